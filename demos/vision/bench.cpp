@@ -0,0 +1,47 @@
+#include <chrono>
+#include <cstdio>
+
+#include "vision.hpp"
+
+// Runs the native gesture pipeline over a recording (or a camera) and reports
+// the per-frame cost. Usage: ./bench frames.pgm
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <frames.pgm | /dev/videoN>\n", argv[0]);
+        return 1;
+    }
+
+    if (vision_open(argv[1])) {
+        return 1;
+    }
+
+    static const char *names[] = {"no hand", "closed", "opened"};
+
+    VISION_RESULT result;
+    int    frames = 0, skipped = 0;
+    double total_us = 0.0, worst_us = 0.0;
+    while (true) {
+        auto start = std::chrono::steady_clock::now();
+        if (!vision_step(&result)) {
+            break;
+        }
+        double us = std::chrono::duration<double, std::micro>(
+                        std::chrono::steady_clock::now() - start).count();
+
+        frames++;
+        skipped  += result.skipped;
+        total_us += us;
+        worst_us  = us > worst_us ? us : worst_us;
+
+        printf("%5d %-8s area %5u fingers %u centroid (%.2f, %.2f) %8.1f us%s\n",
+               frames, names[result.gesture], result.area, result.fingers,
+               result.cx, result.cy, us, result.skipped ? " (skipped)" : "");
+    }
+    vision_close();
+
+    if (frames) {
+        printf("%d frames, %d skipped, mean %.1f us, worst %.1f us\n",
+               frames, skipped, total_us / frames, worst_us);
+    }
+    return 0;
+}
@@ -1,20 +1,9 @@
 import cv2
-import fcntl
 from picamera2 import Picamera2
 import time
 
-GESTURE_NOHAND = "0"
-GESTURE_CLOSED = "1"
-GESTURE_OPENED = "2"
-
-GESTURE_FILE = "/tmp/gesture.txt"
-
-def write_gesture(value):
-    with open(GESTURE_FILE, 'w') as f:
-        fcntl.flock(f, fcntl.LOCK_EX)  # exclusive lock
-        f.write(value + "\n")
-        f.flush()
-        fcntl.flock(f, fcntl.LOCK_UN)  # unlock
+from gesture_ipc import (GestureChannel, GESTURE_NOHAND, GESTURE_CLOSED,
+                         GESTURE_OPENED)
 
 def count_fingers(contour):
     hull = cv2.convexHull(contour, returnPoints=False)
@@ -29,7 +18,11 @@ def count_fingers(contour):
             return count
     return 0
 
+ROI_SIZE = 180
+
 def detect_gesture(frame):
+    """Returns (gesture, fingers, cx, cy, area) with the continuous features
+    normalized to the ROI."""
     roi = frame[60:240, 60:240]  # Focus on center
     gray = cv2.cvtColor(roi, cv2.COLOR_BGR2GRAY)
     blur = cv2.GaussianBlur(gray, (35, 35), 0)
@@ -39,13 +32,20 @@ def detect_gesture(frame):
     if contours:
         cnt = max(contours, key=cv2.contourArea)
         print(f"Contour area: {cv2.contourArea(cnt)}")
-        if cv2.contourArea(cnt) > 2500:
+        area = cv2.contourArea(cnt)
+        if area > 2500:
             finger_count = count_fingers(cnt)
+            m = cv2.moments(cnt)
+            cx = m["m10"] / m["m00"] / ROI_SIZE if m["m00"] else 0.5
+            cy = m["m01"] / m["m00"] / ROI_SIZE if m["m00"] else 0.5
+            features = (finger_count, cx, cy, area / (ROI_SIZE * ROI_SIZE))
             if finger_count <= 1:
-                return "Closed Fist"
+                return ("Closed Fist",) + features
             else:
-                return "Open Hand"
-    return "No Hand"
+                return ("Open Hand",) + features
+    return ("No Hand", 0, 0.5, 0.5, 0.0)
+
+channel = GestureChannel()
 
 # Initialize camera
 picam2 = Picamera2()
@@ -61,19 +61,21 @@ try:
     last_gesture = ""
     while True:
         frame = picam2.capture_array()
-        gesture = detect_gesture(frame)
+        gesture, fingers, cx, cy, area = detect_gesture(frame)
 
         if gesture != last_gesture:
             print(f"Detected gesture: {gesture}")
             last_gesture = gesture
-            if gesture == "No Hand":
-                write_gesture(GESTURE_NOHAND)
-            elif gesture == "Closed Fist":
-                write_gesture(GESTURE_CLOSED)
-            else:
-                write_gesture(GESTURE_OPENED)
 
-        time.sleep(0.5)  # Adjust delay as needed
+        # Every frame is published: the app smooths the hand position into
+        # continuous controls. capture_array() paces the loop.
+        if gesture == "No Hand":
+            code = GESTURE_NOHAND
+        elif gesture == "Closed Fist":
+            code = GESTURE_CLOSED
+        else:
+            code = GESTURE_OPENED
+        channel.publish(code, fingers, cx, cy, area)
 
 except KeyboardInterrupt:
     print("Exiting gesture detection.")
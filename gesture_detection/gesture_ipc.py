@@ -0,0 +1,114 @@
+"""
+Writer side of the gesture channel (see include/gesture_ipc.hpp for the
+layout). The app reads it with a couple of memory loads per main loop pass,
+so updates cost this process two stores, two fences and at most one futex
+wake -- no files, no locks.
+"""
+import ctypes
+import ctypes.util
+import mmap
+import os
+import platform
+import struct
+import time
+
+SHM_PATH = "/dev/shm/daw-gesture"
+SHM_SIZE = 64
+SHM_MAGIC = 0x47574144
+SHM_VERSION = 2
+
+GESTURE_NOHAND = 0
+GESTURE_CLOSED = 1
+GESTURE_OPENED = 2
+
+OFF_MAGIC = 0
+OFF_VERSION = 4
+OFF_SEQ = 8
+OFF_WAITERS = 12
+OFF_GESTURE = 16
+OFF_FINGERS = 20
+OFF_STAMP = 24
+
+FUTEX_WAKE = 1
+SYS_FUTEX = {"x86_64": 202, "aarch64": 98, "armv7l": 240, "armv6l": 240}
+SEQ_CST = 5
+
+_libc = ctypes.CDLL(None, use_errno=True)
+
+# Python gives no ordering guarantees between two mmap stores; on the Pi's
+# weakly ordered cores the seqlock needs real fences, which only libatomic
+# offers from here (a syscall is not a barrier). Without it the app would
+# read torn frames, so refuse to start. CDLL(None) would load the
+# interpreter itself, hence the explicit check.
+_atomic_name = ctypes.util.find_library("atomic")
+try:
+    if not _atomic_name:
+        raise OSError("not found")
+    _atomic_fence = ctypes.CDLL(_atomic_name).atomic_thread_fence
+except (OSError, AttributeError) as err:
+    raise ImportError("gesture channel needs libatomic (apt install "
+                      "libatomic1): %s" % err) from err
+
+
+def _fence():
+    _atomic_fence(SEQ_CST)
+
+
+def _map_channel():
+    """Maps the channel, None when what is there has another size or
+    layout."""
+    fd = os.open(SHM_PATH, os.O_RDWR | os.O_CREAT, 0o666)
+    try:
+        st = os.fstat(fd)
+        if st.st_size not in (0, SHM_SIZE):
+            return None
+        # The mode above went through the umask; the app may run as root
+        # and still has to map it, so whoever creates it opens it up
+        if st.st_uid == os.geteuid():
+            os.fchmod(fd, 0o666)
+        if st.st_size < SHM_SIZE:
+            os.ftruncate(fd, SHM_SIZE)
+        mem = mmap.mmap(fd, SHM_SIZE)
+    finally:
+        os.close(fd)
+
+    magic, version = struct.unpack_from("<II", mem, OFF_MAGIC)
+    if magic == 0:
+        struct.pack_into("<II", mem, OFF_MAGIC, SHM_MAGIC, SHM_VERSION)
+    elif magic != SHM_MAGIC or version != SHM_VERSION:
+        mem.close()
+        return None
+    return mem
+
+
+class GestureChannel:
+    def __init__(self):
+        self._mem = _map_channel()
+        if self._mem is None:
+            # Left by an older build, it stays in /dev/shm until reboot
+            os.unlink(SHM_PATH)
+            self._mem = _map_channel()
+        if self._mem is None:
+            raise RuntimeError("gesture channel has an unknown layout")
+
+        self._seq_addr = ctypes.addressof(
+            ctypes.c_uint32.from_buffer(self._mem, OFF_SEQ))
+        self._sys_futex = SYS_FUTEX.get(platform.machine())
+
+    def publish(self, gesture, fingers=0, cx=0.5, cy=0.5, area=0.0):
+        """Publish one analysed frame; call it for every frame, not only on
+        gesture changes, so the continuous features keep flowing."""
+        seq = struct.unpack_from("<I", self._mem, OFF_SEQ)[0]
+
+        struct.pack_into("<I", self._mem, OFF_SEQ, (seq + 1) & 0xFFFFFFFF)
+        _fence()
+        struct.pack_into("<IIQfff", self._mem, OFF_GESTURE, gesture, fingers,
+                         time.monotonic_ns(), cx, cy, area)
+        _fence()
+        struct.pack_into("<I", self._mem, OFF_SEQ, (seq + 2) & 0xFFFFFFFF)
+        _fence()
+
+        waiters = struct.unpack_from("<I", self._mem, OFF_WAITERS)[0]
+        if waiters and self._sys_futex is not None:
+            _libc.syscall(self._sys_futex, ctypes.c_void_p(self._seq_addr),
+                          FUTEX_WAKE, 0x7FFFFFFF, None, None, 0)
@@ -0,0 +1,98 @@
+#ifndef DAW_AUDIO_H
+#define DAW_AUDIO_H
+
+#include <cstdint>
+
+#define DEFAULT_SAMPLE_RATE 44100
+#define DEFAULT_PERIOD      256
+#define DEFAULT_PERIODS     2
+
+#define MIN_SAMPLE_RATE 8000
+#define MAX_SAMPLE_RATE 96000
+#define MIN_PERIOD      16
+#define MAX_PERIOD      2048
+
+#define AUDIO_CHANNELS 2
+
+/*
+ * One period of capture, read where the backend has it (the PortAudio
+ * buffer, the ALSA mmap area, the JACK ports): sample i of channel c is
+ * channel[c][i * stride], valid for the callback it is handed to. latency is
+ * what the backend measured for it, in frames from the first of them hitting
+ * the converter to the first frame of the same period's output leaving it.
+ */
+typedef struct audio_input {
+    const float *channel[AUDIO_CHANNELS];
+    uint32_t     stride;
+    uint8_t      channels;   // 0 when nothing was captured for the period
+    uint32_t     latency;
+} AUDIO_INPUT;
+
+// Fills frames of interleaved stereo float, on the audio thread. in is
+// never null, it has no channels without capture.
+typedef void (*AUDIO_RENDER)(const AUDIO_INPUT *in, float *out,
+                             unsigned int frames, void *user);
+
+typedef enum audio_backend_type {
+    AUDIO_PORTAUDIO = 0,
+    AUDIO_ALSA,      // Direct mmap access to a hw/plughw PCM
+    AUDIO_JACK,
+    AUDIO_NULL,      // No device, free-runs on a timer (CI, profiling)
+    AUDIO_BACKEND_CNT
+} AUDIO_BACKEND_TYPE;
+
+typedef struct audio_config {
+    AUDIO_BACKEND_TYPE backend;
+    uint32_t           sample_rate;
+    uint32_t           period;     // Frames per callback
+    uint32_t           periods;    // Periods in the device buffer
+    char               device[64]; // Backend specific, empty for the default
+    uint8_t            input;      // Channels captured, 0 for output only
+} AUDIO_CONFIG;
+
+/*
+ * Every backend implements these. open() may change config to what the
+ * device actually accepted (JACK imposes both rate and period). With input
+ * set, capture runs on the same clock and periods as playback.
+ */
+typedef struct audio_backend {
+    const char *name;
+    uint8_t   (*open)(AUDIO_CONFIG *config, AUDIO_RENDER render, void *user);
+    uint8_t   (*start)();
+    void      (*stop)();
+    void      (*close)();
+} AUDIO_BACKEND;
+
+extern const AUDIO_BACKEND portaudio_backend;
+extern const AUDIO_BACKEND alsa_backend;
+extern const AUDIO_BACKEND jack_backend;
+extern const AUDIO_BACKEND null_backend;
+
+/*
+ * Defaults, overridden by the environment:
+ *   DAW_AUDIO_BACKEND  portaudio | alsa | jack | null
+ *   DAW_SAMPLE_RATE, DAW_PERIOD, DAW_PERIODS, DAW_AUDIO_DEVICE,
+ *   DAW_AUDIO_INPUT (channels captured)
+ */
+AUDIO_CONFIG audio_default_config();
+
+uint8_t audio_open(const AUDIO_CONFIG& config, AUDIO_RENDER render,
+                   void *user);
+
+uint8_t audio_start();
+
+void audio_stop();
+
+void audio_close();
+
+// Settings of the open device, fixed while it runs
+uint32_t audio_sample_rate();
+
+uint32_t audio_period();
+
+uint8_t audio_input_channels();
+
+// Gives the calling thread real-time priority, for backends owning a thread
+void audio_set_realtime();
+
+#endif
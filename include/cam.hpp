@@ -3,6 +3,8 @@
 
 void init_cam();
 
+void cleanup_cam();
+
 void cam_check_gesture();
 
 #endif
@@ -0,0 +1,113 @@
+#ifndef DAW_CONFIG_H
+#define DAW_CONFIG_H
+
+#include <cstdint>
+
+#include "audio.hpp"
+#include "envelope.hpp"
+#include "filter.hpp"
+#include "keys.hpp"
+#include "looper.hpp"
+#include "mod.hpp"
+#include "sequencer.hpp"
+#include "sound.hpp"
+#include "touch.hpp"
+
+#define CONFIG_PATH "config_files/daw.conf"
+
+#define CONFIG_NAME_LEN 5   // Same as key::name
+#define CONFIG_PATH_LEN 128
+
+#define CONFIG_SUGGEST_CNT 2
+
+/*
+ * Everything that used to be a #define or a static table spread across the
+ * modules, in one flat block. The whole file is parsed and validated in a
+ * single pass; a snapshot is never modified once published, so readers just
+ * take config() and index straight into it.
+ *
+ * [envelope], [oscillator], [filter], [modulation], [tuning] and [leds] are
+ * reapplied while running when the file changes, every other section is read
+ * once at startup.
+ */
+typedef struct daw_config {
+    // [devices]
+    uint8_t      keys_address;     // MCP23017
+    uint8_t      analog_address;   // ADS7830
+    uint8_t      accel_address;    // MPU6050
+    uint8_t      touch_pins[MAX_TOUCH];
+    uint8_t      led_brightness;
+    uint8_t      disp_fast_baud;   // 1 switches the Nextion to 115200 baud
+
+    // [audio], the DAW_* environment variables still override it
+    AUDIO_CONFIG audio;
+
+    // [engine]
+    uint8_t      voices;           // Polyphony, up to MAX_VOICES
+    uint8_t      voice_steal;      // VOICE_STEAL
+    uint8_t      workers;          // Render threads besides the callback
+
+    // [envelope]
+    ENVELOPE_SETTINGS envelope;
+
+    // [oscillator]
+    uint8_t      wave;             // SIGNAL_TYPE a closed hand switches to
+    float        pulse_width;
+
+    // [filter], the cutoff comes from its pot
+    FILTER_SETTINGS filter;
+
+    // [modulation]
+    MOD_SETTINGS mod;
+
+    // [camera]
+    uint8_t      theremin;         // 1 plays the hand position, see cam.cpp
+
+    // [samples]
+    char         sample_paths[SAMPLE_CNT][CONFIG_PATH_LEN];
+
+    // [input], with [audio] input set
+    float        input_gain;       // dB
+    float        input_send;       // Share sent to the reverbs, 0..1
+    uint8_t      input_filter;     // 1 runs it through the synth filter
+    uint8_t      input_detect;     // 1 shows the notes heard, see detect.hpp
+
+    // [convolution]
+    char         impulse_path[CONFIG_PATH_LEN];  // Empty for none
+    float        conv_wet;
+
+    // [looper]
+    uint32_t     looper_seconds;   // Longest loop, 0 leaves the looper out
+
+    // [recorder]
+    char         record_dir[CONFIG_PATH_LEN];   // Where takes are written
+    uint8_t      record_flac;                   // 0 float WAV, 1 24-bit FLAC
+
+    // [sequencer], the pattern the engine starts with
+    SEQ_PATTERN  sequencer;
+
+    // [keys]
+    char         key_names[MAX_KEYS][CONFIG_NAME_LEN];
+
+    // [tuning]
+    float        reference_pitch;        // Hz of reference_key in octave 0
+    uint8_t      reference_key;
+    char         scale_name[CONFIG_PATH_LEN];  // TUNING_EQUAL or a .scl path
+
+    // [leds]
+    uint8_t      key_leds[MAX_KEYS];     // Strip position of every key
+    uint16_t     scale;                  // Bit per key lit in the scale color
+    uint32_t     color_pressed;
+    uint32_t     color_scale;
+    uint32_t     color_suggest[CONFIG_SUGGEST_CNT];
+} DAW_CONFIG;
+
+// Loads CONFIG_PATH (defaults if it is missing) and starts watching it
+uint8_t init_config();
+
+void cleanup_config();
+
+// Current snapshot, always valid after init_config()
+const DAW_CONFIG *config();
+
+#endif
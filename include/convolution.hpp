@@ -0,0 +1,92 @@
+#ifndef DAW_CONVOLUTION_H
+#define DAW_CONVOLUTION_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "fft.hpp"
+
+#define CONV_SUCCESS 0
+#define CONV_OPENERR 1
+#define CONV_RATEERR 2
+
+// Early partitions, convolved in the callback. The wet signal comes out one
+// block late.
+#define CONV_BLOCK 128
+
+// Tail partitions, convolved on the tail thread
+#define CONV_TAIL_BLOCK 1024
+
+/*
+ * The early stage covers the first two tail blocks of the response: a tail
+ * block handed over when its input is complete is then first heard one tail
+ * block later, which is the time the tail thread gets for it.
+ */
+#define CONV_EARLY_PARTS (2 * CONV_TAIL_BLOCK / CONV_BLOCK)
+
+// Tail input blocks kept for the thread to catch up on
+#define CONV_TAIL_RING 4
+
+#define CONV_MAX_CHANNELS 2
+#define CONV_MAX_SECONDS  10
+
+// One uniformly partitioned overlap-save convolution
+typedef struct conv_stage {
+    FFT       fft;       // Of two blocks
+    uint32_t  block;
+    uint32_t  bins;
+    uint32_t  parts;
+    uint8_t   channels;
+    float    *h_re;      // [channel][part][bin], response spectra
+    float    *h_im;
+    float    *x_re;      // [part][bin], spectra of past input windows
+    float    *x_im;
+    uint32_t  head;      // Newest entry of x
+    float    *window;    // Last two blocks of input
+    float    *acc_re;    // [bin]
+    float    *acc_im;
+    float    *y;         // Two blocks, the second half is the output
+} CONV_STAGE;
+
+typedef struct convolution {
+    bool       loaded;
+    uint8_t    channels;  // Of the response, 1 or 2
+    CONV_STAGE early;
+    CONV_STAGE tail;
+
+    // Callback side
+    float      in[CONV_BLOCK];
+    float      out[CONV_MAX_CHANNELS][CONV_BLOCK];  // Block being played
+    uint32_t   fill;
+    float      tail_out[CONV_MAX_CHANNELS][CONV_TAIL_BLOCK];
+    uint32_t   tail_pos;
+    float     *tail_in;     // CONV_TAIL_RING blocks of input
+    uint32_t   tail_fill;
+    uint32_t   handed;      // Tail blocks handed to the thread
+
+    // Tail thread
+    std::thread           thread;
+    std::atomic<uint32_t> requested;  // Futex word, blocks to convolve
+    std::atomic<uint32_t> done;       // Blocks convolved
+    std::atomic<bool>     stopping;
+    std::atomic<uint32_t> missed;     // Tail blocks that weren't ready
+    float                *result;     // [2][channel][CONV_TAIL_BLOCK]
+} CONVOLUTION;
+
+/*
+ * Loads an impulse response from a WAV (or anything libsndfile reads) and
+ * starts its tail thread. Mono responses play the same on both sides, the
+ * first two channels of anything wider are used. The response is scaled to
+ * unit energy so responses of any length come out about as loud.
+ */
+uint8_t conv_load(CONVOLUTION *conv, const char *path, uint32_t rate);
+
+// Stops the tail thread and frees the response, only with the stream stopped
+void conv_unload(CONVOLUTION *conv);
+
+// Audio side: frames of input, adds wet times the response to left and right
+void conv_process(CONVOLUTION *conv, const float *in, float *left,
+                  float *right, float wet, unsigned int frames);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef DAW_DETECT_H
+#define DAW_DETECT_H
+
+#include <cstdint>
+
+#include "audio.hpp"
+
+#define DETECT_SUCCESS 0
+#define DETECT_INITERR 1
+
+// Analysed every hop over the last window of the input, mixed to mono
+#define DETECT_WINDOW     4096
+#define DETECT_HOP        1024
+#define DETECT_YIN_WINDOW 2048   // Newest part of it, for the pitch
+
+// Notes reported at once, a four note chord at most
+#define DETECT_MAX_NOTES 4
+
+/*
+ * Starts the analysis thread when [input] detect is on and the stream has
+ * input, does nothing otherwise. After init_sound().
+ */
+uint8_t init_detect();
+
+// Stops the thread and reports what the analysis cost
+void cleanup_detect();
+
+/*
+ * Audio side: a block of capture for the analysis, never blocks. Blocks
+ * are dropped while the thread is behind or not running.
+ */
+void detect_write(const AUDIO_INPUT *in, unsigned int frames);
+
+/*
+ * Main loop: a note or chord heard steadily on the input since the last
+ * call goes to the chord display and the LED suggestions, like keys.
+ */
+void loop_detect();
+
+#endif
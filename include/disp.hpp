@@ -1,12 +1,35 @@
 #ifndef DAW_DISP_H
 #define DAW_DISP_H
 
+#include <cstdint>
+#include <string>
+
+// Nextion components driven by the app (see the component table in disp.cpp)
+typedef enum disp_field {
+    DISP_CHORD = 0,     // t0 - detected chord
+    DISP_COMPOSITION,   // t1 - pressed keys
+    DISP_SUG1_CHORD,    // t2 - first suggestion
+    DISP_SUG1_PATH,     // t3 - first suggestion progression
+    DISP_SUG2_CHORD,    // t4 - second suggestion
+    DISP_SUG2_PATH,     // t5 - second suggestion progression
+    DISP_LEVEL,         // j0 - master level bar (0-100)
+    DISP_CLIP,          // t6 - clip indicator
+    DISP_FIELD_CNT
+} DISP_FIELD;
+
 uint8_t init_disp();
 
 void cleanup_disp();
 
-void set_chord(std::string chord, std::string composition);
+// Stage a new value for a component. Nothing is sent until disp_commit().
+void set_disp_field(DISP_FIELD field, const std::string& value);
+
+void set_chord(const std::string& chord, const std::string& composition);
+
+void set_suggestion(uint8_t slot, const std::string& chord,
+                    const std::string& path);
 
-void set_suggestions(std::string sug1, std::string sug2);
+// Hand every changed component to the writer thread as a single frame
+void disp_commit();
 
 #endif
@@ -0,0 +1,54 @@
+#ifndef DAW_ENVELOPE_H
+#define DAW_ENVELOPE_H
+
+#include <cstdint>
+
+// Level taken as silence: voices start from it and are dropped on reaching it
+#define ENV_FLOOR_DB -80.0f
+
+typedef enum env_stage {
+    ENV_IDLE = 0,
+    ENV_ATTACK,
+    ENV_DECAY,
+    ENV_SUSTAIN,
+    ENV_RELEASE
+} ENV_STAGE;
+
+/*
+ * Every segment is a straight line in dB, which is how a level is heard to
+ * fade. Times are rates: how long the segment would take to cross the whole
+ * range between silence and full level. A decay to -6 dB is then over in a
+ * small part of its time, and a release from any level fades at the same
+ * speed.
+ */
+typedef struct envelope_settings {
+    float attack;   // ms
+    float decay;    // ms
+    float sustain;  // dB, ENV_FLOOR_DB..0
+    float release;  // ms
+} ENVELOPE_SETTINGS;
+
+typedef struct envelope {
+    ENV_STAGE stage;
+    float     level;  // dB
+} ENVELOPE;
+
+// A voice taken over while still sounding attacks from where it is
+void envelope_start(ENVELOPE *env);
+
+void envelope_release(ENVELOPE *env);
+
+// Level as a modulation source, 0 (silent) to 1 (full)
+float envelope_amount(const ENVELOPE *env);
+
+/*
+ * Moves env on by a block of frames. Gain is the factor for the first frame
+ * and step what it is multiplied by on every following one, so the block is
+ * one exponential ramp and a corner between segments is rounded off over it.
+ * Returns false once the envelope was already silent, the voice can go.
+ */
+bool envelope_block(ENVELOPE *env, const ENVELOPE_SETTINGS *settings,
+                    float rate, unsigned int frames, float *gain,
+                    float *step);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef DAW_EVENTS_H
+#define DAW_EVENTS_H
+
+#include <cstdint>
+
+/*
+ * Timestamped control events for the audio callback.
+ *
+ * Time is counted in stream frames. Producers are stamped with the current
+ * stream time plus a fixed latency of one period, and the callback splits its
+ * block so every event lands on its exact frame. The constant offset is the
+ * price for removing the jitter of the buffer boundaries.
+ */
+
+typedef enum event_type {
+    EV_NOTE_ON = 0, // index: note, see tuning.hpp
+    EV_NOTE_OFF,    // index: note
+    EV_SAMPLE,      // index: sample
+    EV_VIBRATO,
+    EV_LOOPER,      // index: LOOPER_COMMAND
+} EVENT_TYPE;
+
+typedef struct event {
+    uint64_t   frame;
+    EVENT_TYPE type;
+    uint8_t    index;
+    float      value; // Velocity for notes and samples, 0..1
+} EVENT;
+
+uint8_t init_events();
+
+void cleanup_events();
+
+// Control side, any thread. Returns false if the queue is full.
+bool events_post(EVENT_TYPE type, uint8_t index, float value);
+
+// Same, for producers that know when the event really happened (e.g. MIDI
+// arrival stamps). Never scheduled before anything already queued.
+bool events_post_at(EVENT_TYPE type, uint8_t index, float value,
+                    uint64_t frame);
+
+// Stream frame an event posted right now would be scheduled on
+uint64_t events_now();
+
+/*
+ * Audio side. events_clock() is called once at the start of every block with
+ * the frame it begins on; events_pop() hands out, in order, the events due
+ * before the given frame.
+ */
+void events_clock(uint64_t frame);
+
+bool events_pop(uint64_t before, EVENT *event);
+
+// Frame of the oldest queued event, UINT64_MAX when there is none
+uint64_t events_next_due();
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef DAW_FFT_H
+#define DAW_FFT_H
+
+#include <cstdint>
+
+#define FFT_SUCCESS 0
+#define FFT_SIZEERR 1
+
+/*
+ * Real FFT of a fixed power of two size, done as a complex FFT of half the
+ * size plus a split. Spectra are kept as separate real and imaginary arrays
+ * of size / 2 + 1 bins so products over them vectorize. Every table and the
+ * working buffer are allocated up front; a plan is used by one thread at a
+ * time.
+ */
+typedef struct fft {
+    uint32_t  size;
+    uint32_t  half;
+    uint32_t *reverse;   // Bit reversed index, half entries
+    float    *cos;       // Twiddles of the half size FFT, half / 2 entries
+    float    *sin;
+    float    *split_cos; // e^(-2 pi i k / size) for the split, half + 1
+    float    *split_sin;
+    float    *work_re;   // half entries
+    float    *work_im;
+} FFT;
+
+uint8_t fft_init(FFT *fft, uint32_t size);
+
+void fft_cleanup(FFT *fft);
+
+// size samples in, size / 2 + 1 bins out
+void fft_forward(FFT *fft, const float *in, float *re, float *im);
+
+// size / 2 + 1 bins in, size samples out, scaled back by 1 / size
+void fft_inverse(FFT *fft, const float *re, const float *im, float *out);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef DAW_FILTER_H
+#define DAW_FILTER_H
+
+#include <cstdint>
+
+#include "voices.hpp"
+
+// Voices filtered side by side, one per lane of a 128-bit register
+#define FILTER_LANES  4
+#define FILTER_GROUPS (MAX_VOICES / FILTER_LANES)
+
+// Range the cutoff control (0..1) sweeps, evenly in octaves
+#define FILTER_MIN_HZ 20.0f
+#define FILTER_MAX_HZ 20000.0f
+
+typedef float v4f __attribute__((vector_size(16)));
+
+typedef enum filter_mode {
+    FILTER_OFF = 0,
+    FILTER_LOW,
+    FILTER_BAND,
+    FILTER_HIGH,
+    FILTER_MODE_CNT
+} FILTER_MODE;
+
+typedef struct filter_settings {
+    uint8_t mode;        // FILTER_MODE
+    float   resonance;   // 0..1, rings on its own just short of 1
+    float   key_track;   // 0: same cutoff for every note, 1: follows pitch
+} FILTER_SETTINGS;
+
+/*
+ * One state variable filter (trapezoidal integrators, stable under any
+ * modulation) per voice. Voice v is lane v % FILTER_LANES of group
+ * v / FILTER_LANES, every array is a whole group per element so a group runs
+ * as plain vector arithmetic (NEON on the Pi, SSE elsewhere).
+ */
+typedef struct filter_bank {
+    v4f ic1[FILTER_GROUPS];  // Integrator states
+    v4f ic2[FILTER_GROUPS];
+    v4f a1[FILTER_GROUPS];   // Set by filter_tune()
+    v4f a2[FILTER_GROUPS];
+    v4f a3[FILTER_GROUPS];
+    v4f m0[FILTER_GROUPS];   // Mix of input, band and low outputs
+    v4f m1[FILTER_GROUPS];
+    v4f m2[FILTER_GROUPS];
+} FILTER_BANK;
+
+// Cutoff in Hz of the 0..1 control
+float filter_cutoff_hz(float control);
+
+// Empties the state of a voice, for a new note
+void filter_reset(FILTER_BANK *bank, uint8_t voice);
+
+// New coefficients for a voice, cutoff as a fraction of the sample rate
+void filter_tune(FILTER_BANK *bank, uint8_t voice, FILTER_MODE mode,
+                 float cutoff, float resonance);
+
+// Filters a group in place, frame i of voice lane l at lanes[i][l]
+void filter_run(FILTER_BANK *bank, uint8_t group, v4f *lanes,
+                unsigned int frames);
+
+#endif
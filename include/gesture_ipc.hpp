@@ -0,0 +1,86 @@
+#ifndef DAW_GESTURE_IPC_H
+#define DAW_GESTURE_IPC_H
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Gesture channel shared with the detector process.
+ *
+ * POSIX shared memory object GESTURE_SHM_NAME (/dev/shm/daw-gesture),
+ * GESTURE_SHM_SIZE bytes, native endianness, every field 32/64-bit aligned:
+ *
+ *   offset size field
+ *   0      4    magic     GESTURE_SHM_MAGIC ("DAWG"), set by whoever creates it
+ *   4      4    version   GESTURE_SHM_VERSION
+ *   8      4    seq       seqlock counter, odd while the writer is updating
+ *   12     4    waiters   number of readers blocked in FUTEX_WAIT on seq
+ *   16     4    gesture   GESTURE_CODE
+ *   20     4    fingers   extended fingers (u32)
+ *   24     8    stamp_ns  CLOCK_MONOTONIC time of the frame
+ *   32     4    cx        hand centroid x, 0 (left) .. 1 (right), f32
+ *   36     4    cy        hand centroid y, 0 (top) .. 1 (bottom), f32
+ *   40     4    area      hand area as a fraction of the ROI, f32
+ *   44     20   reserved
+ *
+ * The writer publishes every analysed frame, so the continuous fields arrive
+ * at the camera frame rate.
+ *
+ * Writer: seq++ (odd), fence, write payload, fence, seq++ (even), then
+ * FUTEX_WAKE on seq when waiters is non-zero. There must be a single writer.
+ *
+ * Reader: load seq; if odd or unchanged, there is nothing new. Otherwise copy
+ * the payload and accept it only if seq still holds the same value.
+ */
+
+#define GESTURE_SHM_NAME    "/daw-gesture"
+#define GESTURE_SHM_MAGIC   0x47574144u
+#define GESTURE_SHM_VERSION 2
+#define GESTURE_SHM_SIZE    64
+
+typedef enum gesture_code {
+    GESTURE_NOHAND = 0,
+    GESTURE_CLOSED = 1,
+    GESTURE_OPENED = 2,
+} GESTURE_CODE;
+
+typedef struct gesture_shm {
+    std::atomic<uint32_t> magic;
+    std::atomic<uint32_t> version;
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> waiters;
+    std::atomic<uint32_t> gesture;
+    std::atomic<uint32_t> fingers;
+    std::atomic<uint64_t> stamp_ns;
+    std::atomic<float>    cx;
+    std::atomic<float>    cy;
+    std::atomic<float>    area;
+    uint32_t              reserved[5];
+} GESTURE_SHM;
+
+static_assert(sizeof(GESTURE_SHM) == GESTURE_SHM_SIZE,
+              "gesture channel layout changed");
+
+typedef struct gesture_state {
+    GESTURE_CODE gesture;
+    uint32_t     fingers;
+    uint64_t     stamp_ns;
+    float        cx, cy;
+    float        area;
+} GESTURE_STATE;
+
+// Maps (and creates if needed) the channel
+uint8_t gesture_ipc_open();
+
+void gesture_ipc_close();
+
+// Non-blocking and syscall free. Returns true when a new update was read.
+bool gesture_ipc_poll(GESTURE_STATE *state);
+
+// Blocks until the channel changes or timeout_ms elapses
+void gesture_ipc_wait(int timeout_ms);
+
+// In-process writer, for detectors running inside the app
+void gesture_ipc_publish(const GESTURE_STATE& state);
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef DAW_GRAPH_H
+#define DAW_GRAPH_H
+
+#include <cstdint>
+
+#include "audio.hpp"
+
+#define GRAPH_SUCCESS 0
+#define GRAPH_CYCLE   1  // Routing loops back on itself
+#define GRAPH_NOBUFS  2  // More signals alive at once than GRAPH_MAX_BUFFERS
+
+#define GRAPH_MAX_NODES   16
+#define GRAPH_MAX_PORTS   4   // Inputs or outputs of a node, mono each
+#define GRAPH_MAX_EDGES   (GRAPH_MAX_NODES * GRAPH_MAX_PORTS)
+#define GRAPH_MAX_BUFFERS 16
+
+#define GRAPH_NONE 0xFF
+
+/*
+ * Renders one stretch. in has an entry per input port, reading silence where
+ * nothing is connected; out has one per output port and every frame of it
+ * must be written. Runs on the audio thread, same rules as the callback.
+ */
+typedef void (*GRAPH_PROCESS)(void *ctx, const float *const *in,
+                              float *const *out, unsigned int frames);
+
+typedef struct graph_node {
+    const char   *name;
+    GRAPH_PROCESS process;
+    void         *ctx;
+    uint8_t       inputs;
+    uint8_t       outputs;
+} GRAPH_NODE;
+
+// An input port takes a single edge, buses sum their inputs themselves
+typedef struct graph_edge {
+    uint8_t from;
+    uint8_t from_port;
+    uint8_t to;
+    uint8_t to_port;
+} GRAPH_EDGE;
+
+/*
+ * Routing as set up by the control side. Nothing here is read by the audio
+ * thread apart from the buffers, which only a plan points into.
+ */
+typedef struct graph {
+    GRAPH_NODE node[GRAPH_MAX_NODES];
+    uint8_t    node_cnt;
+    GRAPH_EDGE edge[GRAPH_MAX_EDGES];
+    uint8_t    edge_cnt;
+    uint8_t    output;  // Its first two outputs are the stereo out
+
+    alignas(64) float buffers[GRAPH_MAX_BUFFERS][MAX_PERIOD];
+    alignas(64) float silence[MAX_PERIOD];
+} GRAPH;
+
+typedef struct graph_step {
+    GRAPH_PROCESS process;
+    void         *ctx;
+    uint8_t       node;
+    uint8_t       level;
+    const float  *in[GRAPH_MAX_PORTS];
+    float        *out[GRAPH_MAX_PORTS];
+} GRAPH_STEP;
+
+/*
+ * What the audio thread runs: steps in dependency order, grouped in levels.
+ * Every step of a level only reads what earlier levels wrote and no buffer
+ * is handed out again within the level it was last read in, so the steps of
+ * one level can run side by side.
+ */
+typedef struct graph_plan {
+    GRAPH_STEP step[GRAPH_MAX_NODES];
+    uint8_t    count;
+    uint8_t    levels;
+    uint8_t    level_start[GRAPH_MAX_NODES + 1];  // First step of each level
+    uint8_t    buffers;                           // Pool buffers in use
+    const float *output[2];
+} GRAPH_PLAN;
+
+void graph_reset(GRAPH *graph);
+
+// Returns the new node, GRAPH_NONE when full
+uint8_t graph_add(GRAPH *graph, const char *name, GRAPH_PROCESS process,
+                  void *ctx, uint8_t inputs, uint8_t outputs);
+
+// Replaces whatever fed that input
+bool graph_connect(GRAPH *graph, uint8_t from, uint8_t from_port, uint8_t to,
+                   uint8_t to_port);
+
+void graph_disconnect(GRAPH *graph, uint8_t to, uint8_t to_port);
+
+/*
+ * Control side, allocation free. Only the nodes the output depends on are
+ * planned, so an effect taken out of the routing costs nothing. Buffers
+ * follow the liveness of each output: a buffer goes back to the pool after
+ * the level of its last reader, so the pool stays as small as the widest
+ * point of the graph and recently written buffers get reused while warm.
+ */
+uint8_t graph_plan(GRAPH *graph, GRAPH_PLAN *plan);
+
+// Audio side: runs every step and interleaves the output into out
+void graph_run(const GRAPH_PLAN *plan, float *out, unsigned int frames);
+
+#endif
@@ -1,6 +1,20 @@
 #ifndef DAW_LED_H
 #define DAW_LED_H
 
+#include <cstdint>
+
+#define LED_COUNT 18
+
+// Compositor layers, from bottom to top. A lit LED on a higher layer hides
+// whatever the layers below it show.
+typedef enum led_layer {
+    LED_LAYER_BASE = 0,  // Display backlight and scale keys
+    LED_LAYER_PRESSED,   // Keys currently held
+    LED_LAYER_SUGGEST,   // Chord suggestions
+    LED_LAYER_ANIM,      // Animations and meters
+    LED_LAYER_CNT
+} LED_LAYER;
+
 uint8_t init_led();
 
 void cleanup_led();
@@ -11,4 +25,14 @@ void light_suggestions(uint8_t idx_1, uint8_t idx_2);
 
 void turn_off_suggestions();
 
+// Redraws the strip after the LED section of the config changed
+void refresh_led();
+
+// Raw access to a layer by strip position (not key index)
+void set_led_layer(LED_LAYER layer, uint8_t led, uint32_t color);
+
+void clear_led_layer_pixel(LED_LAYER layer, uint8_t led);
+
+void clear_led_layer(LED_LAYER layer);
+
 #endif
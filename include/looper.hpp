@@ -0,0 +1,47 @@
+#ifndef DAW_LOOPER_H
+#define DAW_LOOPER_H
+
+#include <cstdint>
+
+// Loop length limit, [looper] seconds. Every layer is allocated that long.
+#define LOOPER_DEFAULT_SECONDS 30
+#define LOOPER_MAX_SECONDS     120
+#define LOOPER_LAYERS          4
+
+typedef enum looper_command {
+    LOOPER_REC = 0, // Record the first take, then toggle overdub
+    LOOPER_PLAY,    // Toggle playback of the recorded layers
+    LOOPER_UNDO,    // Drop the last layer
+    LOOPER_CLEAR,   // Drop everything
+} LOOPER_COMMAND;
+
+typedef enum looper_mode {
+    LOOPER_IDLE = 0,
+    LOOPER_RECORDING,
+    LOOPER_PLAYING,
+    LOOPER_OVERDUBBING,
+    LOOPER_STOPPED,
+} LOOPER_MODE;
+
+/*
+ * Allocates and locks in memory every layer up front (stereo, max_seconds
+ * long), nothing is allocated afterwards. 0 leaves the looper out, commands
+ * are then ignored. Called by init_sound() before the stream starts.
+ */
+uint8_t init_looper(uint32_t max_seconds);
+
+// Only valid once the audio stream is stopped
+void cleanup_looper();
+
+// Control side: the command is applied on its frame like any other event
+void looper_command(LOOPER_COMMAND command);
+
+LOOPER_MODE looper_mode();
+
+// Audio side
+void looper_apply(LOOPER_COMMAND command);
+
+// Records from and mixes the loop into an interleaved stereo master buffer
+void looper_process(float *buffer, unsigned int frames);
+
+#endif
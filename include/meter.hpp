@@ -0,0 +1,31 @@
+#ifndef DAW_METER_H
+#define DAW_METER_H
+
+#include <cstdint>
+
+#include "keys.hpp"
+
+// Per-block level summary published by the audio callback
+typedef struct meter_block {
+    float    voice_peak[MAX_KEYS];
+    float    voice_sum_sq[MAX_KEYS];  // RMS is derived off the audio thread
+    float    master_peak;
+    float    master_sum_sq;
+    uint32_t frames;
+} METER_BLOCK;
+
+uint8_t init_meter();
+
+void cleanup_meter();
+
+// Called from the audio callback; never blocks, drops the block when full
+void meter_publish(const METER_BLOCK& block);
+
+// Latest levels in linear amplitude, refreshed at the meter rate
+float meter_voice_level(uint8_t index);
+
+float meter_voice_peak(uint8_t index);
+
+float meter_master_level();
+
+#endif
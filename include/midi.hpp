@@ -0,0 +1,51 @@
+#ifndef DAW_MIDI_H
+#define DAW_MIDI_H
+
+#include <cstdint>
+
+/*
+ * ALSA sequencer virtual port ("DAW-DEV"), connect it with aconnect or from
+ * a DAW. Incoming:
+ *   notes, any channel but 10  -> synth notes, in their own octave
+ *   notes 36/38/42, channel 10 -> kick/snare/hi hat
+ *   CC 1 (mod wheel)           -> wheel mod source, vibrato when pushed
+ *                                 past half
+ *   CC 7                       -> volume
+ *   CC 74                      -> filter cutoff
+ *   CC 91                      -> reverb on/off
+ *   CC 80..83                  -> looper rec/play/undo/clear
+ *   CC 84                      -> sequencer start/stop
+ *   CC 85                      -> recorder start/stop
+ *   CC 86, 87                  -> sequencer tempo, swing
+ *   CC 88                      -> sequencer step recording on/off
+ *   CC 89                      -> sequencer pattern clear
+ *   pitch bend                 -> +-MIDI_BEND_RANGE semitones
+ * The same mapping is used to send the local keys, pads and pots out.
+ */
+
+#define MIDI_CC_MODULATION 1
+#define MIDI_CC_VOLUME     7
+#define MIDI_CC_CUTOFF     74
+#define MIDI_CC_LOOPER     80
+#define MIDI_CC_SEQ_RUN    84
+#define MIDI_CC_RECORD     85
+#define MIDI_CC_SEQ_TEMPO  86
+#define MIDI_CC_SEQ_SWING  87
+#define MIDI_CC_SEQ_STEP   88
+#define MIDI_CC_SEQ_CLEAR  89
+#define MIDI_CC_REVERB     91
+
+uint8_t init_midi();
+
+void cleanup_midi();
+
+// Local activity out to the subscribers of the port
+// note indexes the tuning table, it goes out in its own octave
+void midi_send_note(uint8_t note, bool on);
+
+void midi_send_sample(uint8_t sample);
+
+// value 0..1, only sent when the 7-bit value changes
+void midi_send_control(uint8_t cc, float value);
+
+#endif
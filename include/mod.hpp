@@ -0,0 +1,89 @@
+#ifndef DAW_MOD_H
+#define DAW_MOD_H
+
+#include <cstdint>
+
+#include "envelope.hpp"
+
+#define MOD_LFOS       3
+#define MOD_MAX_ROUTES 8
+
+// Frames between two evaluations of the matrix, destinations are ramped
+// linearly in between
+#define MOD_BLOCK 64
+
+typedef enum mod_source {
+    MOD_SRC_NONE = 0,      // Constant 1, as a via: the route always applies
+    MOD_SRC_LFO1,          // -1..1
+    MOD_SRC_LFO2,
+    MOD_SRC_LFO3,
+    MOD_SRC_ENVELOPE,      // 0..1, the voice's own level envelope
+    MOD_SRC_MOD_ENVELOPE,  // 0..1, a second envelope only for modulation
+    MOD_SRC_VIBRATO,       // 1 when trigger_vibrato() fires, fading to 0
+    MOD_SRC_WHEEL,         // 0..1, MIDI mod wheel
+    MOD_SRC_MOTION,        // 0..1, how hard the board is being moved
+    MOD_SRC_HAND_X,        // -1..1, camera hand position, left to right
+    MOD_SRC_HAND_Y,        // 0..1, bottom to top, 0 without a hand
+    MOD_SRC_CNT
+} MOD_SOURCE;
+
+typedef enum mod_dest {
+    MOD_PITCH = 0,  // Semitones
+    MOD_AMP,        // dB
+    MOD_CUTOFF,     // Octaves
+    MOD_PAN,        // -1 (left) .. 1 (right)
+    MOD_REVERB,     // Reverb send, added to the full send of 1
+    MOD_WIDTH,      // Pulse width
+    MOD_DEST_CNT
+} MOD_DEST;
+
+typedef enum lfo_shape {
+    LFO_SINE = 0,
+    LFO_TRIANGLE,
+    LFO_SAW,
+    LFO_SQUARE,
+    LFO_RANDOM,     // A new random level every cycle
+    LFO_SHAPE_CNT
+} LFO_SHAPE;
+
+// dest moves by depth times source, times via when there is one
+typedef struct mod_route {
+    uint8_t source;  // MOD_SOURCE
+    uint8_t dest;    // MOD_DEST
+    float   depth;   // In the units of dest
+    uint8_t via;     // MOD_SOURCE scaling the route, MOD_SRC_NONE for none
+} MOD_ROUTE;
+
+typedef struct mod_routes {
+    uint8_t   count;
+    MOD_ROUTE route[MOD_MAX_ROUTES];
+} MOD_ROUTES;
+
+typedef struct mod_settings {
+    uint8_t           lfo_shape[MOD_LFOS];  // LFO_SHAPE
+    float             lfo_rate[MOD_LFOS];   // Hz
+    ENVELOPE_SETTINGS envelope;             // MOD_SRC_MOD_ENVELOPE
+    MOD_ROUTES        routes;
+} MOD_SETTINGS;
+
+// Free running, shared by every voice
+typedef struct lfo {
+    float    phase;  // Cycles
+    float    held;   // LFO_RANDOM level of the current cycle
+    uint32_t noise;
+} LFO;
+
+void mod_lfo_reset(LFO *lfo, uint32_t seed);
+
+// Moves an LFO on by frames, returns its value where it lands
+float mod_lfo_advance(LFO *lfo, LFO_SHAPE shape, float rate_hz,
+                      float sample_rate, unsigned int frames);
+
+/*
+ * Runs every route over the source values of one voice. dest gets the sum
+ * for each destination, 0 where nothing is routed.
+ */
+void mod_evaluate(const MOD_SETTINGS *settings, const float *sources,
+                  float *dest);
+
+#endif
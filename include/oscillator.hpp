@@ -0,0 +1,29 @@
+#ifndef DAW_OSCILLATOR_H
+#define DAW_OSCILLATOR_H
+
+#include <cstdint>
+
+// Narrower pulses thin out to nothing and alias, whatever the correction
+#define OSC_MIN_WIDTH 0.05f
+#define OSC_MAX_WIDTH 0.95f
+
+/*
+ * Band-limited waves for the synth voices. The naive shapes are corrected
+ * around every jump (PolyBLEP) or corner (PolyBLAMP) by a short polynomial,
+ * which takes out most of the aliasing for a couple of operations a sample.
+ *
+ * Each call renders a whole stretch of frames. Phase is in cycles and carries
+ * over between calls, step is the phase increment of every frame (pitch bend
+ * and vibrato included) and has to stay under half a cycle. The shape loops
+ * are branch free so they vectorize.
+ */
+void osc_saw(float *phase, const float *step, float *out, unsigned int frames);
+
+// width is the part of the cycle spent high, 0.5 for a square
+void osc_pulse(float *phase, const float *step, float width, float *out,
+               unsigned int frames);
+
+void osc_triangle(float *phase, const float *step, float *out,
+                  unsigned int frames);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef DAW_PARAMS_H
+#define DAW_PARAMS_H
+
+#include <cstdint>
+
+#include "envelope.hpp"
+#include "filter.hpp"
+#include "graph.hpp"
+#include "mod.hpp"
+#include "sequencer.hpp"
+#include "sound.hpp"
+#include "tuning.hpp"
+
+/*
+ * Every engine parameter the control side can change. The audio callback
+ * picks up one immutable snapshot per block and applies it on the frame it
+ * was stamped with, so related changes (e.g. a preset switch) are always seen
+ * together and never torn.
+ *
+ * Notes and other one-shot actions don't belong here, they go through the
+ * event queue (events.hpp).
+ */
+typedef struct engine_params {
+    uint64_t    serial;            // Bumped by every commit, never reused
+    uint64_t    frame;             // Stream frame it takes effect on
+    float       volume;
+    int8_t      octave;
+    const TUNING_TABLE *tuning;    // Pitches, octave picks the offset into it
+    SIGNAL_TYPE type;
+    ENVELOPE_SETTINGS envelope;    // Picked up by sounding voices too
+    float       pulse_width;       // SQUARE_e, same
+    FILTER_SETTINGS filter;        // Same, the cutoff is an EXPRESSION
+    MOD_SETTINGS mod;              // Same
+    bool        reverb;
+    GRAPH_PLAN  graph;             // Routing, planned on the control side
+    SEQ_PATTERN seq;
+} ENGINE_PARAMS;
+
+uint8_t init_params(const ENGINE_PARAMS& initial);
+
+void cleanup_params();
+
+/*
+ * Control side. params_begin() locks out other writers and returns a private
+ * copy of the latest snapshot; params_commit() stamps it with the current
+ * stream time and publishes it with a single pointer swap. Never call these
+ * from the audio callback.
+ */
+ENGINE_PARAMS *params_begin();
+
+void params_commit();
+
+// Drops the edit without publishing it
+void params_abort();
+
+// Latest published octave, for the control side to pick notes with
+int8_t params_octave();
+
+/*
+ * Audio side, once per block: acquire, use the snapshot for the whole block,
+ * release at the end. Lock and allocation free.
+ */
+const ENGINE_PARAMS *params_acquire();
+
+void params_release();
+
+#endif
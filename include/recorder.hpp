@@ -0,0 +1,33 @@
+#ifndef DAW_RECORDER_H
+#define DAW_RECORDER_H
+
+#include <cstdint>
+
+uint8_t init_recorder();
+
+void cleanup_recorder();
+
+/*
+ * Starts bouncing the master output to path. The format follows the
+ * extension: ".flac" for 24-bit FLAC, anything else 32-bit float WAV.
+ */
+uint8_t recorder_start(const char *path);
+
+// Drains what is still buffered, closes the file and reports drops
+void recorder_stop();
+
+/*
+ * Starts a take named after the current time ("take-YYYYMMDD-HHMMSS") in
+ * [recorder] directory, or stops the one running. Mapped to MIDI CC 85.
+ */
+uint8_t recorder_toggle();
+
+bool recorder_active();
+
+// Blocks lost because the writer couldn't keep up, for the current take
+uint32_t recorder_dropped();
+
+// Audio side: copies an interleaved stereo block, never blocks
+void recorder_write(const float *buffer, unsigned int frames);
+
+#endif
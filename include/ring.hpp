@@ -0,0 +1,91 @@
+#ifndef DAW_RING_H
+#define DAW_RING_H
+
+#include <atomic>
+#include <cstddef>
+
+/*
+ * Bounded single-producer/single-consumer queue. Neither side ever blocks or
+ * allocates, so it is safe to push from (or pop into) the audio callback.
+ * N must be a power of two.
+ */
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "ring size must be a power of 2");
+
+public:
+    // Returns false (and drops the item) when the ring is full
+    bool push(const T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        items_[head & (N - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (head_.load(std::memory_order_acquire) == tail) {
+            return false;
+        }
+        item = items_[tail & (N - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*
+     * In place alternatives for large items, saving the copy through item.
+     * claim() returns the free slot at the head (nullptr when full), which
+     * the producer fills and hands over with publish(). front() returns the
+     * oldest item, which stays valid until the consumer calls release().
+     */
+    T *claim() {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == N) {
+            return nullptr;
+        }
+        return &items_[head & (N - 1)];
+    }
+
+    void publish() {
+        head_.store(head_.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_release);
+    }
+
+    T *front() {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (head_.load(std::memory_order_acquire) == tail) {
+            return nullptr;
+        }
+        return &items_[tail & (N - 1)];
+    }
+
+    void release() {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_release);
+    }
+
+    // Consumer side: looks at the oldest item without removing it
+    bool peek(T& item) const {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (head_.load(std::memory_order_acquire) == tail) {
+            return false;
+        }
+        item = items_[tail & (N - 1)];
+        return true;
+    }
+
+    size_t size() const {
+        return head_.load(std::memory_order_acquire)
+               - tail_.load(std::memory_order_acquire);
+    }
+
+private:
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    T items_[N];
+};
+
+#endif
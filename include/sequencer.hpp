@@ -0,0 +1,82 @@
+#ifndef DAW_SEQUENCER_H
+#define DAW_SEQUENCER_H
+
+#include <cstdint>
+
+#include "events.hpp"
+#include "keys.hpp"
+#include "sound.hpp"
+
+#define SEQ_MAX_STEPS 32
+
+#define SEQ_DEFAULT_BPM   120.0f
+#define SEQ_DEFAULT_STEPS 16
+
+#define SEQ_MIN_BPM   20.0f
+#define SEQ_MAX_BPM   300.0f
+#define SEQ_MAX_SWING 0.75f
+
+// One track per sample, then one per synth key
+#define SEQ_TRACKS               (SAMPLE_CNT + MAX_KEYS)
+#define SEQ_SAMPLE_TRACK(sample) (sample)
+#define SEQ_KEY_TRACK(key)       (SAMPLE_CNT + (key))
+
+// Events one block can produce. Steps that don't fit are played late, at
+// the start of the next block.
+#define SEQ_MAX_EVENTS 64
+
+/*
+ * A pattern is part of the engine parameter snapshot (params.hpp), so edits
+ * reach the audio thread as a single pointer swap. Steps are sixteenth notes.
+ * The one the engine starts with comes from [sequencer] in the config.
+ */
+typedef struct seq_pattern {
+    bool    running;
+    float   bpm;
+    float   swing;   // Delay of the off-beat steps, fraction of a step
+    uint8_t steps;
+    float   velocity[SEQ_TRACKS][SEQ_MAX_STEPS]; // 0 = step off
+} SEQ_PATTERN;
+
+// Playback position, owned by the audio callback
+typedef struct seq_state {
+    bool     running;
+    uint8_t  step;
+    double   grid;                  // Unswung frame of the next step
+    uint64_t note_off[MAX_KEYS];    // Pending release frame, 0 = none
+    uint8_t  note[MAX_KEYS];        // Note each key track last started
+} SEQ_STATE;
+
+/*
+ * Control side, each edit is published as a new parameter snapshot. MIDI CC
+ * 84 starts and stops, 86 and 87 set tempo and swing, 88 toggles step
+ * recording and 89 clears the pattern.
+ */
+void seq_toggle_running();
+
+void seq_set_tempo(float bpm);
+
+void seq_set_swing(float swing);
+
+void seq_set_step(uint8_t track, uint8_t step, float velocity);
+
+// Turns every step off, the tempo and length are kept
+void seq_clear();
+
+void seq_toggle_record();
+
+/*
+ * While step recording is on and the pattern runs, a key, pad or MIDI note
+ * played is written into the step playing at that moment.
+ */
+void seq_record(uint8_t track, float velocity);
+
+/*
+ * Audio side: writes the events falling in [start, end) to events, sorted
+ * by frame, and returns how many there are. Key tracks play in octave.
+ */
+uint8_t seq_render(SEQ_STATE *state, const SEQ_PATTERN *pattern,
+                   int8_t octave, uint64_t start, uint64_t end,
+                   EVENT *events);
+
+#endif
@@ -1,30 +1,87 @@
 #ifndef DAW_SOUND_H
 #define DAW_SOUND_H
 
+#include <cstdint>
+
+#include "mod.hpp"
+
+#define SAMPLE_CNT 3
+
 #define DEC_OCTAVE 0
 #define INC_OCTAVE 1
 
 typedef enum signal_type {
-    WAVE_e = 0,
-    KS_e   = 1,
+    WAVE_e     = 0, // Sine
+    KS_e       = 1, // Karplus-Strong string
+    SAW_e      = 2,
+    SQUARE_e   = 3, // Pulse, see set_pulse_width()
+    TRIANGLE_e = 4,
+    SIGNAL_TYPE_CNT
 } SIGNAL_TYPE;
 
+// Continuous controls, ramped across each audio block
+typedef enum expression {
+    EXPR_PITCH_BEND = 0, // Semitones, applied to wave voices
+    EXPR_HAND_BEND,      // Semitones, the theremin's, added to the one above
+    EXPR_LEVEL,          // 0..1, scales the synth voices
+    EXPR_CUTOFF,         // 0..1, filter cutoff (filter_cutoff_hz())
+    EXPR_CNT
+} EXPRESSION;
+
 uint8_t init_sound();
 
 void cleanup_sound();
 
-void trigger_gate(uint8_t index);
+// Returns the note the key started or released (a tuning table index)
+uint8_t trigger_gate(uint8_t index);
 
 void trigger_sample(uint8_t index);
 
+// For sources with their own timing (MIDI): frame is the stream time to act
+// on, velocity 0..1. Notes index the tuning table (TUNING_NOTE in tuning.hpp)
+// and are not moved by the octave pads.
+void note_on(uint8_t note, float velocity, uint64_t frame);
+
+void note_off(uint8_t note, uint64_t frame);
+
+void play_sample(uint8_t index, float velocity, uint64_t frame);
+
 void trigger_vibrato();
 
 void change_sound_type(SIGNAL_TYPE type);
 
 void set_volume(float volume);
 
+// Part of the cycle SQUARE_e voices spend high, 0.5 is a square. Sounding
+// voices follow it.
+void set_pulse_width(float width);
+
 void trigger_reverb();
 
+void set_reverb(bool enabled);
+
 void change_frequency(bool increase);
 
+// Switches every voice to a new table (tuning.hpp), from a config reload
+void set_tuning(const struct tuning_table *table);
+
+// New ADSR for every voice (envelope.hpp), from a config reload
+void set_envelope(const struct envelope_settings *settings);
+
+// Filter mode, resonance and key tracking (filter.hpp), from a config reload
+void set_filter(const struct filter_settings *settings);
+
+// LFOs, modulation envelope and routes (mod.hpp), from a config reload
+void set_modulation(const MOD_SETTINGS *settings);
+
+// Controller modulation sources (MOD_SRC_WHEEL and up), picked up once per
+// block
+void set_mod_source(MOD_SOURCE source, float value);
+
+void set_expression(EXPRESSION expr, float value);
+
+// Input to output latency the backend measured on the last block with
+// capture, 0 without any
+float sound_input_latency_ms();
+
 #endif
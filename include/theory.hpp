@@ -1,6 +1,11 @@
 #ifndef DAW_THEORY_H
 #define DAW_THEORY_H
 
+#include <cstdint>
+
 void update_music_state();
 
+// Same readout for notes heard on the input (key indexes, bass first)
+void update_detected_state(const uint8_t *notes, uint8_t count);
+
 #endif
@@ -1,6 +1,11 @@
 #ifndef DAW_TOUCH_H
 #define DAW_TOUCH_H
 
+#include <cstdint>
+
+// Touch pads: samples first, then the octave pads
+#define MAX_TOUCH 5
+
 // Initialize keys
 uint8_t init_touch();
 
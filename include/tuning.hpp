@@ -0,0 +1,58 @@
+#ifndef DAW_TUNING_H
+#define DAW_TUNING_H
+
+#include <cstdint>
+
+#include "keys.hpp"
+
+// The keyboard can be shifted this many octaves either way
+#define TUNING_LOWEST_OCTAVE  -2
+#define TUNING_HIGHEST_OCTAVE 2
+#define TUNING_NOTES (MAX_KEYS * (TUNING_HIGHEST_OCTAVE \
+                                  - TUNING_LOWEST_OCTAVE + 1))
+
+// Note index of a key played with the keyboard shifted by octave. Shifting
+// is only ever an offset into the table, nothing is multiplied.
+#define TUNING_NOTE(key, octave) \
+    ((key) + MAX_KEYS * ((octave) - TUNING_LOWEST_OCTAVE))
+
+#define TUNING_EQUAL "equal"
+
+// Scala files may have more degrees than there are keys (microtonal scales)
+#define TUNING_MAX_DEGREES 128
+
+/*
+ * Everything the audio thread needs per note, worked out in double precision
+ * on the control side for the open sample rate. Immutable once published.
+ */
+typedef struct tuning_table {
+    float frequency[TUNING_NOTES];  // Hz
+    float step[TUNING_NOTES];       // Oscillator phase step, cycles per sample
+    float period[TUNING_NOTES];     // Samples per cycle, for Karplus-Strong
+} TUNING_TABLE;
+
+/*
+ * ratio[0] is always 1/1 and ratio[degrees] the interval the scale repeats
+ * at (2/1 for octave scales). Key k is scale degree k, counted on into the
+ * next periods when the scale has fewer degrees than the keyboard.
+ */
+typedef struct scale {
+    uint8_t degrees;
+    double  ratio[TUNING_MAX_DEGREES + 1];
+} SCALE;
+
+// Builds the table for the [tuning] section of the config
+uint8_t init_tuning();
+
+void cleanup_tuning();
+
+// Latest table, valid after init_tuning()
+const TUNING_TABLE *tuning_current();
+
+// Rebuilds the table after a config reload and hands it to the engine
+void tuning_reload();
+
+// TUNING_EQUAL or the path of a Scala (.scl) file
+bool tuning_load_scale(const char *name, SCALE *scale);
+
+#endif
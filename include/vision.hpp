@@ -0,0 +1,35 @@
+#ifndef DAW_VISION_H
+#define DAW_VISION_H
+
+#include <cstdint>
+
+#include "gesture_ipc.hpp"
+
+typedef struct vision_result {
+    GESTURE_CODE gesture;
+    uint32_t     area;      // Hand pixels inside the ROI
+    uint8_t      fingers;
+    float        cx, cy;    // Hand centroid, normalized to the ROI (0..1)
+    uint64_t     stamp_ns;  // CLOCK_MONOTONIC capture time
+    bool         skipped;   // Frame matched the previous one, result reused
+} VISION_RESULT;
+
+/*
+ * source is either a V4L2 capture device ("/dev/video0") or a file of
+ * recorded frames: concatenated binary PGMs (P5), e.g. from
+ *   ffmpeg -i clip.mp4 -s 320x240 -f image2pipe -vcodec pgm - > frames.pgm
+ */
+uint8_t vision_open(const char *source);
+
+void vision_close();
+
+// Grabs and analyses the next frame. Returns false when the recording ends
+// or the camera timed out.
+bool vision_step(VISION_RESULT *result);
+
+// Runs the pipeline on its own thread and publishes to the gesture channel
+uint8_t init_vision(const char *source);
+
+void cleanup_vision();
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef DAW_VOICES_H
+#define DAW_VOICES_H
+
+#include <cstdint>
+
+#include "tuning.hpp"
+
+// Voices are preallocated, the config picks how many of them are used
+#define MAX_VOICES     32
+#define DEFAULT_VOICES 16
+
+#define VOICE_NONE 0xFF
+
+typedef enum voice_steal {
+    STEAL_OLDEST = 0,
+    STEAL_QUIETEST,
+    STEAL_CNT
+} VOICE_STEAL;
+
+/*
+ * Bookkeeping of which voice plays which note, owned by the audio callback.
+ * The renderer only walks active[], so the cost follows what is sounding.
+ * Notes are tuning table indexes, the same pitch class can sound in several
+ * octaves at once.
+ */
+typedef struct voice_pool {
+    uint8_t     size;                   // Voices the pool may hand out
+    VOICE_STEAL steal;
+    uint8_t     active[MAX_VOICES];     // Sounding voices, oldest first
+    uint8_t     active_cnt;
+    uint8_t     idle[MAX_VOICES];       // Stack of free voices
+    uint8_t     idle_cnt;
+    uint8_t     note[MAX_VOICES];       // Note each voice plays
+    bool        held[MAX_VOICES];       // Cleared on release
+    float       level[MAX_VOICES];      // Peak of the last block, for stealing
+    float       peak[MAX_VOICES];       // Of the block being rendered
+    bool        fresh[MAX_VOICES];      // Started in the block being rendered
+    uint8_t     voice_of[TUNING_NOTES]; // Latest voice started on each note
+} VOICE_POOL;
+
+void voices_reset(VOICE_POOL *pool, uint8_t size, VOICE_STEAL steal);
+
+/*
+ * Picks the voice for a new note. A note already held is released first so
+ * its tail survives the retrigger. With no voice free, a released voice is
+ * taken before a held one, by the pool's stealing rule.
+ */
+uint8_t voices_start(VOICE_POOL *pool, uint8_t note);
+
+// Releases the latest voice on note, returns it or VOICE_NONE
+uint8_t voices_release(VOICE_POOL *pool, uint8_t note);
+
+// The renderer hands a silent voice back
+void voices_free(VOICE_POOL *pool, uint8_t voice);
+
+/*
+ * End of a block: the peaks gathered over it become the levels stealing
+ * compares. Voices started during the block keep theirs at full until they
+ * have been heard for a whole one.
+ */
+void voices_block_done(VOICE_POOL *pool);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef DAW_WORKERS_H
+#define DAW_WORKERS_H
+
+#include <cstdint>
+
+#define WORKERS_SUCCESS 0
+#define WORKERS_INITERR 1
+
+// Threads besides the audio one, the Pi has four cores
+#define MAX_WORKERS 3
+
+// Threads that can take part in a batch: the audio thread is thread 0
+#define WORKER_THREADS (MAX_WORKERS + 1)
+
+/*
+ * One piece of a batch. thread tells which of the WORKER_THREADS runs it, so
+ * tasks can keep partial results per thread and leave the merging to the
+ * caller.
+ */
+typedef void (*WORKER_TASK)(void *ctx, uint8_t task, uint8_t thread);
+
+// Starts count pinned real-time threads, none keeps everything on the caller
+uint8_t init_workers(uint8_t count);
+
+void cleanup_workers();
+
+uint8_t workers_count();
+
+/*
+ * Audio side. Runs tasks 0..tasks-1 on the workers and the calling thread
+ * and returns once all of them are done. The caller takes tasks from the
+ * same queue as the workers, so whatever a late worker hasn't started by
+ * then is rendered inline instead of waited for. Never nested.
+ */
+void workers_run(WORKER_TASK task, void *ctx, uint8_t tasks);
+
+// Tasks the calling thread rendered itself since init_workers()
+uint64_t workers_inline();
+
+#endif
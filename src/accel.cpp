@@ -4,6 +4,7 @@
     http://www.electronicwings.com
 */
 
+#include <algorithm>
 #include <cmath>
 #include <wiringPiI2C.h>
 #include <stdlib.h>
@@ -11,10 +12,9 @@
 #include <wiringPi.h>
 
 #include "accel.hpp"
+#include "config.hpp"
 #include "sound.hpp"
 
-#define Device_Address 0x68	/*Device Address/Identifier for MPU6050*/
-
 #define PWR_MGMT_1   0x6B
 #define SMPLRT_DIV   0x19
 #define CONFIG       0x1A
@@ -27,6 +27,9 @@
 #define GYRO_YOUT_H  0x45
 #define GYRO_ZOUT_H  0x47
 
+// Rotation speed (deg/s) taken as the full motion modulation
+#define MOTION_FULL_SCALE 40.0f
+
 static int fd;
 
 static float Acc_x;
@@ -78,7 +81,7 @@ void init_accel() {
     Gy = 0.0f;
     Gz = 0.0f;
 
-    fd = wiringPiI2CSetup(Device_Address); /*Initializes I2C with device Address*/
+    fd = wiringPiI2CSetup(config()->accel_address); /*Initializes I2C with device Address*/
 
     MPU6050_Init(); /* Initializes MPU6050 */
 }
@@ -114,6 +117,8 @@ void loop_accel() {
     // float mag = std::sqrt((Ax*Ax) + (Ay*Ay) + (Az*Az));
     // printf("|%f|%f|%f|\n", mag, mag2, mag3);
 
+    set_mod_source(MOD_SRC_MOTION, std::min(G_mag / MOTION_FULL_SCALE, 1.0f));
+
     if (G_mag >= 4.0f) {
         trigger_vibrato();
     }
@@ -3,6 +3,8 @@
 #include <unistd.h>
 #include <wiringPiI2C.h>
 
+#include "config.hpp"
+#include "midi.hpp"
 #include "sound.hpp"
 
 #include "analog.hpp"
@@ -12,8 +14,6 @@
 #define ANALOG_WRITERR 2
 #define ANALOG_READERR 3
 
-#define ADS7830_ADDRESS   0x48
-
 /*
  * Representation of ADS7830 control byte for Single-ended Mode:
  * | S-E | A:0 | A:2 | A:1 | PD1 | PD0 |  -  |  -  |
@@ -26,6 +26,9 @@
 // Reverb is connected to AIN1 -> 0b00[1] -> 0b[1]00 (after odd fix)
 #define ANALOG_REVERB_CTRL 0xC0
 
+// Filter cutoff is connected to AIN2 -> 0b0[1]0 -> 0b00[1] (after odd fix)
+#define ANALOG_CUTOFF_CTRL 0x90
+
 #define MAX_ANALOG_VALUE_INT 255
 #define MAX_ANALOG_VALUE_FLT 255.0f
 
@@ -60,7 +63,7 @@ static float normalize_value(uint8_t value) {
 }
 
 uint8_t init_analog() {
-    analog_fd = wiringPiI2CSetup(ADS7830_ADDRESS);
+    analog_fd = wiringPiI2CSetup(config()->analog_address);
     if (analog_fd < 0) {
         std::cerr << "Failed to init I2C communication to ADS7830" << std::endl;
         return ANALOG_INITERR;
@@ -72,7 +75,7 @@ uint8_t init_analog() {
 }
 
 void loop_analog() {
-    uint8_t volume, reverb;
+    uint8_t volume, reverb, cutoff;
 
     // Volume control
     if (read_analog(ANALOG_VOLUME_CTRL, &volume) != ANALOG_SUCCESS) {
@@ -84,6 +87,7 @@ void loop_analog() {
          */
         volume = invert_value(volume);
         set_volume(normalize_value(volume));
+        midi_send_control(MIDI_CC_VOLUME, normalize_value(volume));
     }
 
     // Reverb control
@@ -95,7 +99,17 @@ void loop_analog() {
         if (new_reverb != reverb_status) {
             reverb_status = new_reverb;
             trigger_reverb();
+            midi_send_control(MIDI_CC_REVERB, reverb_status ? 1.0f : 0.0f);
             std::cout << "Reverb is now set to " << reverb_status << std::endl;
         }
     }
+
+    // Filter cutoff control, glides in the engine so the steps don't zipper
+    if (read_analog(ANALOG_CUTOFF_CTRL, &cutoff) != ANALOG_SUCCESS) {
+        std::cerr << "Failed to read cutoff value" << std::endl;
+    } else {
+        float value = normalize_value(invert_value(cutoff));
+        set_expression(EXPR_CUTOFF, value);
+        midi_send_control(MIDI_CC_CUTOFF, value);
+    }
 }
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+
+#include "audio.hpp"
+#include "config.hpp"
+
+#define AUDIO_SUCCESS 0
+#define AUDIO_INITERR 1
+
+#define AUDIO_RT_PRIORITY 80
+
+static const AUDIO_BACKEND *backends[AUDIO_BACKEND_CNT] = {
+    &portaudio_backend,
+    &alsa_backend,
+    &jack_backend,
+    &null_backend
+};
+
+static const AUDIO_BACKEND *active;
+static AUDIO_CONFIG         current;
+
+static uint32_t env_value(const char *name, uint32_t fallback,
+                          uint32_t min, uint32_t max) {
+    const char *value = getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+    return std::clamp<uint32_t>(strtoul(value, nullptr, 10), min, max);
+}
+
+AUDIO_CONFIG audio_default_config() {
+    // The [audio] section of the config, then the environment on top
+    AUDIO_CONFIG config = ::config()->audio;
+    config.sample_rate = env_value("DAW_SAMPLE_RATE", config.sample_rate,
+                                   MIN_SAMPLE_RATE, MAX_SAMPLE_RATE);
+    config.period      = env_value("DAW_PERIOD", config.period,
+                                   MIN_PERIOD, MAX_PERIOD);
+    config.periods     = env_value("DAW_PERIODS", config.periods, 2, 16);
+    config.input       = env_value("DAW_AUDIO_INPUT", config.input, 0,
+                                   AUDIO_CHANNELS);
+
+    const char *backend = getenv("DAW_AUDIO_BACKEND");
+    for (size_t b = 0; backend && b < AUDIO_BACKEND_CNT; b++) {
+        if (!strcmp(backend, backends[b]->name)) {
+            config.backend = static_cast<AUDIO_BACKEND_TYPE>(b);
+        }
+    }
+
+    const char *device = getenv("DAW_AUDIO_DEVICE");
+    if (device) {
+        strncpy(config.device, device, sizeof(config.device) - 1);
+    }
+    return config;
+}
+
+uint8_t audio_open(const AUDIO_CONFIG& config, AUDIO_RENDER render,
+                   void *user) {
+    if (config.backend >= AUDIO_BACKEND_CNT) {
+        return AUDIO_INITERR;
+    }
+
+    current = config;
+    active  = backends[config.backend];
+
+    std::cout << "  * opening " << active->name << " audio ("
+              << current.sample_rate << " Hz, " << current.period << " x "
+              << current.periods << " frames";
+    if (current.input) {
+        std::cout << ", " << int(current.input) << " in";
+    }
+    std::cout << ") ...\n";
+
+    if (active->open(&current, render, user)) {
+        active = nullptr;
+        return AUDIO_INITERR;
+    }
+
+    if (current.sample_rate != config.sample_rate
+        || current.period != config.period) {
+        std::cout << "  * device settled on " << current.sample_rate
+                  << " Hz, " << current.period << " frames\n";
+    }
+    return AUDIO_SUCCESS;
+}
+
+uint8_t audio_start() {
+    return active ? active->start() : AUDIO_INITERR;
+}
+
+void audio_stop() {
+    if (active) {
+        active->stop();
+    }
+}
+
+void audio_close() {
+    if (active) {
+        active->close();
+        active = nullptr;
+    }
+}
+
+uint32_t audio_sample_rate() {
+    return current.sample_rate;
+}
+
+uint32_t audio_period() {
+    return current.period;
+}
+
+uint8_t audio_input_channels() {
+    return active ? current.input : 0;
+}
+
+void audio_set_realtime() {
+    struct sched_param param = {};
+    param.sched_priority = AUDIO_RT_PRIORITY;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) {
+        std::cerr << "Warning: audio thread is not real-time "
+                     "(needs CAP_SYS_NICE or rtprio limits)" << std::endl;
+    }
+}
@@ -0,0 +1,405 @@
+#include <algorithm>
+#include <alsa/asoundlib.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "audio.hpp"
+
+#define ALSA_BACKEND_SUCCESS 0
+#define ALSA_BACKEND_INITERR 1
+
+#define ALSA_DEFAULT_DEVICE "default"
+#define ALSA_WAIT_MS        100
+
+/*
+ * Direct ALSA playback: one period is rendered and copied straight into the
+ * mmap'ed device buffer. The device starts by itself once the buffer has
+ * been filled (start threshold = buffer size) and recovers the same way
+ * after an underrun.
+ *
+ * Capture, when asked for, is a second PCM on the same device started along
+ * with playback. Each period is rendered with the oldest captured one read
+ * in place in the mmap area, which is only released afterwards.
+ */
+
+static snd_pcm_t        *pcm;
+static snd_pcm_format_t  format;
+static snd_pcm_t        *capture;
+static snd_pcm_format_t  capture_format;
+static uint8_t           input_channels;
+static uint32_t          period;
+static AUDIO_RENDER      render;
+static void             *user;
+static std::thread       worker;
+static std::atomic<bool> running;
+
+static float scratch[MAX_PERIOD * AUDIO_CHANNELS];
+
+// Capture of integer devices, or of a period split by the buffer end
+static float capture_scratch[MAX_PERIOD * AUDIO_CHANNELS];
+
+// Device formats we can feed, best first
+static const snd_pcm_format_t formats[] = {
+    SND_PCM_FORMAT_FLOAT_LE,
+    SND_PCM_FORMAT_S32_LE,
+    SND_PCM_FORMAT_S16_LE
+};
+
+static void convert(void *dst, const float *src, size_t samples) {
+    switch (format) {
+        case SND_PCM_FORMAT_FLOAT_LE:
+            memcpy(dst, src, samples * sizeof(float));
+            break;
+
+        case SND_PCM_FORMAT_S32_LE: {
+            int32_t *out = static_cast<int32_t *>(dst);
+            for (size_t i = 0; i < samples; i++) {
+                out[i] = static_cast<int32_t>(
+                    std::clamp(src[i], -1.0f, 1.0f) * 2147483392.0f);
+            }
+            break;
+        }
+
+        default: {
+            int16_t *out = static_cast<int16_t *>(dst);
+            for (size_t i = 0; i < samples; i++) {
+                out[i] = static_cast<int16_t>(
+                    std::clamp(src[i], -1.0f, 1.0f) * 32767.0f);
+            }
+            break;
+        }
+    }
+}
+
+static void convert_in(float *dst, const void *src, size_t samples) {
+    switch (capture_format) {
+        case SND_PCM_FORMAT_FLOAT_LE:
+            memcpy(dst, src, samples * sizeof(float));
+            break;
+
+        case SND_PCM_FORMAT_S32_LE: {
+            const int32_t *in = static_cast<const int32_t *>(src);
+            for (size_t i = 0; i < samples; i++) {
+                dst[i] = in[i] * (1.0f / 2147483648.0f);
+            }
+            break;
+        }
+
+        default: {
+            const int16_t *in = static_cast<const int16_t *>(src);
+            for (size_t i = 0; i < samples; i++) {
+                dst[i] = in[i] * (1.0f / 32768.0f);
+            }
+            break;
+        }
+    }
+}
+
+// Copies frames of scratch into the device buffer, across its wrap point
+static int write_mmap(const float *src, snd_pcm_uframes_t frames) {
+    while (frames) {
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t count = frames;
+
+        int err = snd_pcm_mmap_begin(pcm, &areas, &offset, &count);
+        if (err < 0) {
+            return err;
+        }
+
+        char *dst = static_cast<char *>(areas[0].addr) + areas[0].first / 8
+                    + offset * (areas[0].step / 8);
+        convert(dst, src, count * AUDIO_CHANNELS);
+
+        snd_pcm_sframes_t done = snd_pcm_mmap_commit(pcm, offset, count);
+        if (done < 0) {
+            return done;
+        }
+
+        src    += count * AUDIO_CHANNELS;
+        frames -= count;
+    }
+    return 0;
+}
+
+static const char *area_frame(const snd_pcm_channel_area_t *areas,
+                              snd_pcm_uframes_t offset) {
+    return static_cast<const char *>(areas[0].addr) + areas[0].first / 8
+           + offset * (areas[0].step / 8);
+}
+
+/*
+ * Points input at the next captured period. A float device is read right
+ * in the mmap area: the frames to commit once rendered are returned, at
+ * offset. Anything else is converted into capture_scratch and released
+ * here. No input when capture isn't running or hasn't a period ready.
+ */
+static snd_pcm_uframes_t take_capture(AUDIO_INPUT *input,
+                                      snd_pcm_uframes_t *offset) {
+    *input = {};
+    if (!capture) {
+        return 0;
+    }
+
+    // Started with playback, and again after every recovery
+    if (snd_pcm_state(capture) == SND_PCM_STATE_PREPARED) {
+        if (snd_pcm_state(pcm) != SND_PCM_STATE_RUNNING) {
+            return 0;
+        }
+        snd_pcm_start(capture);
+    }
+
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(capture);
+    if (avail < 0) {
+        snd_pcm_recover(capture, avail, 1);
+        return 0;
+    }
+    if (static_cast<snd_pcm_uframes_t>(avail) < period) {
+        return 0;
+    }
+
+    // A backlog is nothing but latency, keep to the newest period
+    if (static_cast<snd_pcm_uframes_t>(avail) >= 2 * period) {
+        snd_pcm_forward(capture, avail - period);
+    }
+
+    snd_pcm_sframes_t in_delay  = 0;
+    snd_pcm_sframes_t out_delay = 0;
+    snd_pcm_delay(capture, &in_delay);
+    snd_pcm_delay(pcm, &out_delay);
+
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t count = period;
+    if (snd_pcm_mmap_begin(capture, &areas, offset, &count) < 0) {
+        return 0;
+    }
+
+    input->channels = input_channels;
+    input->stride   = input_channels;
+    input->latency  = static_cast<uint32_t>(std::max<snd_pcm_sframes_t>(
+                          in_delay, 0) + std::max<snd_pcm_sframes_t>(
+                          out_delay, 0));
+
+    if (capture_format == SND_PCM_FORMAT_FLOAT_LE && count == period) {
+        const float *frames = reinterpret_cast<const float *>(
+                                  area_frame(areas, *offset));
+        for (uint8_t c = 0; c < input_channels; c++) {
+            input->channel[c] = frames + c;
+        }
+        return count;
+    }
+
+    snd_pcm_uframes_t done = 0;
+    while (true) {
+        convert_in(capture_scratch + done * input_channels,
+                   area_frame(areas, *offset), count * input_channels);
+        snd_pcm_mmap_commit(capture, *offset, count);
+        done += count;
+        if (done == period) {
+            break;
+        }
+
+        count = period - done;
+        if (snd_pcm_mmap_begin(capture, &areas, offset, &count) < 0) {
+            *input = {};
+            return 0;
+        }
+    }
+    for (uint8_t c = 0; c < input_channels; c++) {
+        input->channel[c] = capture_scratch + c;
+    }
+    return 0;
+}
+
+static void alsa_thread() {
+    audio_set_realtime();
+
+    while (running.load(std::memory_order_relaxed)) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+        if (avail < 0) {
+            snd_pcm_recover(pcm, avail, 1);
+            continue;
+        }
+
+        if (static_cast<snd_pcm_uframes_t>(avail) < period) {
+            // Not started yet: keep filling up to the start threshold
+            if (snd_pcm_state(pcm) == SND_PCM_STATE_RUNNING) {
+                int err = snd_pcm_wait(pcm, ALSA_WAIT_MS);
+                if (err < 0) {
+                    snd_pcm_recover(pcm, err, 1);
+                }
+                continue;
+            }
+            snd_pcm_start(pcm);
+            continue;
+        }
+
+        AUDIO_INPUT       input;
+        snd_pcm_uframes_t offset = 0;
+        snd_pcm_uframes_t held   = take_capture(&input, &offset);
+
+        render(&input, scratch, period, user);
+        if (held) {
+            snd_pcm_mmap_commit(capture, offset, held);
+        }
+
+        int err = write_mmap(scratch, period);
+        if (err < 0) {
+            snd_pcm_recover(pcm, err, 1);
+        }
+    }
+}
+
+// Interleaved mmap access in the best format the device has, for either
+// direction. rate, size and periods come back as the device set them.
+static uint8_t configure(snd_pcm_t *handle, const char *device,
+                         unsigned int channels, snd_pcm_format_t *chosen,
+                         unsigned int *rate, snd_pcm_uframes_t *size,
+                         unsigned int *periods) {
+    snd_pcm_hw_params_t *hw;
+    snd_pcm_hw_params_alloca(&hw);
+    snd_pcm_hw_params_any(handle, hw);
+
+    int err = snd_pcm_hw_params_set_access(handle, hw,
+                                           SND_PCM_ACCESS_MMAP_INTERLEAVED);
+    if (err < 0) {
+        std::cerr << "Device has no mmap access, try plughw:" << std::endl;
+        return ALSA_BACKEND_INITERR;
+    }
+
+    err = -1;
+    for (snd_pcm_format_t candidate : formats) {
+        if (snd_pcm_hw_params_set_format(handle, hw, candidate) == 0) {
+            *chosen = candidate;
+            err     = 0;
+            break;
+        }
+    }
+    if (err < 0) {
+        std::cerr << "No usable sample format on " << device << std::endl;
+        return ALSA_BACKEND_INITERR;
+    }
+
+    snd_pcm_hw_params_set_channels(handle, hw, channels);
+    snd_pcm_hw_params_set_rate_near(handle, hw, rate, nullptr);
+    snd_pcm_hw_params_set_period_size_near(handle, hw, size, nullptr);
+    snd_pcm_hw_params_set_periods_near(handle, hw, periods, nullptr);
+
+    err = snd_pcm_hw_params(handle, hw);
+    if (err < 0) {
+        std::cerr << "Failed to configure " << device << ": "
+                  << snd_strerror(err) << std::endl;
+        return ALSA_BACKEND_INITERR;
+    }
+    if (*size > MAX_PERIOD) {
+        std::cerr << device << " settled on a period of " << *size
+                  << " frames, the engine takes up to " << MAX_PERIOD
+                  << std::endl;
+        return ALSA_BACKEND_INITERR;
+    }
+    return ALSA_BACKEND_SUCCESS;
+}
+
+// Same device, held to the rate and period playback settled on
+static uint8_t open_capture(const char *device, unsigned int rate,
+                            snd_pcm_uframes_t size, unsigned int periods) {
+    int err = snd_pcm_open(&capture, device, SND_PCM_STREAM_CAPTURE, 0);
+    if (err < 0) {
+        std::cerr << "Failed to open " << device << " for capture: "
+                  << snd_strerror(err) << std::endl;
+        capture = nullptr;
+        return ALSA_BACKEND_INITERR;
+    }
+
+    unsigned int      in_rate = rate;
+    snd_pcm_uframes_t in_size = size;
+    if (configure(capture, device, input_channels, &capture_format,
+                  &in_rate, &in_size, &periods)) {
+        snd_pcm_close(capture);
+        capture = nullptr;
+        return ALSA_BACKEND_INITERR;
+    }
+    if (in_rate != rate || in_size != size) {
+        std::cerr << "Capture on " << device << " can't run at "
+                  << rate << " Hz, " << size << " frames" << std::endl;
+        snd_pcm_close(capture);
+        capture = nullptr;
+        return ALSA_BACKEND_INITERR;
+    }
+    return ALSA_BACKEND_SUCCESS;
+}
+
+static uint8_t alsa_open(AUDIO_CONFIG *config, AUDIO_RENDER cb, void *data) {
+    const char *device = config->device[0] ? config->device
+                                           : ALSA_DEFAULT_DEVICE;
+    render         = cb;
+    user           = data;
+    input_channels = config->input;
+
+    int err = snd_pcm_open(&pcm, device, SND_PCM_STREAM_PLAYBACK, 0);
+    if (err < 0) {
+        std::cerr << "Failed to open " << device << ": " << snd_strerror(err)
+                  << std::endl;
+        return ALSA_BACKEND_INITERR;
+    }
+
+    unsigned int      rate    = config->sample_rate;
+    snd_pcm_uframes_t size    = config->period;
+    unsigned int      periods = config->periods;
+    if (configure(pcm, device, AUDIO_CHANNELS, &format, &rate, &size,
+                  &periods)) {
+        snd_pcm_close(pcm);
+        return ALSA_BACKEND_INITERR;
+    }
+
+    snd_pcm_sw_params_t *sw;
+    snd_pcm_sw_params_alloca(&sw);
+    snd_pcm_sw_params_current(pcm, sw);
+    snd_pcm_sw_params_set_avail_min(pcm, sw, size);
+    snd_pcm_sw_params_set_start_threshold(pcm, sw, size * periods);
+    snd_pcm_sw_params(pcm, sw);
+
+    if (input_channels && open_capture(device, rate, size, periods)) {
+        snd_pcm_close(pcm);
+        return ALSA_BACKEND_INITERR;
+    }
+
+    config->sample_rate = rate;
+    config->period      = size;
+    config->periods     = periods;
+    period              = size;
+    return ALSA_BACKEND_SUCCESS;
+}
+
+static uint8_t alsa_start() {
+    running = true;
+    worker  = std::thread(alsa_thread);
+    return ALSA_BACKEND_SUCCESS;
+}
+
+static void alsa_stop() {
+    running = false;
+    if (worker.joinable()) {
+        worker.join();
+    }
+    snd_pcm_drop(pcm);
+    if (capture) {
+        snd_pcm_drop(capture);
+    }
+}
+
+static void alsa_close() {
+    if (capture) {
+        snd_pcm_close(capture);
+        capture = nullptr;
+    }
+    snd_pcm_close(pcm);
+    pcm = nullptr;
+}
+
+const AUDIO_BACKEND alsa_backend = {
+    "alsa", alsa_open, alsa_start, alsa_stop, alsa_close
+};
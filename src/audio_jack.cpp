@@ -0,0 +1,158 @@
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include "audio.hpp"
+
+#define JACK_BACKEND_SUCCESS 0
+#define JACK_BACKEND_INITERR 1
+
+// Built with `make WITH_JACK=1`, the Pi image has no JACK by default
+#ifdef WITH_JACK
+
+#include <jack/jack.h>
+
+#define JACK_CLIENT_NAME "DAW-DEV"
+
+static jack_client_t *client;
+static jack_port_t   *ports[AUDIO_CHANNELS];
+static jack_port_t   *in_ports[AUDIO_CHANNELS];
+static uint8_t        input_channels;
+static AUDIO_RENDER   render;
+static void          *user;
+
+// JACK hands out one buffer per channel, the engine renders interleaved
+static float scratch[MAX_PERIOD * AUDIO_CHANNELS];
+
+static int jk_process(jack_nframes_t frames, void *arg) {
+    // Too long to render: play silence rather than what the ports held
+    if (frames > MAX_PERIOD) {
+        for (size_t c = 0; c < AUDIO_CHANNELS; c++) {
+            memset(jack_port_get_buffer(ports[c], frames), 0,
+                   frames * sizeof(jack_default_audio_sample_t));
+        }
+        return 0;
+    }
+
+    // Capture straight off the input ports, one buffer per channel
+    AUDIO_INPUT input = {};
+    input.channels = input_channels;
+    input.stride   = 1;
+    for (uint8_t c = 0; c < input_channels; c++) {
+        input.channel[c] = (const float *)jack_port_get_buffer(in_ports[c],
+                                                               frames);
+    }
+    if (input_channels) {
+        // The graph latency on each side of this client
+        jack_latency_range_t capture, playback;
+        jack_port_get_latency_range(in_ports[0], JackCaptureLatency, &capture);
+        jack_port_get_latency_range(ports[0], JackPlaybackLatency, &playback);
+        input.latency = capture.max + playback.max;
+    }
+
+    render(&input, scratch, frames, user);
+
+    for (size_t c = 0; c < AUDIO_CHANNELS; c++) {
+        jack_default_audio_sample_t *out =
+            (jack_default_audio_sample_t *)jack_port_get_buffer(ports[c],
+                                                                frames);
+        for (jack_nframes_t i = 0; i < frames; i++) {
+            out[i] = scratch[i * AUDIO_CHANNELS + c];
+        }
+    }
+    return 0;
+}
+
+static uint8_t jk_open(AUDIO_CONFIG *config, AUDIO_RENDER cb, void *data) {
+    render         = cb;
+    user           = data;
+    input_channels = config->input;
+
+    client = jack_client_open(JACK_CLIENT_NAME, JackNoStartServer, nullptr);
+    if (!client) {
+        std::cerr << "Failed to connect to the JACK server" << std::endl;
+        return JACK_BACKEND_INITERR;
+    }
+
+    const char *names[AUDIO_CHANNELS] = {"out_left", "out_right"};
+    for (size_t c = 0; c < AUDIO_CHANNELS; c++) {
+        ports[c] = jack_port_register(client, names[c],
+                                      JACK_DEFAULT_AUDIO_TYPE,
+                                      JackPortIsOutput, 0);
+    }
+
+    const char *in_names[AUDIO_CHANNELS] = {"in_left", "in_right"};
+    for (size_t c = 0; c < input_channels; c++) {
+        in_ports[c] = jack_port_register(client, in_names[c],
+                                         JACK_DEFAULT_AUDIO_TYPE,
+                                         JackPortIsInput, 0);
+    }
+
+    // The server owns the clock
+    config->sample_rate = jack_get_sample_rate(client);
+    config->period      = jack_get_buffer_size(client);
+
+    if (config->period > MAX_PERIOD) {
+        std::cerr << "JACK period too large" << std::endl;
+        jack_client_close(client);
+        return JACK_BACKEND_INITERR;
+    }
+
+    jack_set_process_callback(client, jk_process, nullptr);
+    return JACK_BACKEND_SUCCESS;
+}
+
+static uint8_t jk_start() {
+    if (jack_activate(client)) {
+        return JACK_BACKEND_INITERR;
+    }
+
+    // Connect to the first playback ports, like most JACK clients do
+    const char **playback = jack_get_ports(client, nullptr, nullptr,
+                                           JackPortIsPhysical
+                                           | JackPortIsInput);
+    for (size_t c = 0; playback && c < AUDIO_CHANNELS && playback[c]; c++) {
+        jack_connect(client, jack_port_name(ports[c]), playback[c]);
+    }
+    jack_free(playback);
+
+    // And the first capture ports to the inputs
+    const char **capture = jack_get_ports(client, nullptr, nullptr,
+                                          JackPortIsPhysical
+                                          | JackPortIsOutput);
+    for (size_t c = 0; capture && c < input_channels && capture[c]; c++) {
+        jack_connect(client, capture[c], jack_port_name(in_ports[c]));
+    }
+    jack_free(capture);
+    return JACK_BACKEND_SUCCESS;
+}
+
+static void jk_stop() {
+    jack_deactivate(client);
+}
+
+static void jk_close() {
+    jack_client_close(client);
+    client = nullptr;
+}
+
+#else
+
+static uint8_t jk_open(AUDIO_CONFIG *config, AUDIO_RENDER cb, void *data) {
+    std::cerr << "JACK support not built in (make WITH_JACK=1)" << std::endl;
+    return JACK_BACKEND_INITERR;
+}
+
+static uint8_t jk_start() {
+    return JACK_BACKEND_INITERR;
+}
+
+static void jk_stop() {}
+
+static void jk_close() {}
+
+#endif
+
+const AUDIO_BACKEND jack_backend = {
+    "jack", jk_open, jk_start, jk_stop, jk_close
+};
@@ -0,0 +1,102 @@
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <sndfile.h>
+#include <thread>
+#include <time.h>
+
+#include "audio.hpp"
+
+#define NULL_BACKEND_SUCCESS 0
+#define NULL_BACKEND_INITERR 1
+
+/*
+ * No sound card: a thread renders one period per tick of an absolute
+ * CLOCK_MONOTONIC timer, so the engine runs at its real rate. With a device
+ * set, it is taken as a WAV path and the output is written there. Input, if
+ * asked for, is silence that comes out again the same period.
+ */
+
+static AUDIO_CONFIG      config;
+static AUDIO_RENDER      render;
+static void             *user;
+static std::thread       worker;
+static std::atomic<bool> running;
+static SNDFILE          *file;
+
+static float buffer[MAX_PERIOD * AUDIO_CHANNELS];
+static float silence[MAX_PERIOD * AUDIO_CHANNELS];
+
+static void null_thread() {
+    audio_set_realtime();
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    long period_ns = static_cast<long>(1000000000LL * config.period
+                                       / config.sample_rate);
+
+    AUDIO_INPUT input = {};
+    input.channels = config.input;
+    input.stride   = config.input;
+    for (uint8_t c = 0; c < config.input; c++) {
+        input.channel[c] = silence + c;
+    }
+
+    while (running.load(std::memory_order_relaxed)) {
+        render(&input, buffer, config.period, user);
+        if (file) {
+            sf_writef_float(file, buffer, config.period);
+        }
+
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+    }
+}
+
+static uint8_t null_open(AUDIO_CONFIG *cfg, AUDIO_RENDER cb, void *data) {
+    config = *cfg;
+    render = cb;
+    user   = data;
+
+    if (config.device[0]) {
+        SF_INFO info = {};
+        info.samplerate = config.sample_rate;
+        info.channels   = AUDIO_CHANNELS;
+        info.format     = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+
+        file = sf_open(config.device, SFM_WRITE, &info);
+        if (!file) {
+            std::cerr << "Failed to open " << config.device << std::endl;
+            return NULL_BACKEND_INITERR;
+        }
+    }
+    return NULL_BACKEND_SUCCESS;
+}
+
+static uint8_t null_start() {
+    running = true;
+    worker  = std::thread(null_thread);
+    return NULL_BACKEND_SUCCESS;
+}
+
+static void null_stop() {
+    running = false;
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+static void null_close() {
+    if (file) {
+        sf_close(file);
+        file = nullptr;
+    }
+}
+
+const AUDIO_BACKEND null_backend = {
+    "null", null_open, null_start, null_stop, null_close
+};
@@ -0,0 +1,136 @@
+#include <cstdint>
+#include <cstdio>
+#include <portaudio.h>
+
+#include "audio.hpp"
+
+#define PA_BACKEND_SUCCESS 0
+#define PA_BACKEND_INITERR 1
+
+static PaStream    *stream;
+static AUDIO_RENDER render;
+static void        *user;
+static uint8_t      input_channels;
+static double       rate;
+static uint32_t     stream_latency;  // What the stream reports, in frames
+
+static int pa_callback(const void *inputBuffer, void *outputBuffer,
+                       unsigned long framesPerBuffer,
+                       const PaStreamCallbackTimeInfo *timeInfo,
+                       PaStreamCallbackFlags statusFlags,
+                       void *userData) {
+    // Interleaved input, read where PortAudio put it
+    AUDIO_INPUT input = {};
+    if (inputBuffer) {
+        input.channels = input_channels;
+        input.stride   = input_channels;
+        for (uint8_t c = 0; c < input_channels; c++) {
+            input.channel[c] = static_cast<const float *>(inputBuffer) + c;
+        }
+
+        // Host APIs without timestamps leave them at 0
+        PaTime trip = timeInfo->outputBufferDacTime
+                      - timeInfo->inputBufferAdcTime;
+        input.latency = trip > 0.0 ? static_cast<uint32_t>(trip * rate)
+                                   : stream_latency;
+    }
+
+    render(&input, (float *)outputBuffer, framesPerBuffer, user);
+    return paContinue;
+}
+
+static uint8_t pa_open(AUDIO_CONFIG *config, AUDIO_RENDER cb, void *data) {
+    PaError err;
+
+    render         = cb;
+    user           = data;
+    input_channels = config->input;
+    rate           = config->sample_rate;
+
+    err = Pa_Initialize();
+    if (err != paNoError) {
+        fprintf(stderr, "PortAudio error: %s\n", Pa_GetErrorText(err));
+        return PA_BACKEND_INITERR;
+    }
+
+    PaStreamParameters outputParams;
+    outputParams.device = Pa_GetDefaultOutputDevice();
+    if (outputParams.device == paNoDevice) {
+        fprintf(stderr, "Error: No default output device.\n");
+        Pa_Terminate();
+        return PA_BACKEND_INITERR;
+    }
+
+    // Ask for the configured buffering, never less than the device can do
+    PaTime latency = (PaTime)config->period * config->periods
+                     / config->sample_rate;
+    PaTime lowest  = Pa_GetDeviceInfo(outputParams.device)
+                     ->defaultLowOutputLatency;
+
+    outputParams.channelCount = AUDIO_CHANNELS;
+    outputParams.sampleFormat = paFloat32;
+    outputParams.suggestedLatency = latency > lowest ? latency : lowest;
+    outputParams.hostApiSpecificStreamInfo = NULL;
+
+    // Capture, if asked for, with the same buffering
+    PaStreamParameters inputParams;
+    if (input_channels) {
+        inputParams.device = Pa_GetDefaultInputDevice();
+        if (inputParams.device == paNoDevice) {
+            fprintf(stderr, "Error: No default input device.\n");
+            Pa_Terminate();
+            return PA_BACKEND_INITERR;
+        }
+
+        lowest = Pa_GetDeviceInfo(inputParams.device)->defaultLowInputLatency;
+        inputParams.channelCount = input_channels;
+        inputParams.sampleFormat = paFloat32;
+        inputParams.suggestedLatency = latency > lowest ? latency : lowest;
+        inputParams.hostApiSpecificStreamInfo = NULL;
+    }
+
+    err = Pa_OpenStream(
+        &stream,
+        input_channels ? &inputParams : NULL,
+        &outputParams,
+        config->sample_rate,
+        config->period,
+        paClipOff,
+        pa_callback,
+        NULL
+    );
+
+    if (err != paNoError) {
+        fprintf(stderr, "Failed to open stream: %s\n", Pa_GetErrorText(err));
+        Pa_Terminate();
+        return PA_BACKEND_INITERR;
+    }
+
+    const PaStreamInfo *info = Pa_GetStreamInfo(stream);
+    stream_latency = static_cast<uint32_t>((info->inputLatency
+                                            + info->outputLatency) * rate);
+    return PA_BACKEND_SUCCESS;
+}
+
+static uint8_t pa_start() {
+    PaError err = Pa_StartStream(stream);
+    if (err != paNoError) {
+        fprintf(stderr, "Failed to start stream: %s\n", Pa_GetErrorText(err));
+        return PA_BACKEND_INITERR;
+    }
+    return PA_BACKEND_SUCCESS;
+}
+
+static void pa_stop() {
+    Pa_StopStream(stream);
+}
+
+static void pa_close() {
+    Pa_CloseStream(stream);
+    Pa_Terminate();
+    stream = nullptr;
+}
+
+const AUDIO_BACKEND portaudio_backend = {
+    "portaudio", pa_open, pa_start, pa_stop, pa_close
+};
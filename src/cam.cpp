@@ -1,74 +1,143 @@
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
-#include <fcntl.h>
 #include <iostream>
-#include <string>
-#include <sys/file.h>
-#include <unistd.h>
 
+#include "config.hpp"
+#include "gesture_ipc.hpp"
 #include "sound.hpp"
+#include "vision.hpp"
 
 #include "cam.hpp"
 
-#define GESTURE_NOHAND  '0'
-#define GESTURE_CLOSED  '1'
-#define GESTURE_OPENED  '2'
-#define CAM_ERR         '3'
+// Run gesture detection inside the app instead of the Python detector
+// (disable gesture.service when enabling this: the channel has one writer)
+#define CAM_NATIVE_PIPELINE false
+#define CAM_DEVICE          "/dev/video0"
 
-static const char* GESTURE_FILE = "/tmp/gesture.txt";
+/*
+ * Theremin mode ([camera] theremin): the hand position bends the pitch
+ * (left/right, on top of any MIDI pitch bend) and sets the synth level
+ * (up/down). Removing the hand returns both to neutral. The position is also
+ * a modulation source (mod.hpp) in any mode.
+ */
+#define CAM_SMOOTHING_MS    80.0f // Time constant of the position smoothing
+#define CAM_STALE_MS        500.0f // Gap after which smoothing restarts
+#define THEREMIN_BEND_RANGE 2.0f  // Semitones either side of the center
+#define THEREMIN_LEVEL_TOP  0.2f  // Hand height (0 = top) for full level
+#define THEREMIN_LEVEL_BOT  0.8f  // Hand height for silence
 
-static SIGNAL_TYPE current_sound_selected;
+static SIGNAL_TYPE  current_sound_selected;
+static GESTURE_CODE last_gesture;
 
-static char read_fifo_gesture() {
-    int fd = open(GESTURE_FILE, O_RDONLY);
-    if (fd == -1) {
-        return CAM_ERR;
-    }
+static float    smooth_x, smooth_y;
+static uint64_t last_stamp_ns;
+static bool     hand_tracked;
 
-    flock(fd, LOCK_SH);  // shared lock
+static void update_hand(const GESTURE_STATE& state) {
+    if (state.gesture == GESTURE_NOHAND) {
+        if (hand_tracked) {
+            hand_tracked = false;
+            set_mod_source(MOD_SRC_HAND_X, 0.0f);
+            set_mod_source(MOD_SRC_HAND_Y, 0.0f);
+            if (config()->theremin) {
+                set_expression(EXPR_HAND_BEND, 0.0f);
+                set_expression(EXPR_LEVEL, 1.0f);
+            }
+        }
+        return;
+    }
 
-    char gesture;
-    read(fd, &gesture, 1);
+    // One-pole smoothing driven by the frame timestamps, so it behaves the
+    // same whatever the camera frame rate is
+    float dt_ms = (state.stamp_ns - last_stamp_ns) / 1e6f;
+    if (!hand_tracked || dt_ms > CAM_STALE_MS) {
+        smooth_x = state.cx;
+        smooth_y = state.cy;
+    } else {
+        float alpha = 1.0f - std::exp(-dt_ms / CAM_SMOOTHING_MS);
+        smooth_x += alpha * (state.cx - smooth_x);
+        smooth_y += alpha * (state.cy - smooth_y);
+    }
+    hand_tracked  = true;
+    last_stamp_ns = state.stamp_ns;
 
-    flock(fd, LOCK_UN);  // unlock
-    close(fd);
+    set_mod_source(MOD_SRC_HAND_X, (smooth_x - 0.5f) * 2.0f);
+    set_mod_source(MOD_SRC_HAND_Y, 1.0f - smooth_y);
+    if (!config()->theremin) {
+        return;
+    }
 
-    return gesture;
+    set_expression(EXPR_HAND_BEND,
+                   (smooth_x - 0.5f) * 2.0f * THEREMIN_BEND_RANGE);
+    set_expression(EXPR_LEVEL,
+                   std::clamp((THEREMIN_LEVEL_BOT - smooth_y)
+                              / (THEREMIN_LEVEL_BOT - THEREMIN_LEVEL_TOP),
+                              0.0f, 1.0f));
 }
 
 void init_cam() {
-    current_sound_selected = WAVE_e;
+    current_sound_selected = static_cast<SIGNAL_TYPE>(config()->wave);
     change_sound_type(current_sound_selected);
+
+    last_gesture  = GESTURE_NOHAND;
+    hand_tracked  = false;
+    last_stamp_ns = 0;
+
+    if (gesture_ipc_open()) {
+        std::cout << "Couldn't open the gesture channel!" << std::endl;
+        return;
+    }
+
+    if (CAM_NATIVE_PIPELINE && init_vision(CAM_DEVICE)) {
+        std::cout << "Couldn't start the gesture pipeline!" << std::endl;
+    }
+}
+
+void cleanup_cam() {
+    cleanup_vision();
+    gesture_ipc_close();
 }
 
 void cam_check_gesture() {
-    char gesture = read_fifo_gesture();
-    switch (gesture) {
+    GESTURE_STATE state;
+
+    // A single shared memory load when nothing changed
+    if (!gesture_ipc_poll(&state)) {
+        return;
+    }
+
+    update_hand(state);
+
+    // Frames arrive continuously, the sound type only reacts to changes
+    if (state.gesture == last_gesture) {
+        return;
+    }
+    last_gesture = state.gesture;
+
+    switch (state.gesture) {
         case GESTURE_NOHAND:
             // just silently skip
             break;
         
         case GESTURE_CLOSED:
             if (current_sound_selected == KS_e) {
-                current_sound_selected = WAVE_e;
+                current_sound_selected =
+                    static_cast<SIGNAL_TYPE>(config()->wave);
                 change_sound_type(current_sound_selected);
             }
             break;
         
         case GESTURE_OPENED:
-            if (current_sound_selected == WAVE_e) {
+            if (current_sound_selected != KS_e) {
                 current_sound_selected = KS_e;
                 change_sound_type(current_sound_selected);
             }
             break;
 
-        case CAM_ERR:
-            std::cout << "Couldn't open the camera FIFO!" << std::endl;
-            break;
-        
         default:
-            // Need to see why this spam happens
-            // std::cerr << "Error: Gesture (" << gesture << ") not valid!"
-            //           << std::endl;
+            std::cerr << "Error: Gesture (" << state.gesture << ") not valid!"
+                      << std::endl;
             break;
     }
 }
@@ -0,0 +1,736 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+#include "led.hpp"
+#include "oscillator.hpp"
+#include "tuning.hpp"
+#include "voices.hpp"
+#include "workers.hpp"
+
+#define CONFIG_SUCCESS 0
+#define CONFIG_INITERR 1
+
+#define CONFIG_POLL_MS 500
+
+typedef enum field_type {
+    FIELD_U8 = 0,
+    FIELD_U32,
+    FIELD_FLOAT,
+    FIELD_STRING,   // min/max bound the length
+    FIELD_KEY_SET,  // List of key indexes, stored as a uint16_t bit mask
+    FIELD_BACKEND,  // Audio backend by name
+    FIELD_CHOICE,   // One of choices, stored as its uint8_t index
+    FIELD_ROUTES,   // "source dest depth [via]" per item, into MOD_ROUTES,
+                    // min/max bound the depth
+    FIELD_STEPS     // "track steps" per item, into SEQ_PATTERN velocities
+} FIELD_TYPE;
+
+typedef struct field {
+    const char *section;
+    const char *name;
+    FIELD_TYPE  type;
+    size_t      offset;
+    size_t      size;   // Bytes of the whole member
+    uint8_t     count;  // Values expected
+    double      min;
+    double      max;
+    bool        hot;    // Reapplied while running
+    const char *const *choices;  // FIELD_CHOICE names, max + 1 of them
+} FIELD;
+
+#define CFG(member) offsetof(DAW_CONFIG, member), \
+                    sizeof(((DAW_CONFIG *)0)->member)
+
+static const char *const steal_names[STEAL_CNT] = {"oldest", "quietest"};
+
+static const char *const wave_names[SIGNAL_TYPE_CNT] = {
+    "sine", "string", "saw", "square", "triangle"
+};
+
+static const char *const record_names[2] = {"wav", "flac"};
+
+// Sequencer tracks by name, keys go by their index
+static const char *const sample_names[SAMPLE_CNT] = {"kick", "snare", "hihat"};
+
+static const char *const filter_names[FILTER_MODE_CNT] = {
+    "off", "low", "band", "high"
+};
+
+static const char *const lfo_names[LFO_SHAPE_CNT] = {
+    "sine", "triangle", "saw", "square", "random"
+};
+
+static const char *const source_names[MOD_SRC_CNT] = {
+    "none", "lfo1", "lfo2", "lfo3", "envelope", "mod_envelope", "vibrato",
+    "wheel", "motion", "hand_x", "hand_y"
+};
+
+static const char *const dest_names[MOD_DEST_CNT] = {
+    "pitch", "amp", "cutoff", "pan", "reverb", "width"
+};
+
+// One entry per setting; list fields take the size of the whole array and
+// are split evenly over count
+static const FIELD fields[] = {
+    {"devices", "keys_address", FIELD_U8, CFG(keys_address),
+     1, 0x03, 0x77, false},
+    {"devices", "analog_address", FIELD_U8, CFG(analog_address),
+     1, 0x03, 0x77, false},
+    {"devices", "accel_address", FIELD_U8, CFG(accel_address),
+     1, 0x03, 0x77, false},
+    {"devices", "touch_pins", FIELD_U8, CFG(touch_pins),
+     MAX_TOUCH, 0, 31, false},
+    {"devices", "led_brightness", FIELD_U8, CFG(led_brightness),
+     1, 0, 255, false},
+    {"devices", "display_fast_baud", FIELD_U8, CFG(disp_fast_baud),
+     1, 0, 1, false},
+    {"audio", "backend", FIELD_BACKEND, CFG(audio.backend),
+     1, 0, 0, false},
+    {"audio", "sample_rate", FIELD_U32, CFG(audio.sample_rate),
+     1, MIN_SAMPLE_RATE, MAX_SAMPLE_RATE, false},
+    {"audio", "period", FIELD_U32, CFG(audio.period),
+     1, MIN_PERIOD, MAX_PERIOD, false},
+    {"audio", "periods", FIELD_U32, CFG(audio.periods),
+     1, 2, 16, false},
+    {"audio", "device", FIELD_STRING, CFG(audio.device),
+     1, 0, 63, false},
+    {"audio", "input", FIELD_U8, CFG(audio.input),
+     1, 0, AUDIO_CHANNELS, false},
+    {"engine", "voices", FIELD_U8, CFG(voices),
+     1, 1, MAX_VOICES, false},
+    {"engine", "steal", FIELD_CHOICE, CFG(voice_steal),
+     1, 0, STEAL_CNT - 1, false, steal_names},
+    {"engine", "workers", FIELD_U8, CFG(workers),
+     1, 0, MAX_WORKERS, false},
+    {"envelope", "attack", FIELD_FLOAT, CFG(envelope.attack),
+     1, 0.0, 60000.0, true},
+    {"envelope", "decay", FIELD_FLOAT, CFG(envelope.decay),
+     1, 0.0, 60000.0, true},
+    {"envelope", "sustain", FIELD_FLOAT, CFG(envelope.sustain),
+     1, ENV_FLOOR_DB, 0.0, true},
+    {"envelope", "release", FIELD_FLOAT, CFG(envelope.release),
+     1, 0.0, 60000.0, true},
+    {"oscillator", "wave", FIELD_CHOICE, CFG(wave),
+     1, 0, SIGNAL_TYPE_CNT - 1, true, wave_names},
+    {"oscillator", "pulse_width", FIELD_FLOAT, CFG(pulse_width),
+     1, OSC_MIN_WIDTH, OSC_MAX_WIDTH, true},
+    {"filter", "mode", FIELD_CHOICE, CFG(filter.mode),
+     1, 0, FILTER_MODE_CNT - 1, true, filter_names},
+    {"filter", "resonance", FIELD_FLOAT, CFG(filter.resonance),
+     1, 0.0, 1.0, true},
+    {"filter", "key_track", FIELD_FLOAT, CFG(filter.key_track),
+     1, 0.0, 1.0, true},
+    {"modulation", "lfo_shapes", FIELD_CHOICE, CFG(mod.lfo_shape),
+     MOD_LFOS, 0, LFO_SHAPE_CNT - 1, true, lfo_names},
+    {"modulation", "lfo_rates", FIELD_FLOAT, CFG(mod.lfo_rate),
+     MOD_LFOS, 0.01, 50.0, true},
+    {"modulation", "env_attack", FIELD_FLOAT, CFG(mod.envelope.attack),
+     1, 0.0, 60000.0, true},
+    {"modulation", "env_decay", FIELD_FLOAT, CFG(mod.envelope.decay),
+     1, 0.0, 60000.0, true},
+    {"modulation", "env_sustain", FIELD_FLOAT, CFG(mod.envelope.sustain),
+     1, ENV_FLOOR_DB, 0.0, true},
+    {"modulation", "env_release", FIELD_FLOAT, CFG(mod.envelope.release),
+     1, 0.0, 60000.0, true},
+    {"modulation", "routes", FIELD_ROUTES, CFG(mod.routes),
+     0, -100.0, 100.0, true},
+    {"camera", "theremin", FIELD_U8, CFG(theremin),
+     1, 0, 1, false},
+    {"samples", "paths", FIELD_STRING, CFG(sample_paths),
+     SAMPLE_CNT, 1, CONFIG_PATH_LEN - 1, false},
+    {"input", "gain", FIELD_FLOAT, CFG(input_gain),
+     1, -60.0, 24.0, false},
+    {"input", "send", FIELD_FLOAT, CFG(input_send),
+     1, 0.0, 1.0, false},
+    {"input", "filter", FIELD_U8, CFG(input_filter),
+     1, 0, 1, false},
+    {"input", "detect", FIELD_U8, CFG(input_detect),
+     1, 0, 1, false},
+    {"convolution", "impulse", FIELD_STRING, CFG(impulse_path),
+     1, 0, CONFIG_PATH_LEN - 1, false},
+    {"convolution", "wet", FIELD_FLOAT, CFG(conv_wet),
+     1, 0.0, 4.0, false},
+    {"looper", "seconds", FIELD_U32, CFG(looper_seconds),
+     1, 0, LOOPER_MAX_SECONDS, false},
+    {"recorder", "directory", FIELD_STRING, CFG(record_dir),
+     1, 1, CONFIG_PATH_LEN - 1, false},
+    {"recorder", "format", FIELD_CHOICE, CFG(record_flac),
+     1, 0, 1, false, record_names},
+    {"sequencer", "run", FIELD_U8, CFG(sequencer.running),
+     1, 0, 1, false},
+    {"sequencer", "bpm", FIELD_FLOAT, CFG(sequencer.bpm),
+     1, SEQ_MIN_BPM, SEQ_MAX_BPM, false},
+    {"sequencer", "swing", FIELD_FLOAT, CFG(sequencer.swing),
+     1, 0.0, SEQ_MAX_SWING, false},
+    {"sequencer", "steps", FIELD_U8, CFG(sequencer.steps),
+     1, 1, SEQ_MAX_STEPS, false},
+    {"sequencer", "tracks", FIELD_STEPS, CFG(sequencer.velocity),
+     0, 0, 0, false},
+    {"keys", "names", FIELD_STRING, CFG(key_names),
+     MAX_KEYS, 1, CONFIG_NAME_LEN - 1, false},
+    {"tuning", "reference_pitch", FIELD_FLOAT, CFG(reference_pitch),
+     1, 20.0, 5000.0, true},
+    {"tuning", "reference_key", FIELD_U8, CFG(reference_key),
+     1, 0, MAX_KEYS - 1, true},
+    {"tuning", "scale", FIELD_STRING, CFG(scale_name),
+     1, 1, CONFIG_PATH_LEN - 1, true},
+    {"leds", "key_leds", FIELD_U8, CFG(key_leds),
+     MAX_KEYS, 0, LED_COUNT - 1, true},
+    {"leds", "scale", FIELD_KEY_SET, CFG(scale),
+     0, 0, MAX_KEYS - 1, true},
+    {"leds", "color_pressed", FIELD_U32, CFG(color_pressed),
+     1, 0, 0xFFFFFF, true},
+    {"leds", "color_scale", FIELD_U32, CFG(color_scale),
+     1, 0, 0xFFFFFF, true},
+    {"leds", "color_suggest", FIELD_U32, CFG(color_suggest),
+     CONFIG_SUGGEST_CNT, 0, 0xFFFFFF, true},
+};
+
+#define FIELD_CNT (sizeof(fields) / sizeof(fields[0]))
+
+// What the hardware was built with, used for anything the file leaves out
+static const DAW_CONFIG defaults = {
+    .keys_address    = 0x20,
+    .analog_address  = 0x48,
+    .accel_address   = 0x68,
+    .touch_pins      = {7, 0, 2, 3, 4},
+    .led_brightness  = 3,
+    .disp_fast_baud  = 0,
+    .audio           = {AUDIO_PORTAUDIO, DEFAULT_SAMPLE_RATE, DEFAULT_PERIOD,
+                        DEFAULT_PERIODS, "", 0},
+    .voices          = DEFAULT_VOICES,
+    .voice_steal     = STEAL_OLDEST,
+    .workers         = 0,
+    .envelope        = {5.0f, 2000.0f, -6.0f, 400.0f},
+    .wave            = WAVE_e,
+    .pulse_width     = 0.5f,
+    .filter          = {FILTER_LOW, 0.2f, 0.5f},
+    // The old fixed vibrato, 10 Hz and about a quarter of a semitone
+    .mod             = {{LFO_SINE, LFO_TRIANGLE, LFO_RANDOM},
+                        {10.0f, 0.5f, 4.0f},
+                        {5.0f, 1000.0f, ENV_FLOOR_DB, 300.0f},
+                        {1, {{MOD_SRC_LFO1, MOD_PITCH, 0.25f,
+                              MOD_SRC_VIBRATO}}}},
+    .theremin        = 0,
+    .sample_paths    = {"sounds/kick.wav", "sounds/snare.wav",
+                        "sounds/hi-hat.wav"},
+    .input_gain      = 0.0f,
+    .input_send      = 0.0f,
+    .input_filter    = 0,
+    .input_detect    = 0,
+    .impulse_path    = "",
+    .conv_wet        = 0.5f,
+    .looper_seconds  = LOOPER_DEFAULT_SECONDS,
+    .record_dir      = ".",
+    .record_flac     = 0,
+    .sequencer       = {false, SEQ_DEFAULT_BPM, 0.0f, SEQ_DEFAULT_STEPS, {}},
+    .key_names       = {"Do", "Do#", "Re", "Re#", "Mi", "Fa",
+                        "Fa#", "Sol", "Sol#", "La", "La#", "Si"},
+    .reference_pitch = 440.0f,
+    .reference_key   = 9,
+    .scale_name      = TUNING_EQUAL,
+    .key_leds        = {17, 6, 16, 7, 15, 14, 8, 13, 9, 12, 10, 11},
+    .scale           = (1 << 1) | (1 << 4) | (1 << 6) | (1 << 7) | (1 << 11),
+    .color_pressed   = 0xF4430D,
+    .color_scale     = 0x4C1403,
+    .color_suggest   = {0x00FF00, 0x0000FF},
+};
+
+static std::atomic<const DAW_CONFIG *> current;
+
+// Old snapshots may still be read by a module, they are freed on cleanup
+static std::vector<DAW_CONFIG *> retired;
+
+static std::thread             watch_thread;
+static std::mutex              watch_mutex;
+static std::condition_variable watch_cv;
+static bool                    watching;
+static struct timespec         loaded_mtime;
+
+static std::string trim(const std::string& s) {
+    size_t first = s.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return "";
+    }
+    return s.substr(first, s.find_last_not_of(" \t\r") - first + 1);
+}
+
+static std::vector<std::string> split(const std::string& value) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (true) {
+        size_t comma = value.find(',', start);
+        items.push_back(trim(value.substr(start, comma - start)));
+        if (comma == std::string::npos) {
+            return items;
+        }
+        start = comma + 1;
+    }
+}
+
+static const FIELD *find_field(const std::string& section,
+                               const std::string& name) {
+    for (size_t f = 0; f < FIELD_CNT; f++) {
+        if (section == fields[f].section && name == fields[f].name) {
+            return &fields[f];
+        }
+    }
+    return nullptr;
+}
+
+static bool find_choice(const std::string& item, const char *const *choices,
+                        size_t count, uint8_t *index) {
+    for (size_t c = 0; c < count; c++) {
+        if (item == choices[c]) {
+            *index = static_cast<uint8_t>(c);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_number(const std::string& item, const FIELD *field,
+                         double *value) {
+    char *end;
+    bool  real = field->type == FIELD_FLOAT || field->type == FIELD_ROUTES;
+    if (real) {
+        *value = strtod(item.c_str(), &end);
+    } else {
+        // Base 0 so addresses and colors can be written in hex
+        *value = static_cast<double>(strtoul(item.c_str(), &end, 0));
+    }
+    // strtoul takes a '-' and wraps around, floats have min for that
+    return !item.empty() && *end == '\0'
+           && (real || item[0] != '-')
+           && *value >= field->min && *value <= field->max;
+}
+
+// Writes one value straight into its slot of the flat table
+static bool store(DAW_CONFIG *cfg, const FIELD *field, size_t index,
+                  const std::string& item) {
+    // A key set is a single mask whatever the number of items
+    size_t   width = field->count ? field->size / field->count : 0;
+    uint8_t *slot  = reinterpret_cast<uint8_t *>(cfg) + field->offset
+                     + index * width;
+    double   value;
+
+    switch (field->type) {
+        case FIELD_U8:
+            if (!parse_number(item, field, &value)) {
+                return false;
+            }
+            *slot = static_cast<uint8_t>(value);
+            return true;
+
+        case FIELD_U32:
+            if (!parse_number(item, field, &value)) {
+                return false;
+            }
+            *reinterpret_cast<uint32_t *>(slot) = static_cast<uint32_t>(value);
+            return true;
+
+        case FIELD_FLOAT:
+            if (!parse_number(item, field, &value)) {
+                return false;
+            }
+            *reinterpret_cast<float *>(slot) = static_cast<float>(value);
+            return true;
+
+        case FIELD_STRING:
+            if (item.size() < field->min || item.size() > field->max) {
+                return false;
+            }
+            memset(slot, 0, field->size / field->count);
+            memcpy(slot, item.c_str(), item.size());
+            return true;
+
+        case FIELD_KEY_SET:
+            if (!parse_number(item, field, &value)) {
+                return false;
+            }
+            *reinterpret_cast<uint16_t *>(slot) |= 1 << static_cast<int>(value);
+            return true;
+
+        case FIELD_BACKEND: {
+            static const AUDIO_BACKEND *backends[AUDIO_BACKEND_CNT] = {
+                &portaudio_backend, &alsa_backend, &jack_backend,
+                &null_backend
+            };
+            for (size_t b = 0; b < AUDIO_BACKEND_CNT; b++) {
+                if (item == backends[b]->name) {
+                    *reinterpret_cast<AUDIO_BACKEND_TYPE *>(slot) =
+                        static_cast<AUDIO_BACKEND_TYPE>(b);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        case FIELD_CHOICE:
+            return find_choice(item, field->choices,
+                               static_cast<size_t>(field->max) + 1, slot);
+
+        case FIELD_ROUTES: {
+            MOD_ROUTES *routes = reinterpret_cast<MOD_ROUTES *>(slot);
+            MOD_ROUTE  *route  = &routes->route[index];
+            std::istringstream words(item);
+            std::string source, dest, depth, via = "none", extra;
+            words >> source >> dest >> depth;
+            if (words >> via) {
+                words >> extra;
+            }
+            if (!extra.empty()
+                || !find_choice(source, source_names, MOD_SRC_CNT,
+                                &route->source)
+                || !find_choice(dest, dest_names, MOD_DEST_CNT, &route->dest)
+                || !find_choice(via, source_names, MOD_SRC_CNT, &route->via)
+                || !parse_number(depth, field, &value)) {
+                return false;
+            }
+            route->depth  = static_cast<float>(value);
+            routes->count = static_cast<uint8_t>(index + 1);
+            return true;
+        }
+
+        case FIELD_STEPS: {
+            // '.' is off, 'x' full velocity and 1..9 tenths of it
+            float (*rows)[SEQ_MAX_STEPS] =
+                reinterpret_cast<float (*)[SEQ_MAX_STEPS]>(slot);
+            std::istringstream words(item);
+            std::string track, steps, extra;
+            words >> track >> steps >> extra;
+
+            uint8_t row;
+            if (find_choice(track, sample_names, SAMPLE_CNT, &row)) {
+                row = SEQ_SAMPLE_TRACK(row);
+            } else {
+                char *end;
+                unsigned long key = strtoul(track.c_str(), &end, 10);
+                if (track.empty() || *end != '\0' || key >= MAX_KEYS) {
+                    return false;
+                }
+                row = SEQ_KEY_TRACK(key);
+            }
+            if (steps.empty() || steps.size() > SEQ_MAX_STEPS
+                || !extra.empty()) {
+                return false;
+            }
+
+            for (size_t s = 0; s < steps.size(); s++) {
+                char c = steps[s];
+                if (c == 'x') {
+                    rows[row][s] = 1.0f;
+                } else if (c >= '1' && c <= '9') {
+                    rows[row][s] = (c - '0') / 10.0f;
+                } else if (c == '.') {
+                    rows[row][s] = 0.0f;
+                } else {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool error(int line, const std::string& message) {
+    std::cerr << CONFIG_PATH << ":" << line << ": " << message << std::endl;
+    return false;
+}
+
+static bool assign(DAW_CONFIG *cfg, const std::string& section,
+                   const std::string& name, const std::string& value,
+                   int line) {
+    const FIELD *field = find_field(section, name);
+    if (!field) {
+        return error(line, "unknown setting [" + section + "] " + name);
+    }
+
+    std::vector<std::string> items = field->count == 1
+                                     ? std::vector<std::string>{value}
+                                     : split(value);
+    if (field->count && items.size() != field->count) {
+        return error(line, name + " needs " + std::to_string(field->count)
+                           + " values, got " + std::to_string(items.size()));
+    }
+
+    if (field->type == FIELD_ROUTES && items.size() > MOD_MAX_ROUTES) {
+        return error(line, name + " takes up to "
+                           + std::to_string(MOD_MAX_ROUTES) + " routes");
+    }
+
+    // Lists of any length start over, an empty one clears them
+    if (field->type == FIELD_KEY_SET || field->type == FIELD_ROUTES
+        || field->type == FIELD_STEPS) {
+        memset(reinterpret_cast<uint8_t *>(cfg) + field->offset, 0,
+               field->size);
+        if (items.size() == 1 && items[0].empty()) {
+            return true;
+        }
+    }
+
+    for (size_t i = 0; i < items.size(); i++) {
+        if (!store(cfg, field, i, items[i])) {
+            return error(line, "bad value for " + name + ": '" + items[i]
+                               + "'");
+        }
+    }
+    return true;
+}
+
+// Checks that span several values
+static bool validate(const DAW_CONFIG *cfg) {
+    uint32_t used = 0;
+    for (size_t k = 0; k < MAX_KEYS; k++) {
+        if (used & (1u << cfg->key_leds[k])) {
+            std::cerr << CONFIG_PATH << ": LED " << int(cfg->key_leds[k])
+                      << " is mapped to more than one key" << std::endl;
+            return false;
+        }
+        used |= 1u << cfg->key_leds[k];
+    }
+
+    uint8_t addresses[] = {cfg->keys_address, cfg->analog_address,
+                           cfg->accel_address};
+    for (size_t a = 0; a < 3; a++) {
+        for (size_t b = a + 1; b < 3; b++) {
+            if (addresses[a] == addresses[b]) {
+                std::cerr << CONFIG_PATH << ": two I2C devices share address "
+                          << int(addresses[a]) << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Parses the whole file over the defaults into cfg. A value ending in a comma
+ * continues on the next line, comments take a whole line. Nothing is kept
+ * from a file with any error.
+ */
+static bool parse(const char *path, DAW_CONFIG *cfg) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+
+    *cfg = defaults;
+
+    std::string section;
+    std::string name;
+    std::string value;
+    std::string line;
+    int         number    = 0;
+    int         start     = 0;
+    bool        ok        = true;
+    bool        continued = false;
+
+    while (std::getline(file, line)) {
+        number++;
+
+        // Only whole-line comments, '#' is part of note names
+        line = trim(line);
+        if (!line.empty() && line.front() == '#') {
+            continue;
+        }
+
+        if (continued) {
+            value += line;
+        } else if (line.empty()) {
+            continue;
+        } else if (line.front() == '[') {
+            if (line.back() != ']') {
+                ok = error(number, "unterminated section");
+                continue;
+            }
+            section = trim(line.substr(1, line.size() - 2));
+            continue;
+        } else {
+            size_t equals = line.find('=');
+            if (equals == std::string::npos) {
+                ok = error(number, "expected name = value");
+                continue;
+            }
+            name  = trim(line.substr(0, equals));
+            value = trim(line.substr(equals + 1));
+            start = number;
+        }
+
+        continued = !value.empty() && value.back() == ',';
+        if (!continued) {
+            ok = assign(cfg, section, name, value, start) && ok;
+        }
+    }
+
+    if (continued) {
+        ok = error(start, "list never ends");
+    }
+    return ok && validate(cfg);
+}
+
+static struct timespec file_mtime() {
+    struct stat st;
+    if (stat(CONFIG_PATH, &st)) {
+        return {0, 0};
+    }
+    return st.st_mtim;
+}
+
+static bool same_field(const DAW_CONFIG *a, const DAW_CONFIG *b,
+                       const FIELD *field) {
+    return !memcmp(reinterpret_cast<const uint8_t *>(a) + field->offset,
+                   reinterpret_cast<const uint8_t *>(b) + field->offset,
+                   field->size);
+}
+
+static bool same_section(const DAW_CONFIG *a, const DAW_CONFIG *b,
+                         const char *section) {
+    for (size_t f = 0; f < FIELD_CNT; f++) {
+        if (!strcmp(fields[f].section, section)
+            && !same_field(a, b, &fields[f])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Takes the hot sections from the edited file and keeps the rest as they
+ * were loaded, then lets the owning modules pick the changes up.
+ */
+static void reload() {
+    DAW_CONFIG parsed;
+    if (!parse(CONFIG_PATH, &parsed)) {
+        std::cerr << "Config not reloaded, keeping the current one"
+                  << std::endl;
+        return;
+    }
+
+    const DAW_CONFIG *old  = current.load();
+    DAW_CONFIG       *next = new DAW_CONFIG(*old);
+    bool              cold = false;
+
+    for (size_t f = 0; f < FIELD_CNT; f++) {
+        const FIELD *field = &fields[f];
+        if (field->hot) {
+            memcpy(reinterpret_cast<uint8_t *>(next) + field->offset,
+                   reinterpret_cast<const uint8_t *>(&parsed) + field->offset,
+                   field->size);
+        } else if (!same_field(old, &parsed, field)) {
+            cold = true;
+        }
+    }
+
+    current.store(next);
+    retired.push_back(next);
+
+    std::cout << "  * config reloaded\n";
+    if (cold) {
+        std::cout << "  * some changes only apply after a restart\n";
+    }
+
+    if (!same_section(old, next, "envelope")) {
+        set_envelope(&next->envelope);
+    }
+    if (old->pulse_width != next->pulse_width) {
+        set_pulse_width(next->pulse_width);
+    }
+    if (!same_section(old, next, "filter")) {
+        set_filter(&next->filter);
+    }
+    if (!same_section(old, next, "modulation")) {
+        set_modulation(&next->mod);
+    }
+    if (!same_section(old, next, "tuning")) {
+        tuning_reload();
+    }
+    if (!same_section(old, next, "leds")) {
+        refresh_led();
+    }
+}
+
+static void watch_loop() {
+    std::unique_lock<std::mutex> lock(watch_mutex);
+
+    while (!watch_cv.wait_for(lock, std::chrono::milliseconds(CONFIG_POLL_MS),
+                              [] { return !watching; })) {
+        struct timespec mtime = file_mtime();
+        if (mtime.tv_sec == loaded_mtime.tv_sec
+            && mtime.tv_nsec == loaded_mtime.tv_nsec) {
+            continue;
+        }
+        loaded_mtime = mtime;
+
+        // Editors often write the file in several steps, let them finish
+        if (mtime.tv_sec || mtime.tv_nsec) {
+            lock.unlock();
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(CONFIG_POLL_MS / 5));
+            reload();
+            lock.lock();
+        }
+    }
+}
+
+uint8_t init_config() {
+    std::cout << "  * loading configuration ...\n";
+
+    DAW_CONFIG *cfg = new DAW_CONFIG(defaults);
+    loaded_mtime = file_mtime();
+
+    if (!loaded_mtime.tv_sec && !loaded_mtime.tv_nsec) {
+        std::cout << "  * no " << CONFIG_PATH << ", using built-in defaults\n";
+    } else if (!parse(CONFIG_PATH, cfg)) {
+        delete cfg;
+        return CONFIG_INITERR;
+    }
+
+    current.store(cfg);
+    retired.push_back(cfg);
+
+    watching = true;
+    watch_thread = std::thread(watch_loop);
+
+    std::cout << " Config Success!\n";
+    return CONFIG_SUCCESS;
+}
+
+void cleanup_config() {
+    {
+        std::lock_guard<std::mutex> lock(watch_mutex);
+        if (!watching) {
+            return;
+        }
+        watching = false;
+    }
+    watch_cv.notify_one();
+    watch_thread.join();
+
+    // Only called on the way out, when no module reads the config anymore
+    current.store(nullptr);
+    for (DAW_CONFIG *cfg : retired) {
+        delete cfg;
+    }
+    retired.clear();
+}
+
+const DAW_CONFIG *config() {
+    const DAW_CONFIG *cfg = current.load(std::memory_order_acquire);
+    return cfg ? cfg : &defaults;
+}
@@ -0,0 +1,350 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <iostream>
+#include <linux/futex.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sndfile.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "convolution.hpp"
+
+// Under the audio thread and the render workers, over everything else
+#define CONV_RT_PRIORITY 60
+
+static long futex(std::atomic<uint32_t> *word, int op, uint32_t value) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), op, value,
+                   nullptr, nullptr, 0);
+}
+
+/*
+ * Cuts a response into parts of one block and keeps the spectrum of each,
+ * zero padded to two blocks. h is one array of length samples per channel.
+ */
+static void stage_init(CONV_STAGE *stage, uint32_t block,
+                       const std::vector<float> *h, uint8_t channels,
+                       uint32_t offset, uint32_t length) {
+    fft_init(&stage->fft, 2 * block);
+    stage->block    = block;
+    stage->bins     = block + 1;
+    stage->parts    = (length + block - 1) / block;
+    stage->channels = channels;
+    stage->head     = 0;
+
+    size_t spectra = static_cast<size_t>(stage->parts) * stage->bins;
+    stage->h_re   = new float[channels * spectra];
+    stage->h_im   = new float[channels * spectra];
+    stage->x_re   = new float[spectra]();
+    stage->x_im   = new float[spectra]();
+    stage->window = new float[2 * block]();
+    stage->acc_re = new float[stage->bins];
+    stage->acc_im = new float[stage->bins];
+    stage->y      = new float[2 * block];
+
+    for (uint8_t c = 0; c < channels; c++) {
+        for (uint32_t p = 0; p < stage->parts; p++) {
+            uint32_t start = offset + p * block;
+            uint32_t end   = std::min(start + block, offset + length);
+            std::fill(stage->y, stage->y + 2 * block, 0.0f);
+            std::copy(h[c].begin() + start, h[c].begin() + end, stage->y);
+
+            size_t at = (c * stage->parts + p) * stage->bins;
+            fft_forward(&stage->fft, stage->y, stage->h_re + at,
+                        stage->h_im + at);
+        }
+    }
+}
+
+static void stage_cleanup(CONV_STAGE *stage) {
+    fft_cleanup(&stage->fft);
+    delete[] stage->h_re;
+    delete[] stage->h_im;
+    delete[] stage->x_re;
+    delete[] stage->x_im;
+    delete[] stage->window;
+    delete[] stage->acc_re;
+    delete[] stage->acc_im;
+    delete[] stage->y;
+    *stage = {};
+}
+
+static void stage_reset(CONV_STAGE *stage) {
+    size_t spectra = static_cast<size_t>(stage->parts) * stage->bins;
+    std::fill(stage->x_re, stage->x_re + spectra, 0.0f);
+    std::fill(stage->x_im, stage->x_im + spectra, 0.0f);
+    std::fill(stage->window, stage->window + 2 * stage->block, 0.0f);
+    stage->head = 0;
+}
+
+// Takes one block of input, its window becomes the newest spectrum
+static void stage_push(CONV_STAGE *stage, const float *input) {
+    uint32_t block = stage->block;
+    std::copy(stage->window + block, stage->window + 2 * block,
+              stage->window);
+    std::copy(input, input + block, stage->window + block);
+
+    stage->head = (stage->head + 1) % stage->parts;
+    size_t at = static_cast<size_t>(stage->head) * stage->bins;
+    fft_forward(&stage->fft, stage->window, stage->x_re + at,
+                stage->x_im + at);
+}
+
+/*
+ * One block of output for a channel: every past input spectrum times the
+ * part of the response that far back, summed, transformed back, and the
+ * wrapped around half thrown away.
+ */
+static void stage_output(CONV_STAGE *stage, uint8_t channel, float *out) {
+    uint32_t bins = stage->bins;
+    float   *acc_re = stage->acc_re;
+    float   *acc_im = stage->acc_im;
+    std::fill(acc_re, acc_re + bins, 0.0f);
+    std::fill(acc_im, acc_im + bins, 0.0f);
+
+    for (uint32_t p = 0; p < stage->parts; p++) {
+        uint32_t     x  = (stage->head + stage->parts - p) % stage->parts;
+        const float *xr = stage->x_re + static_cast<size_t>(x) * bins;
+        const float *xi = stage->x_im + static_cast<size_t>(x) * bins;
+        size_t       at = (static_cast<size_t>(channel) * stage->parts + p)
+                          * bins;
+        const float *hr = stage->h_re + at;
+        const float *hi = stage->h_im + at;
+        for (uint32_t k = 0; k < bins; k++) {
+            acc_re[k] += xr[k] * hr[k] - xi[k] * hi[k];
+            acc_im[k] += xr[k] * hi[k] + xi[k] * hr[k];
+        }
+    }
+
+    fft_inverse(&stage->fft, acc_re, acc_im, stage->y);
+    std::copy(stage->y + stage->block, stage->y + 2 * stage->block, out);
+}
+
+/*
+ * Convolves every tail block handed over, in order. A block whose input
+ * has been written over by the time the thread gets to it is given up on:
+ * the history starts over from the newest one.
+ */
+static void tail_loop(CONVOLUTION *conv) {
+    CONV_STAGE *tail = &conv->tail;
+
+    while (!conv->stopping.load()) {
+        uint32_t requested = conv->requested.load(std::memory_order_acquire);
+        uint32_t next      = conv->done.load(std::memory_order_relaxed);
+        if (next == requested) {
+            futex(&conv->requested, FUTEX_WAIT_PRIVATE, requested);
+            continue;
+        }
+
+        if (requested - next >= CONV_TAIL_RING - 1) {
+            stage_reset(tail);
+            next = requested - 1;
+        }
+
+        stage_push(tail, conv->tail_in
+                         + (next % CONV_TAIL_RING) * CONV_TAIL_BLOCK);
+        for (uint8_t c = 0; c < conv->channels; c++) {
+            stage_output(tail, c, conv->result
+                                  + ((next % 2) * conv->channels + c)
+                                    * CONV_TAIL_BLOCK);
+        }
+        conv->done.store(next + 1, std::memory_order_release);
+    }
+}
+
+uint8_t conv_load(CONVOLUTION *conv, const char *path, uint32_t rate) {
+    SF_INFO info = {};
+    SNDFILE *file = sf_open(path, SFM_READ, &info);
+    if (!file) {
+        std::cerr << "Failed to open impulse response " << path << std::endl;
+        return CONV_OPENERR;
+    }
+    if (static_cast<uint32_t>(info.samplerate) != rate) {
+        std::cerr << "Impulse response " << path << " is at "
+                  << info.samplerate << " Hz, the stream at " << rate
+                  << std::endl;
+        sf_close(file);
+        return CONV_RATEERR;
+    }
+
+    sf_count_t frames = std::min<sf_count_t>(info.frames,
+                                             CONV_MAX_SECONDS * rate);
+    std::vector<float> interleaved(frames * info.channels);
+    frames = sf_readf_float(file, interleaved.data(), frames);
+    sf_close(file);
+    if (frames <= 0) {
+        std::cerr << "Impulse response " << path << " is empty" << std::endl;
+        return CONV_OPENERR;
+    }
+
+    // Split the channels and bring the whole response to unit energy
+    uint8_t channels = std::min(info.channels, CONV_MAX_CHANNELS);
+    std::vector<float> h[CONV_MAX_CHANNELS];
+    double energy = 0.0;
+    for (uint8_t c = 0; c < channels; c++) {
+        h[c].resize(frames);
+        for (sf_count_t i = 0; i < frames; i++) {
+            h[c][i] = interleaved[i * info.channels + c];
+            energy += h[c][i] * h[c][i];
+        }
+    }
+    float scale = energy > 0.0 ? static_cast<float>(1.0 / sqrt(energy
+                                                                / channels))
+                               : 0.0f;
+    for (uint8_t c = 0; c < channels; c++) {
+        for (float& sample : h[c]) {
+            sample *= scale;
+        }
+    }
+
+    uint32_t length = static_cast<uint32_t>(frames);
+    uint32_t split  = std::min<uint32_t>(length,
+                                         CONV_EARLY_PARTS * CONV_BLOCK);
+    conv->channels = channels;
+    stage_init(&conv->early, CONV_BLOCK, h, channels, 0, split);
+    stage_init(&conv->tail, CONV_TAIL_BLOCK, h, channels, split,
+               length - split);
+
+    std::fill(conv->in, conv->in + CONV_BLOCK, 0.0f);
+    for (uint8_t c = 0; c < CONV_MAX_CHANNELS; c++) {
+        std::fill(conv->out[c], conv->out[c] + CONV_BLOCK, 0.0f);
+        std::fill(conv->tail_out[c], conv->tail_out[c] + CONV_TAIL_BLOCK,
+                  0.0f);
+    }
+    conv->fill      = 0;
+    conv->tail_pos  = 0;
+    conv->tail_fill = 0;
+    conv->handed    = 0;
+    conv->tail_in   = new float[CONV_TAIL_RING * CONV_TAIL_BLOCK]();
+    conv->result    = new float[2 * channels * CONV_TAIL_BLOCK]();
+    conv->requested = 0;
+    conv->done      = 0;
+    conv->missed    = 0;
+    conv->stopping  = false;
+
+    if (conv->tail.parts) {
+        conv->thread = std::thread(tail_loop, conv);
+
+        struct sched_param param = {};
+        param.sched_priority = CONV_RT_PRIORITY;
+        if (pthread_setschedparam(conv->thread.native_handle(), SCHED_FIFO,
+                                  &param)) {
+            std::cerr << "Warning: convolution tail thread is not real-time"
+                      << std::endl;
+        }
+    }
+
+    conv->loaded = true;
+    std::cout << "  * impulse response: " << length << " frames, "
+              << int(conv->early.parts) << " early and "
+              << int(conv->tail.parts) << " tail partitions\n";
+    return CONV_SUCCESS;
+}
+
+void conv_unload(CONVOLUTION *conv) {
+    if (!conv->loaded) {
+        return;
+    }
+
+    if (conv->thread.joinable()) {
+        conv->stopping = true;
+        conv->requested.fetch_add(1);
+        futex(&conv->requested, FUTEX_WAKE_PRIVATE, INT_MAX);
+        conv->thread.join();
+    }
+
+    if (conv->missed.load()) {
+        std::cerr << "Warning: convolution tail missed "
+                  << conv->missed.load() << " blocks" << std::endl;
+    }
+
+    stage_cleanup(&conv->early);
+    stage_cleanup(&conv->tail);
+    delete[] conv->tail_in;
+    delete[] conv->result;
+    conv->tail_in = nullptr;
+    conv->result  = nullptr;
+    conv->loaded  = false;
+}
+
+/*
+ * A full block of input: the early parts are convolved right here, the tail
+ * due over the same block is added, and every CONV_TAIL_BLOCK the block
+ * finished by the tail thread is picked up and the next one handed over.
+ */
+static void run_block(CONVOLUTION *conv) {
+    stage_push(&conv->early, conv->in);
+    for (uint8_t c = 0; c < conv->channels; c++) {
+        stage_output(&conv->early, c, conv->out[c]);
+    }
+
+    // Short responses end within the early parts
+    if (!conv->tail.parts) {
+        return;
+    }
+
+    for (uint8_t c = 0; c < conv->channels; c++) {
+        const float *tail = conv->tail_out[c] + conv->tail_pos;
+        for (uint32_t i = 0; i < CONV_BLOCK; i++) {
+            conv->out[c][i] += tail[i];
+        }
+    }
+    conv->tail_pos += CONV_BLOCK;
+
+    std::copy(conv->in, conv->in + CONV_BLOCK,
+              conv->tail_in + (conv->handed % CONV_TAIL_RING)
+                              * CONV_TAIL_BLOCK + conv->tail_fill);
+    conv->tail_fill += CONV_BLOCK;
+    if (conv->tail_fill < CONV_TAIL_BLOCK) {
+        return;
+    }
+    conv->tail_fill = 0;
+    conv->tail_pos  = 0;
+
+    // The block handed last time is due from here on, a late one is
+    // silence rather than a wait
+    if (conv->handed) {
+        if (conv->done.load(std::memory_order_acquire) == conv->handed) {
+            const float *result = conv->result
+                                  + ((conv->handed - 1) % 2) * conv->channels
+                                    * CONV_TAIL_BLOCK;
+            for (uint8_t c = 0; c < conv->channels; c++) {
+                std::copy(result + c * CONV_TAIL_BLOCK,
+                          result + (c + 1) * CONV_TAIL_BLOCK,
+                          conv->tail_out[c]);
+            }
+        } else {
+            for (uint8_t c = 0; c < conv->channels; c++) {
+                std::fill(conv->tail_out[c],
+                          conv->tail_out[c] + CONV_TAIL_BLOCK, 0.0f);
+            }
+            conv->missed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    conv->handed++;
+    conv->requested.store(conv->handed, std::memory_order_release);
+    futex(&conv->requested, FUTEX_WAKE_PRIVATE, 1);
+}
+
+void conv_process(CONVOLUTION *conv, const float *in, float *left,
+                  float *right, float wet, unsigned int frames) {
+    const float *out_left  = conv->out[0];
+    const float *out_right = conv->out[conv->channels > 1 ? 1 : 0];
+
+    for (unsigned int i = 0; i < frames; i++) {
+        conv->in[conv->fill] = in[i];
+        left[i]  += wet * out_left[conv->fill];
+        right[i] += wet * out_right[conv->fill];
+
+        if (++conv->fill == CONV_BLOCK) {
+            conv->fill = 0;
+            run_block(conv);
+        }
+    }
+}
@@ -0,0 +1,479 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <math.h>
+#include <mutex>
+#include <thread>
+#include <time.h>
+
+#include "config.hpp"
+#include "fft.hpp"
+#include "keys.hpp"
+#include "ring.hpp"
+#include "theory.hpp"
+
+#include "detect.hpp"
+
+// ~0.37 s of input at 44.1 kHz, the thread only ever needs one window
+#define DETECT_BLOCK_FRAMES 256
+#define DETECT_RING_BLOCKS  64
+
+#define DETECT_POLL_MS 5
+
+// RMS under this is silence, about -50 dBFS
+#define DETECT_GATE 0.003f
+
+// Normalized YIN difference a single clear pitch dips under. Chords and
+// noise never get that low, they go to the chromagram instead.
+#define DETECT_YIN_THRESHOLD 0.15f
+
+// Pitch range of YIN, low E of a bass to well over a guitar's top fret
+#define DETECT_MIN_HZ 40.0f
+#define DETECT_MAX_HZ 1500.0f
+
+// Bins that make up the chromagram, kept to where chord fundamentals are:
+// overtones above only add notes that aren't played
+#define DETECT_CHROMA_MIN_HZ 60.0f
+#define DETECT_CHROMA_MAX_HZ 1000.0f
+
+// Share of the strongest pitch class a class needs to count as a note, and
+// of the strongest peak the lowest one needs to count as the bass
+#define DETECT_NOTE_SHARE 0.35f
+#define DETECT_BASS_SHARE 0.3f
+
+// Hops the same notes have to be heard for before they are shown
+#define DETECT_STABLE_HOPS 2
+
+typedef struct detect_block {
+    uint32_t frames;
+    uint64_t time_ns;  // CLOCK_MONOTONIC when the callback had it
+    float    samples[DETECT_BLOCK_FRAMES];
+} DETECT_BLOCK;
+
+typedef struct detection {
+    uint8_t notes[DETECT_MAX_NOTES];  // Key indexes (Do = 0), bass first
+    uint8_t count;
+} DETECTION;
+
+static SpscRing<DETECT_BLOCK, DETECT_RING_BLOCKS> ring;
+
+static std::atomic<bool>     tapping;
+static std::atomic<bool>     detect_running;
+static std::atomic<uint32_t> dropped;
+static std::thread           detect_thread;
+
+// Latest steady detection, for the main loop
+static std::mutex        result_mutex;
+static DETECTION         result;
+static std::atomic<bool> result_fresh;
+
+// Analysis thread only
+static float     rate;
+static float     reference_pitch;
+static uint8_t   reference_key;
+static float     history[DETECT_WINDOW];  // Circular, history_pos is oldest
+static uint32_t  history_pos;
+static uint32_t  pending;                 // Samples since the last hop
+static float     frame[DETECT_WINDOW];    // The window, oldest first
+static float     windowed[DETECT_WINDOW];
+static float     hann[DETECT_WINDOW];
+static FFT       chroma_fft;
+static float     spec_re[DETECT_WINDOW / 2 + 1];
+static float     spec_im[DETECT_WINDOW / 2 + 1];
+static float     magnitude[DETECT_WINDOW / 2 + 1];
+static uint8_t   peak_note[DETECT_WINDOW / 4];   // Ascending in frequency
+static float     peak_level[DETECT_WINDOW / 4];
+static bool      bin_used[DETECT_WINDOW / 2 + 1];
+static FFT       yin_fft;
+static float     yin_re[DETECT_YIN_WINDOW / 2 + 1];
+static float     yin_im[DETECT_YIN_WINDOW / 2 + 1];
+static float     lag_re[DETECT_YIN_WINDOW / 2 + 1];
+static float     lag_im[DETECT_YIN_WINDOW / 2 + 1];
+static float     lag_in[DETECT_YIN_WINDOW];
+static float     corr[DETECT_YIN_WINDOW];
+static float     cmnd[DETECT_YIN_WINDOW / 2];
+static double    energy[DETECT_YIN_WINDOW + 1];
+static DETECTION candidate;
+static DETECTION shown;
+static uint8_t   stable_hops;
+
+// What the analysis cost, reported on cleanup
+static uint64_t hops;
+static uint64_t skipped;
+static double   cpu_sum_ms, cpu_max_ms;
+static double   latency_sum_ms, latency_max_ms;
+
+static uint64_t now_ns(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+}
+
+// Key index of a frequency, on the configured reference
+static uint8_t pitch_class(float hz) {
+    long note = lroundf(reference_key + 12.0f * log2f(hz / reference_pitch));
+    return static_cast<uint8_t>(((note % MAX_KEYS) + MAX_KEYS) % MAX_KEYS);
+}
+
+static bool same(const DETECTION& a, const DETECTION& b) {
+    return a.count == b.count
+           && std::equal(a.notes, a.notes + a.count, b.notes);
+}
+
+/*
+ * YIN over the newest DETECT_YIN_WINDOW samples: the difference function of
+ * the first half against every lag up to half the window, worked out from
+ * one FFT cross-correlation and running energies, then normalized by its
+ * running mean. Returns the pitch and how far the dip went (0 is a perfect
+ * period).
+ */
+static float yin(const float *x, float *aperiodicity) {
+    const uint32_t n    = DETECT_YIN_WINDOW;
+    const uint32_t half = n / 2;
+
+    // Sum of x[j] x[j + lag] over the first half, for every lag at once:
+    // the lags never reach past the window, so nothing wraps
+    fft_forward(&yin_fft, x, yin_re, yin_im);
+    std::copy(x, x + half, lag_in);
+    std::fill(lag_in + half, lag_in + n, 0.0f);
+    fft_forward(&yin_fft, lag_in, lag_re, lag_im);
+    for (uint32_t k = 0; k <= half; k++) {
+        float re = yin_re[k] * lag_re[k] + yin_im[k] * lag_im[k];
+        float im = yin_im[k] * lag_re[k] - yin_re[k] * lag_im[k];
+        lag_re[k] = re;
+        lag_im[k] = im;
+    }
+    fft_inverse(&yin_fft, lag_re, lag_im, corr);
+
+    energy[0] = 0.0;
+    for (uint32_t i = 0; i < n; i++) {
+        energy[i + 1] = energy[i] + x[i] * x[i];
+    }
+
+    uint32_t lo = std::max<uint32_t>(2, static_cast<uint32_t>(
+                                            rate / DETECT_MAX_HZ));
+    uint32_t hi = std::min<uint32_t>(half - 1, static_cast<uint32_t>(
+                                                   rate / DETECT_MIN_HZ));
+    double running = 0.0;
+    cmnd[0] = 1.0f;
+    for (uint32_t lag = 1; lag <= hi; lag++) {
+        double diff = energy[half] + energy[lag + half] - energy[lag]
+                      - 2.0 * corr[lag];
+        running  += diff;
+        cmnd[lag] = running > 0.0 ? static_cast<float>(diff * lag / running)
+                                  : 1.0f;
+    }
+
+    // The first dip under the threshold, down to its bottom; the deepest
+    // one if there is none
+    uint32_t best = 0;
+    for (uint32_t lag = lo; lag < hi; lag++) {
+        if (cmnd[lag] < DETECT_YIN_THRESHOLD) {
+            while (lag + 1 < hi && cmnd[lag + 1] < cmnd[lag]) {
+                lag++;
+            }
+            best = lag;
+            break;
+        }
+    }
+    if (!best) {
+        best = static_cast<uint32_t>(std::min_element(cmnd + lo, cmnd + hi)
+                                     - cmnd);
+    }
+
+    // Parabola through the dip and its neighbours
+    float shift = 0.0f;
+    if (best > lo && best + 1 < hi) {
+        float a = cmnd[best - 1];
+        float b = cmnd[best];
+        float c = cmnd[best + 1];
+        float den = a - 2.0f * b + c;
+        if (den > 0.0f) {
+            shift = 0.5f * (a - c) / den;
+        }
+    }
+
+    *aperiodicity = cmnd[best];
+    return rate / (best + shift);
+}
+
+/*
+ * Pitch classes of the whole window out of its spectrum. The bass note is
+ * the lowest clear peak, the other notes follow upwards from it so theory
+ * reads them like keys pressed from the bass.
+ */
+static void chroma(DETECTION *heard) {
+    for (uint32_t i = 0; i < DETECT_WINDOW; i++) {
+        windowed[i] = frame[i] * hann[i];
+    }
+    fft_forward(&chroma_fft, windowed, spec_re, spec_im);
+
+    for (uint32_t k = 0; k <= DETECT_WINDOW / 2; k++) {
+        magnitude[k] = sqrtf(spec_re[k] * spec_re[k]
+                             + spec_im[k] * spec_im[k]);
+    }
+
+    /*
+     * Peaks only, the skirts of a strong partial spill into the next class.
+     * Low down a bin is wider than a semitone, so each peak is placed by a
+     * parabola through its log magnitudes before it is given a class.
+     */
+    float    classes[MAX_KEYS] = {};
+    uint32_t peaks   = 0;
+    float    loudest = 0.0f;
+    for (uint32_t k = 1; k < DETECT_WINDOW / 2; k++) {
+        if (!bin_used[k] || magnitude[k] <= magnitude[k - 1]
+            || magnitude[k] < magnitude[k + 1]) {
+            continue;
+        }
+
+        float a = logf(magnitude[k - 1] + 1e-9f);
+        float b = logf(magnitude[k] + 1e-9f);
+        float c = logf(magnitude[k + 1] + 1e-9f);
+        float den   = a - 2.0f * b + c;
+        float shift = den < 0.0f ? 0.5f * (a - c) / den : 0.0f;
+        float hz    = (k + shift) * rate / DETECT_WINDOW;
+
+        uint8_t note = pitch_class(hz);
+        classes[note]      += magnitude[k];
+        peak_note[peaks]    = note;
+        peak_level[peaks++] = magnitude[k];
+        loudest = std::max(loudest, magnitude[k]);
+    }
+
+    float strongest = *std::max_element(classes, classes + MAX_KEYS);
+    if (strongest <= 0.0f) {
+        return;
+    }
+
+    // The lowest peak that isn't just leakage or noise
+    uint8_t root = 0;
+    for (uint32_t p = 0; p < peaks; p++) {
+        if (peak_level[p] >= DETECT_BASS_SHARE * loudest) {
+            root = peak_note[p];
+            break;
+        }
+    }
+
+    uint8_t order[MAX_KEYS];
+    for (uint8_t c = 0; c < MAX_KEYS; c++) {
+        order[c] = c;
+    }
+    std::sort(order, order + MAX_KEYS, [&](uint8_t a, uint8_t b) {
+        return classes[a] > classes[b];
+    });
+
+    heard->notes[0] = root;
+    heard->count    = 1;
+    for (uint8_t i = 0; i < MAX_KEYS && heard->count < DETECT_MAX_NOTES;
+         i++) {
+        if (classes[order[i]] < DETECT_NOTE_SHARE * strongest) {
+            break;
+        }
+        if (order[i] != root) {
+            heard->notes[heard->count++] = order[i];
+        }
+    }
+    std::sort(heard->notes + 1, heard->notes + heard->count,
+              [root](uint8_t a, uint8_t b) {
+                  return (a + MAX_KEYS - root) % MAX_KEYS
+                         < (b + MAX_KEYS - root) % MAX_KEYS;
+              });
+}
+
+// One hop: a single clear pitch by YIN, anything else by the chromagram
+static void analyse() {
+    for (uint32_t i = 0; i < DETECT_WINDOW; i++) {
+        frame[i] = history[(history_pos + i) % DETECT_WINDOW];
+    }
+    const float *recent = frame + DETECT_WINDOW - DETECT_YIN_WINDOW;
+
+    double sum_sq = 0.0;
+    for (uint32_t i = 0; i < DETECT_YIN_WINDOW; i++) {
+        sum_sq += recent[i] * recent[i];
+    }
+
+    DETECTION heard = {};
+    if (sqrt(sum_sq / DETECT_YIN_WINDOW) >= DETECT_GATE) {
+        float aperiodicity;
+        float hz = yin(recent, &aperiodicity);
+        if (aperiodicity < DETECT_YIN_THRESHOLD) {
+            heard.notes[0] = pitch_class(hz);
+            heard.count    = 1;
+        } else {
+            chroma(&heard);
+        }
+    }
+
+    // Only something heard steadily, and only when it changes
+    if (same(heard, candidate)) {
+        stable_hops = std::min<uint8_t>(stable_hops + 1, DETECT_STABLE_HOPS);
+    } else {
+        candidate   = heard;
+        stable_hops = 1;
+    }
+    if (stable_hops == DETECT_STABLE_HOPS && !same(candidate, shown)) {
+        shown = candidate;
+        std::lock_guard<std::mutex> lock(result_mutex);
+        result = shown;
+        result_fresh.store(true);
+    }
+}
+
+/*
+ * Takes whatever the callback handed over and analyses the newest window
+ * once a hop has come in. A thread that fell behind skips to the newest
+ * window rather than working through old ones, which keeps the results
+ * within about a hop of the input however slow it gets.
+ */
+static void detect_loop() {
+    DETECT_BLOCK block;
+
+    while (detect_running.load()) {
+        uint64_t newest = 0;
+        while (ring.pop(block)) {
+            for (uint32_t i = 0; i < block.frames; i++) {
+                history[history_pos] = block.samples[i];
+                history_pos = (history_pos + 1) % DETECT_WINDOW;
+            }
+            pending += block.frames;
+            newest   = block.time_ns;
+        }
+
+        if (pending < DETECT_HOP) {
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(DETECT_POLL_MS));
+            continue;
+        }
+        skipped += pending / DETECT_HOP - 1;
+        pending %= DETECT_HOP;
+
+        uint64_t cpu_start = now_ns(CLOCK_THREAD_CPUTIME_ID);
+        analyse();
+        double cpu_ms = (now_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start) / 1e6;
+        double latency_ms = (now_ns(CLOCK_MONOTONIC) - newest) / 1e6;
+
+        hops++;
+        cpu_sum_ms    += cpu_ms;
+        cpu_max_ms     = std::max(cpu_max_ms, cpu_ms);
+        latency_sum_ms += latency_ms;
+        latency_max_ms  = std::max(latency_max_ms, latency_ms);
+    }
+}
+
+uint8_t init_detect() {
+    tapping        = false;
+    detect_running = false;
+    if (!config()->input_detect || !audio_input_channels()) {
+        return DETECT_SUCCESS;
+    }
+
+    std::cout << "  * starting input detection ...\n";
+    if (fft_init(&chroma_fft, DETECT_WINDOW)
+        || fft_init(&yin_fft, DETECT_YIN_WINDOW)) {
+        std::cerr << "Failed to set up input detection" << std::endl;
+        fft_cleanup(&chroma_fft);
+        return DETECT_INITERR;
+    }
+
+    rate            = audio_sample_rate();
+    reference_pitch = config()->reference_pitch;
+    reference_key   = config()->reference_key;
+
+    for (uint32_t i = 0; i < DETECT_WINDOW; i++) {
+        hann[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / DETECT_WINDOW);
+    }
+    for (uint32_t k = 0; k <= DETECT_WINDOW / 2; k++) {
+        float hz = k * rate / DETECT_WINDOW;
+        bin_used[k] = hz >= DETECT_CHROMA_MIN_HZ
+                      && hz <= DETECT_CHROMA_MAX_HZ;
+    }
+
+    std::fill(history, history + DETECT_WINDOW, 0.0f);
+    history_pos  = 0;
+    pending      = 0;
+    candidate    = {};
+    shown        = {};
+    stable_hops  = 0;
+    result_fresh = false;
+    dropped      = 0;
+    hops         = 0;
+    skipped      = 0;
+    cpu_sum_ms   = cpu_max_ms     = 0.0;
+    latency_sum_ms = latency_max_ms = 0.0;
+
+    // An ordinary thread: the audio and render threads always come first
+    detect_running = true;
+    detect_thread  = std::thread(detect_loop);
+    tapping        = true;
+    return DETECT_SUCCESS;
+}
+
+void cleanup_detect() {
+    if (!detect_running) {
+        return;
+    }
+
+    tapping        = false;
+    detect_running = false;
+    detect_thread.join();
+    fft_cleanup(&chroma_fft);
+    fft_cleanup(&yin_fft);
+
+    if (!hops) {
+        return;
+    }
+    double hop_ms = 1000.0 * DETECT_HOP / rate;
+    std::cout << "  * input detection: " << hops << " hops, "
+              << cpu_sum_ms / hops << " ms CPU each (max " << cpu_max_ms
+              << " of a " << hop_ms << " ms hop), results "
+              << latency_sum_ms / hops << " ms after the input (max "
+              << latency_max_ms << ")\n";
+    if (skipped || dropped.load()) {
+        std::cerr << "Warning: input detection fell behind, " << skipped
+                  << " hops skipped and " << dropped.load()
+                  << " blocks dropped" << std::endl;
+    }
+}
+
+void detect_write(const AUDIO_INPUT *in, unsigned int frames) {
+    if (!tapping.load(std::memory_order_relaxed) || !in->channels) {
+        return;
+    }
+
+    DETECT_BLOCK block;
+    block.time_ns = now_ns(CLOCK_MONOTONIC);
+    float scale   = 1.0f / in->channels;
+    for (unsigned int done = 0; done < frames; done += block.frames) {
+        block.frames = std::min<unsigned int>(frames - done,
+                                              DETECT_BLOCK_FRAMES);
+        for (uint32_t i = 0; i < block.frames; i++) {
+            float sum = 0.0f;
+            for (uint8_t c = 0; c < in->channels; c++) {
+                sum += in->channel[c][(done + i) * in->stride];
+            }
+            block.samples[i] = sum * scale;
+        }
+
+        if (!ring.push(block)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+void loop_detect() {
+    if (!result_fresh.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    DETECTION heard;
+    {
+        std::lock_guard<std::mutex> lock(result_mutex);
+        heard = result;
+        result_fresh.store(false);
+    }
+    update_detected_state(heard.notes, heard.count);
+}
@@ -1,10 +1,16 @@
+#include <condition_variable>
 #include <cstdint>
+#include <errno.h>
 #include <fcntl.h>
 #include <iostream>
+#include <mutex>
+#include <poll.h>
 #include <string>
 #include <termios.h>
+#include <thread>
 #include <unistd.h>
 
+#include "config.hpp"
 #include "disp.hpp"
 
 // Error codes
@@ -12,48 +18,246 @@
 #define DISP_INI_ERR 1
 
 #define NEXTION_SERIAL_DEV "/dev/serial0"
+#define NEXTION_TERMINATOR "\xFF\xFF\xFF" // Nextion commands end with 3 x 0xFF
 
-static int serial_port;
+// Nextion boots at 9600 baud. With [devices] display_fast_baud the display is
+// asked to switch to NEXTION_FAST_BAUD with the (non-persistent) "baud="
+// command.
+#define NEXTION_BOOT_BAUD      B9600
+#define NEXTION_FAST_BAUD      B115200
+    #define NEXTION_FAST_BAUD_CMD  "baud=115200"
+#define NEXTION_BAUD_SWITCH_MS 50
 
-static void send_command(const std::string& cmd) {
-    std::string full_cmd = cmd + "\xFF\xFF\xFF"; // Nextion commands end with 3 x 0xFF
-    write(serial_port, full_cmd.c_str(), full_cmd.length());
-}
+// Big enough for every component of one frame, so commits never reallocate
+#define DISP_FRAME_RESERVE 512
+#define DISP_WRITE_TIMEOUT 100 // ms
 
-uint8_t init_disp() {
-    // Open the serial port
-    serial_port = open(NEXTION_SERIAL_DEV, O_RDWR | O_NOCTTY | O_NDELAY);
-    if (serial_port == -1) {
-        std::cerr << "Failed to open serial port." << std::endl;
-        return DISP_INI_ERR;
-    }
+typedef enum component_type {
+    COMP_TEXT = 0,  // obj.txt="value"
+    COMP_NUMBER,    // obj.val=value
+} COMPONENT_TYPE;
+
+typedef struct component {
+    const char     *attr;
+    COMPONENT_TYPE  type;
+    std::string     value;   // Latest value requested by the app
+    std::string     shadow;  // Value the display is known to show
+    bool            valid;   // Shadow reflects the display contents
+} COMPONENT;
+
+// Indexed by DISP_FIELD
+static COMPONENT components[DISP_FIELD_CNT] = {
+    {"t0.txt", COMP_TEXT, "", "", false},
+    {"t1.txt", COMP_TEXT, "", "", false},
+    {"t2.txt", COMP_TEXT, "", "", false},
+    {"t3.txt", COMP_TEXT, "", "", false},
+    {"t4.txt", COMP_TEXT, "", "", false},
+    {"t5.txt", COMP_TEXT, "", "", false},
+    {"j0.val", COMP_NUMBER, "0", "", false},
+    {"t6.txt", COMP_TEXT, "", "", false},
+};
+
+static int serial_port = -1;
 
-    // Configure the serial port
+static std::thread             writer;
+static std::mutex              disp_mutex;
+static std::condition_variable disp_cv;
+static bool                    frame_pending;
+static bool                    writer_running;
+
+// Only touched by the writer thread
+static std::string frame;
+
+static void configure_port(speed_t baud) {
     struct termios options;
     tcgetattr(serial_port, &options);
-    cfsetispeed(&options, B9600); // Set baud rate (should match Nextion setting)
-    cfsetospeed(&options, B9600);
+    cfsetispeed(&options, baud);
+    cfsetospeed(&options, baud);
     options.c_cflag |= (CLOCAL | CREAD);
     options.c_cflag &= ~CSIZE;
     options.c_cflag |= CS8; // 8 data bits
     options.c_cflag &= ~PARENB; // No parity
     options.c_cflag &= ~CSTOPB; // 1 stop bit
     options.c_cflag &= ~CRTSCTS; // No flow control
+    cfmakeraw(&options);
     tcsetattr(serial_port, TCSANOW, &options);
+}
+
+// The port is non-blocking, so wait for room instead of spinning on EAGAIN.
+// False when the port failed and part of the data never went out.
+static bool write_all(const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(serial_port, data, length);
+        if (written > 0) {
+            data   += written;
+            length -= written;
+        } else if (written < 0 && errno != EAGAIN && errno != EINTR) {
+            std::cerr << "Display write failed (errno " << errno << ")"
+                      << std::endl;
+            return false;
+        } else {
+            struct pollfd pfd = {serial_port, POLLOUT, 0};
+            poll(&pfd, 1, DISP_WRITE_TIMEOUT);
+        }
+    }
+    return true;
+}
+
+static void send_raw_command(const char *cmd) {
+    write_all(cmd, std::char_traits<char>::length(cmd));
+    write_all(NEXTION_TERMINATOR, 3);
+}
+
+/*
+ * "baud=" only takes effect until the display is power cycled, and the app is
+ * restarted by the service loop while the display keeps running. The request
+ * is therefore sent at both rates: the copy sent at the wrong rate is garbage
+ * to the display and gets rejected.
+ */
+static void negotiate_baud() {
+    configure_port(NEXTION_FAST_BAUD);
+    write_all(NEXTION_TERMINATOR, 3); // Terminate any partial command
+    send_raw_command(NEXTION_FAST_BAUD_CMD);
+    tcdrain(serial_port);
+
+    configure_port(NEXTION_BOOT_BAUD);
+    write_all(NEXTION_TERMINATOR, 3);
+    send_raw_command(NEXTION_FAST_BAUD_CMD);
+    tcdrain(serial_port);
+
+    usleep(NEXTION_BAUD_SWITCH_MS * 1000);
+    configure_port(NEXTION_FAST_BAUD);
+    tcflush(serial_port, TCIOFLUSH);
+}
+
+static void append_command(const COMPONENT& comp) {
+    frame += comp.attr;
+    frame += '=';
+    if (comp.type == COMP_TEXT) {
+        frame += '"';
+        frame += comp.value;
+        frame += '"';
+    } else {
+        frame += comp.value;
+    }
+    frame.append(NEXTION_TERMINATOR, 3);
+}
+
+/*
+ * Builds a frame from the components that differ from the shadow copy. Several
+ * commits that arrive while a write is in flight collapse into one frame that
+ * only carries the latest values.
+ */
+static void writer_loop() {
+    std::unique_lock<std::mutex> lock(disp_mutex);
+    while (writer_running) {
+        disp_cv.wait(lock, [] { return frame_pending || !writer_running; });
+        if (!writer_running) {
+            break;
+        }
+        frame_pending = false;
+
+        bool sent[DISP_FIELD_CNT] = {};
+        frame.clear();
+        for (size_t c = 0; c < DISP_FIELD_CNT; c++) {
+            COMPONENT& comp = components[c];
+            if (!comp.valid || comp.value != comp.shadow) {
+                append_command(comp);
+                comp.shadow = comp.value;
+                comp.valid  = true;
+                sent[c]     = true;
+            }
+        }
+
+        if (frame.empty()) {
+            continue;
+        }
+
+        lock.unlock();
+        bool ok = write_all(frame.data(), frame.size());
+        lock.lock();
+
+        // Nothing is known about what the display got, send it all again
+        // with the next commit
+        if (!ok) {
+            for (size_t c = 0; c < DISP_FIELD_CNT; c++) {
+                if (sent[c]) {
+                    components[c].valid = false;
+                }
+            }
+        }
+    }
+}
+
+uint8_t init_disp() {
+    // Open the serial port
+    serial_port = open(NEXTION_SERIAL_DEV, O_RDWR | O_NOCTTY | O_NDELAY);
+    if (serial_port == -1) {
+        std::cerr << "Failed to open serial port." << std::endl;
+        return DISP_INI_ERR;
+    }
+
+    // Configure the serial port (should match Nextion setting)
+    configure_port(NEXTION_BOOT_BAUD);
+    if (config()->disp_fast_baud) {
+        negotiate_baud();
+    }
+
+    frame.reserve(DISP_FRAME_RESERVE);
+    frame_pending  = false;
+    writer_running = true;
+    writer = std::thread(writer_loop);
 
     return DISP_SUCCESS;
 }
 
 void cleanup_disp() {
+    {
+        std::lock_guard<std::mutex> lock(disp_mutex);
+        if (!writer_running) {
+            return;
+        }
+        writer_running = false;
+    }
+    disp_cv.notify_one();
+    writer.join();
+
     close(serial_port);
+    serial_port = -1;
 }
 
-void set_chord(std::string chord, std::string composition) {
-    send_command(chord);
-    send_command(composition);
+void set_disp_field(DISP_FIELD field, const std::string& value) {
+    if (field >= DISP_FIELD_CNT) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(disp_mutex);
+    components[field].value = value;
 }
 
-void set_suggestions(std::string sug1, std::string sug2) {
-    send_command(sug1);
-    send_command(sug2);
+void set_chord(const std::string& chord, const std::string& composition) {
+    set_disp_field(DISP_CHORD, chord);
+    set_disp_field(DISP_COMPOSITION, composition);
+}
+
+void set_suggestion(uint8_t slot, const std::string& chord,
+                    const std::string& path) {
+    if (slot == 0) {
+        set_disp_field(DISP_SUG1_CHORD, chord);
+        set_disp_field(DISP_SUG1_PATH, path);
+    } else {
+        set_disp_field(DISP_SUG2_CHORD, chord);
+        set_disp_field(DISP_SUG2_PATH, path);
+    }
+}
+
+void disp_commit() {
+    {
+        std::lock_guard<std::mutex> lock(disp_mutex);
+        if (!writer_running) {
+            return;
+        }
+        frame_pending = true;
+    }
+    disp_cv.notify_one();
 }
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <cstdint>
+#include <math.h>
+
+#include "envelope.hpp"
+
+// dB to a gain factor, 10^(dB / 20)
+static float db_gain(float db) {
+    return exp2f(db * (3.3219281f / 20.0f));
+}
+
+void envelope_start(ENVELOPE *env) {
+    if (env->stage == ENV_IDLE) {
+        env->level = ENV_FLOOR_DB;
+    }
+    env->stage = ENV_ATTACK;
+}
+
+void envelope_release(ENVELOPE *env) {
+    if (env->stage != ENV_IDLE) {
+        env->stage = ENV_RELEASE;
+    }
+}
+
+float envelope_amount(const ENVELOPE *env) {
+    return env->stage == ENV_IDLE ? 0.0f : 1.0f - env->level / ENV_FLOOR_DB;
+}
+
+bool envelope_block(ENVELOPE *env, const ENVELOPE_SETTINGS *settings,
+                    float rate, unsigned int frames, float *gain,
+                    float *step) {
+    if (env->stage == ENV_IDLE) {
+        *gain = 0.0f;
+        *step = 1.0f;
+        return false;
+    }
+
+    float sustain = std::clamp(settings->sustain, ENV_FLOOR_DB, 0.0f);
+    float start   = env->level;
+    float left    = static_cast<float>(frames);
+
+    while (left > 0.0f && env->stage != ENV_IDLE) {
+        float     target;
+        float     ms;
+        ENV_STAGE next;
+
+        switch (env->stage) {
+            case ENV_ATTACK:
+                target = 0.0f;
+                ms     = settings->attack;
+                next   = ENV_DECAY;
+                break;
+
+            case ENV_DECAY:
+                target = sustain;
+                ms     = settings->decay;
+                next   = ENV_SUSTAIN;
+                break;
+
+            case ENV_SUSTAIN:
+                // A new sustain level is reached at the decay speed
+                if (env->level != sustain) {
+                    env->stage = ENV_DECAY;
+                    continue;
+                }
+                left = 0.0f;
+                continue;
+
+            default:
+                target = ENV_FLOOR_DB;
+                ms     = settings->release;
+                next   = ENV_IDLE;
+                break;
+        }
+
+        // dB per frame, a zero time jumps straight to the target
+        float frames_per_range = ms * rate / 1000.0f;
+        float distance = fabsf(target - env->level);
+        float needed   = frames_per_range > 0.0f
+                         ? distance * frames_per_range / -ENV_FLOOR_DB
+                         : 0.0f;
+
+        if (needed > left) {
+            env->level += copysignf(distance * left / needed,
+                                    target - env->level);
+            left = 0.0f;
+        } else {
+            env->level = target;
+            env->stage = next;
+            left      -= needed;
+        }
+    }
+
+    *gain = db_gain(start);
+    *step = frames ? db_gain((env->level - start) / frames) : 1.0f;
+    return true;
+}
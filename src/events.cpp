@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <time.h>
+
+#include "audio.hpp"
+#include "events.hpp"
+#include "ring.hpp"
+#include "sound.hpp"
+
+#define EVENTS_SUCCESS 0
+
+#define EVENT_QUEUE_SIZE 256
+
+// Events are scheduled EVENT_LATENCY_PERIODS ahead: one period absorbs the
+// callback wakeup jitter
+#define EVENT_LATENCY_PERIODS 1
+
+// The block start times are smoothed, wakeup jitter would otherwise leak into
+// the event stamps
+#define CLOCK_SMOOTHING 8
+
+static SpscRing<EVENT, EVENT_QUEUE_SIZE> queue;
+
+// Serializes producers, so the single-consumer ring sees one producer and the
+// stamps come out in queue order
+static std::mutex producer_mutex;
+static uint64_t   last_posted;
+
+// (frame, time) of the last block start, written by the callback only and
+// read under a seqlock
+static std::atomic<uint32_t> clock_seq;
+static std::atomic<uint64_t> clock_frame;
+static std::atomic<int64_t>  clock_ns;
+
+// Audio thread only
+static uint64_t last_frame;
+static int64_t  smoothed_ns;
+
+static int64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+uint8_t init_events() {
+    EVENT event;
+    while (queue.pop(event)) {}
+
+    last_posted = 0;
+    clock_seq   = 0;
+    clock_frame = 0;
+    clock_ns    = 0;
+    last_frame  = 0;
+    smoothed_ns = 0;
+    return EVENTS_SUCCESS;
+}
+
+void cleanup_events() {
+    EVENT event;
+    while (queue.pop(event)) {}
+}
+
+uint64_t events_now() {
+    uint32_t seq;
+    uint64_t frame;
+    int64_t  ns;
+
+    do {
+        seq   = clock_seq.load(std::memory_order_acquire);
+        frame = clock_frame.load(std::memory_order_relaxed);
+        ns    = clock_ns.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != clock_seq.load(std::memory_order_relaxed));
+
+    // Stream not running yet: due immediately
+    if (!ns) {
+        return 0;
+    }
+
+    int64_t elapsed = monotonic_ns() - ns;
+    if (elapsed < 0) {
+        elapsed = 0;
+    }
+
+    return frame
+           + static_cast<uint64_t>(elapsed) * audio_sample_rate() / 1000000000ULL
+           + EVENT_LATENCY_PERIODS * audio_period();
+}
+
+bool events_post(EVENT_TYPE type, uint8_t index, float value) {
+    std::lock_guard<std::mutex> lock(producer_mutex);
+
+    // The clock can step back a few frames when it corrects, and a stamped
+    // event may already sit later: never post behind either
+    last_posted = std::max(events_now(), last_posted);
+    return queue.push({last_posted, type, index, value});
+}
+
+bool events_post_at(EVENT_TYPE type, uint8_t index, float value,
+                    uint64_t frame) {
+    std::lock_guard<std::mutex> lock(producer_mutex);
+
+    // The callback only looks at the head of the queue, keep it sorted
+    last_posted = std::max(frame, last_posted);
+    return queue.push({last_posted, type, index, value});
+}
+
+void events_clock(uint64_t frame) {
+    int64_t now = monotonic_ns();
+
+    if (!smoothed_ns || frame < last_frame) {
+        smoothed_ns = now;
+    } else {
+        int64_t predicted = smoothed_ns + static_cast<int64_t>(
+                                (frame - last_frame) * 1000000000ULL
+                                / audio_sample_rate());
+        smoothed_ns = predicted + (now - predicted) / CLOCK_SMOOTHING;
+    }
+    last_frame = frame;
+
+    uint32_t seq = clock_seq.load(std::memory_order_relaxed);
+    clock_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    clock_frame.store(frame, std::memory_order_relaxed);
+    clock_ns.store(smoothed_ns, std::memory_order_relaxed);
+    clock_seq.store(seq + 2, std::memory_order_release);
+}
+
+bool events_pop(uint64_t before, EVENT *event) {
+    if (!queue.peek(*event) || event->frame >= before) {
+        return false;
+    }
+    return queue.pop(*event);
+}
+
+uint64_t events_next_due() {
+    EVENT event;
+    if (!queue.peek(event)) {
+        return UINT64_MAX;
+    }
+    return event.frame;
+}
@@ -0,0 +1,144 @@
+#include <cstdint>
+#include <math.h>
+
+#include "fft.hpp"
+
+uint8_t fft_init(FFT *fft, uint32_t size) {
+    *fft = {};
+    if (size < 4 || (size & (size - 1))) {
+        return FFT_SIZEERR;
+    }
+
+    fft->size = size;
+    fft->half = size / 2;
+
+    uint32_t bits = 0;
+    while ((1u << bits) < fft->half) {
+        bits++;
+    }
+    fft->reverse = new uint32_t[fft->half];
+    for (uint32_t i = 0; i < fft->half; i++) {
+        uint32_t r = 0;
+        for (uint32_t b = 0; b < bits; b++) {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        fft->reverse[i] = r;
+    }
+
+    fft->cos = new float[fft->half / 2];
+    fft->sin = new float[fft->half / 2];
+    for (uint32_t k = 0; k < fft->half / 2; k++) {
+        double angle = -2.0 * M_PI * k / fft->half;
+        fft->cos[k] = static_cast<float>(cos(angle));
+        fft->sin[k] = static_cast<float>(sin(angle));
+    }
+
+    fft->split_cos = new float[fft->half + 1];
+    fft->split_sin = new float[fft->half + 1];
+    for (uint32_t k = 0; k <= fft->half; k++) {
+        double angle = -2.0 * M_PI * k / size;
+        fft->split_cos[k] = static_cast<float>(cos(angle));
+        fft->split_sin[k] = static_cast<float>(sin(angle));
+    }
+
+    fft->work_re = new float[fft->half];
+    fft->work_im = new float[fft->half];
+    return FFT_SUCCESS;
+}
+
+void fft_cleanup(FFT *fft) {
+    delete[] fft->reverse;
+    delete[] fft->cos;
+    delete[] fft->sin;
+    delete[] fft->split_cos;
+    delete[] fft->split_sin;
+    delete[] fft->work_re;
+    delete[] fft->work_im;
+    *fft = {};
+}
+
+// In place radix 2 on the bit reversed working buffer, sign picks inverse
+static void transform(FFT *fft, float sign) {
+    float   *re = fft->work_re;
+    float   *im = fft->work_im;
+    uint32_t n  = fft->half;
+
+    for (uint32_t len = 2; len <= n; len <<= 1) {
+        uint32_t step = n / len;
+        for (uint32_t start = 0; start < n; start += len) {
+            for (uint32_t k = 0; k < len / 2; k++) {
+                float wr = fft->cos[k * step];
+                float wi = sign * fft->sin[k * step];
+                uint32_t a = start + k;
+                uint32_t b = a + len / 2;
+
+                float tr = re[b] * wr - im[b] * wi;
+                float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+/*
+ * Even samples go in the real part and odd ones in the imaginary part, the
+ * two half size spectra are then pulled apart and joined:
+ * X[k] = E[k] + W^k O[k].
+ */
+void fft_forward(FFT *fft, const float *in, float *re, float *im) {
+    uint32_t n = fft->half;
+    for (uint32_t i = 0; i < n; i++) {
+        fft->work_re[fft->reverse[i]] = in[2 * i];
+        fft->work_im[fft->reverse[i]] = in[2 * i + 1];
+    }
+    transform(fft, 1.0f);
+
+    const float *zr = fft->work_re;
+    const float *zi = fft->work_im;
+    for (uint32_t k = 0; k <= n; k++) {
+        uint32_t a = k == n ? 0 : k;
+        uint32_t b = k == 0 ? 0 : n - k;
+
+        float er = 0.5f * (zr[a] + zr[b]);
+        float ei = 0.5f * (zi[a] - zi[b]);
+        float or_ = 0.5f * (zi[a] + zi[b]);
+        float oi = -0.5f * (zr[a] - zr[b]);
+
+        float wr = fft->split_cos[k];
+        float wi = fft->split_sin[k];
+        re[k] = er + wr * or_ - wi * oi;
+        im[k] = ei + wr * oi + wi * or_;
+    }
+}
+
+// The split run backwards: E[k] and O[k] from X[k] and X[n - k]
+void fft_inverse(FFT *fft, const float *re, const float *im, float *out) {
+    uint32_t n = fft->half;
+    for (uint32_t k = 0; k < n; k++) {
+        float er = 0.5f * (re[k] + re[n - k]);
+        float ei = 0.5f * (im[k] - im[n - k]);
+        float dr = 0.5f * (re[k] - re[n - k]);
+        float di = 0.5f * (im[k] + im[n - k]);
+
+        // O[k] = (X[k] - conj(X[n - k])) conj(W^k) / 2
+        float wr  = fft->split_cos[k];
+        float wi  = -fft->split_sin[k];
+        float or_ = dr * wr - di * wi;
+        float oi  = dr * wi + di * wr;
+
+        // Z[k] = E[k] + i O[k]
+        uint32_t r = fft->reverse[k];
+        fft->work_re[r] = er - oi;
+        fft->work_im[r] = ei + or_;
+    }
+    transform(fft, -1.0f);
+
+    float scale = 1.0f / n;
+    for (uint32_t i = 0; i < n; i++) {
+        out[2 * i]     = fft->work_re[i] * scale;
+        out[2 * i + 1] = fft->work_im[i] * scale;
+    }
+}
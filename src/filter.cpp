@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <cstdint>
+#include <math.h>
+
+#include "filter.hpp"
+
+// Above this the tangent blows up, well past anything audible at 44.1 kHz
+#define FILTER_MAX_CUTOFF 0.49f
+
+// Damping left at full resonance, keeps the filter just short of oscillating
+#define FILTER_MIN_DAMPING 0.05f
+
+float filter_cutoff_hz(float control) {
+    return FILTER_MIN_HZ * powf(FILTER_MAX_HZ / FILTER_MIN_HZ,
+                                std::clamp(control, 0.0f, 1.0f));
+}
+
+void filter_reset(FILTER_BANK *bank, uint8_t voice) {
+    uint8_t group = voice / FILTER_LANES;
+    uint8_t lane  = voice % FILTER_LANES;
+    bank->ic1[group][lane] = 0.0f;
+    bank->ic2[group][lane] = 0.0f;
+}
+
+void filter_tune(FILTER_BANK *bank, uint8_t voice, FILTER_MODE mode,
+                 float cutoff, float resonance) {
+    uint8_t group = voice / FILTER_LANES;
+    uint8_t lane  = voice % FILTER_LANES;
+
+    float g = tanf((float)M_PI * std::clamp(cutoff, 0.0f, FILTER_MAX_CUTOFF));
+    float k = 2.0f - (2.0f - FILTER_MIN_DAMPING)
+                     * std::clamp(resonance, 0.0f, 1.0f);
+    float a1 = 1.0f / (1.0f + g * (g + k));
+
+    bank->a1[group][lane] = a1;
+    bank->a2[group][lane] = g * a1;
+    bank->a3[group][lane] = g * g * a1;
+
+    float m0 = 0.0f, m1 = 0.0f, m2 = 1.0f;
+    if (mode == FILTER_BAND) {
+        m1 = 1.0f;
+        m2 = 0.0f;
+    } else if (mode == FILTER_HIGH) {
+        m0 = 1.0f;
+        m1 = -k;
+        m2 = -1.0f;
+    }
+    bank->m0[group][lane] = m0;
+    bank->m1[group][lane] = m1;
+    bank->m2[group][lane] = m2;
+}
+
+void filter_run(FILTER_BANK *bank, uint8_t group, v4f *lanes,
+                unsigned int frames) {
+    v4f ic1 = bank->ic1[group];
+    v4f ic2 = bank->ic2[group];
+    v4f a1  = bank->a1[group];
+    v4f a2  = bank->a2[group];
+    v4f a3  = bank->a3[group];
+    v4f m0  = bank->m0[group];
+    v4f m1  = bank->m1[group];
+    v4f m2  = bank->m2[group];
+
+    for (unsigned int i = 0; i < frames; i++) {
+        v4f v0 = lanes[i];
+        v4f v3 = v0 - ic2;
+        v4f v1 = a1 * ic1 + a2 * v3;  // Band
+        v4f v2 = ic2 + a2 * ic1 + a3 * v3;  // Low
+        ic1 = 2.0f * v1 - ic1;
+        ic2 = 2.0f * v2 - ic2;
+        lanes[i] = m0 * v0 + m1 * v1 + m2 * v2;
+    }
+
+    bank->ic1[group] = ic1;
+    bank->ic2[group] = ic2;
+}
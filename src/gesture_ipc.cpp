@@ -0,0 +1,176 @@
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gesture_ipc.hpp"
+
+#define GESTURE_IPC_SUCCESS 0
+#define GESTURE_IPC_OPENERR 1
+#define GESTURE_IPC_MAPERR  2
+
+static GESTURE_SHM *shm = nullptr;
+
+// Last sequence number handed to the app
+static uint32_t last_seq;
+
+static long futex(std::atomic<uint32_t> *word, int op, uint32_t value,
+                  const struct timespec *timeout) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), op, value,
+                   timeout, nullptr, 0);
+}
+
+// Maps the channel, false when what is there has another size or layout
+static bool map_channel(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == -1
+        || (st.st_size && st.st_size != GESTURE_SHM_SIZE)) {
+        return false;
+    }
+
+    // The mode was filtered by the umask: open it up for the detector, which
+    // runs as another user than the app. Fails harmlessly when not the owner.
+    fchmod(fd, 0666);
+
+    // Growing a fresh object zero-fills it; an existing one keeps its data
+    if (ftruncate(fd, GESTURE_SHM_SIZE) == -1) {
+        return false;
+    }
+
+    void *mem = mmap(nullptr, GESTURE_SHM_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+        return false;
+    }
+    shm = static_cast<GESTURE_SHM *>(mem);
+
+    uint32_t magic = 0;
+    if (shm->magic.compare_exchange_strong(magic, GESTURE_SHM_MAGIC)) {
+        shm->version.store(GESTURE_SHM_VERSION);
+    } else if (magic != GESTURE_SHM_MAGIC
+               || shm->version.load() != GESTURE_SHM_VERSION) {
+        gesture_ipc_close();
+        return false;
+    }
+    return true;
+}
+
+uint8_t gesture_ipc_open() {
+    int fd = shm_open(GESTURE_SHM_NAME, O_RDWR | O_CREAT, 0666);
+    if (fd == -1) {
+        std::cerr << "Failed to open gesture channel " << GESTURE_SHM_NAME
+                  << std::endl;
+        return GESTURE_IPC_OPENERR;
+    }
+
+    /*
+     * A channel left by an older build (in /dev/shm until reboot) is removed
+     * and made again; whoever was using it is gone, as it couldn't have
+     * mapped this layout either.
+     */
+    bool mapped = map_channel(fd);
+    if (!mapped) {
+        std::cout << "  * replacing stale gesture channel ...\n";
+        close(fd);
+        shm_unlink(GESTURE_SHM_NAME);
+        fd = shm_open(GESTURE_SHM_NAME, O_RDWR | O_CREAT, 0666);
+        if (fd == -1) {
+            std::cerr << "Failed to open gesture channel " << GESTURE_SHM_NAME
+                      << std::endl;
+            return GESTURE_IPC_OPENERR;
+        }
+        mapped = map_channel(fd);
+    }
+    close(fd);
+    if (!mapped) {
+        std::cerr << "Failed to map gesture channel" << std::endl;
+        return GESTURE_IPC_MAPERR;
+    }
+
+    // Whatever is already there counts as new on the first poll
+    last_seq = 0;
+
+    return GESTURE_IPC_SUCCESS;
+}
+
+void gesture_ipc_close() {
+    if (shm) {
+        munmap(shm, GESTURE_SHM_SIZE);
+        shm = nullptr;
+    }
+}
+
+bool gesture_ipc_poll(GESTURE_STATE *state) {
+    if (!shm) {
+        return false;
+    }
+
+    uint32_t seq = shm->seq.load(std::memory_order_acquire);
+    if (seq == last_seq || (seq & 1)) {
+        return false;
+    }
+
+    GESTURE_STATE snapshot;
+    snapshot.gesture  = static_cast<GESTURE_CODE>(
+                            shm->gesture.load(std::memory_order_relaxed));
+    snapshot.fingers  = shm->fingers.load(std::memory_order_relaxed);
+    snapshot.stamp_ns = shm->stamp_ns.load(std::memory_order_relaxed);
+    snapshot.cx       = shm->cx.load(std::memory_order_relaxed);
+    snapshot.cy       = shm->cy.load(std::memory_order_relaxed);
+    snapshot.area     = shm->area.load(std::memory_order_relaxed);
+
+    // A writer got in while copying: leave it for the next poll
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (shm->seq.load(std::memory_order_relaxed) != seq) {
+        return false;
+    }
+
+    last_seq = seq;
+    *state = snapshot;
+    return true;
+}
+
+void gesture_ipc_wait(int timeout_ms) {
+    if (!shm) {
+        return;
+    }
+
+    struct timespec timeout = {timeout_ms / 1000,
+                               (timeout_ms % 1000) * 1000000L};
+
+    shm->waiters.fetch_add(1);
+    // Sleeps only if seq still holds what was last consumed
+    futex(&shm->seq, FUTEX_WAIT, last_seq, &timeout);
+    shm->waiters.fetch_sub(1);
+}
+
+void gesture_ipc_publish(const GESTURE_STATE& state) {
+    if (!shm) {
+        return;
+    }
+
+    uint32_t seq = shm->seq.load(std::memory_order_relaxed);
+    shm->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    shm->gesture.store(state.gesture, std::memory_order_relaxed);
+    shm->fingers.store(state.fingers, std::memory_order_relaxed);
+    shm->stamp_ns.store(state.stamp_ns, std::memory_order_relaxed);
+    shm->cx.store(state.cx, std::memory_order_relaxed);
+    shm->cy.store(state.cy, std::memory_order_relaxed);
+    shm->area.store(state.area, std::memory_order_relaxed);
+
+    // seq_cst so the waiters check cannot move ahead of the seq store
+    shm->seq.store(seq + 2, std::memory_order_seq_cst);
+
+    if (shm->waiters.load() != 0) {
+        futex(&shm->seq, FUTEX_WAKE, INT_MAX, nullptr);
+    }
+}
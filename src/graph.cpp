@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "graph.hpp"
+
+void graph_reset(GRAPH *graph) {
+    graph->node_cnt = 0;
+    graph->edge_cnt = 0;
+    graph->output   = GRAPH_NONE;
+    std::fill(graph->silence, graph->silence + MAX_PERIOD, 0.0f);
+}
+
+uint8_t graph_add(GRAPH *graph, const char *name, GRAPH_PROCESS process,
+                  void *ctx, uint8_t inputs, uint8_t outputs) {
+    if (graph->node_cnt == GRAPH_MAX_NODES || inputs > GRAPH_MAX_PORTS
+        || outputs > GRAPH_MAX_PORTS) {
+        return GRAPH_NONE;
+    }
+
+    graph->node[graph->node_cnt] = {name, process, ctx, inputs, outputs};
+    return graph->node_cnt++;
+}
+
+void graph_disconnect(GRAPH *graph, uint8_t to, uint8_t to_port) {
+    for (uint8_t e = 0; e < graph->edge_cnt; e++) {
+        if (graph->edge[e].to == to && graph->edge[e].to_port == to_port) {
+            graph->edge[e] = graph->edge[--graph->edge_cnt];
+            return;
+        }
+    }
+}
+
+bool graph_connect(GRAPH *graph, uint8_t from, uint8_t from_port, uint8_t to,
+                   uint8_t to_port) {
+    if (from >= graph->node_cnt || to >= graph->node_cnt
+        || from_port >= graph->node[from].outputs
+        || to_port >= graph->node[to].inputs) {
+        return false;
+    }
+
+    graph_disconnect(graph, to, to_port);
+    graph->edge[graph->edge_cnt++] = {from, from_port, to, to_port};
+    return true;
+}
+
+// Marks every node the output depends on
+static void mark_needed(const GRAPH *graph, uint8_t node, bool *needed) {
+    if (needed[node]) {
+        return;
+    }
+    needed[node] = true;
+
+    for (uint8_t e = 0; e < graph->edge_cnt; e++) {
+        if (graph->edge[e].to == node) {
+            mark_needed(graph, graph->edge[e].from, needed);
+        }
+    }
+}
+
+/*
+ * Kahn's algorithm, level by level: a node lands one level after the latest
+ * of its inputs. Leaves level GRAPH_NONE on anything caught in a loop.
+ */
+static uint8_t assign_levels(const GRAPH *graph, const bool *needed,
+                             uint8_t *level) {
+    uint8_t pending[GRAPH_MAX_NODES] = {};
+    for (uint8_t e = 0; e < graph->edge_cnt; e++) {
+        if (needed[graph->edge[e].to]) {
+            pending[graph->edge[e].to]++;
+        }
+    }
+
+    uint8_t queue[GRAPH_MAX_NODES];
+    uint8_t head = 0, tail = 0;
+    for (uint8_t n = 0; n < graph->node_cnt; n++) {
+        level[n] = GRAPH_NONE;
+        if (needed[n] && !pending[n]) {
+            level[n]      = 0;
+            queue[tail++] = n;
+        }
+    }
+
+    while (head < tail) {
+        uint8_t node = queue[head++];
+        for (uint8_t e = 0; e < graph->edge_cnt; e++) {
+            const GRAPH_EDGE *edge = &graph->edge[e];
+            if (edge->from != node || !needed[edge->to]) {
+                continue;
+            }
+
+            uint8_t next = level[node] + 1;
+            if (level[edge->to] == GRAPH_NONE || level[edge->to] < next) {
+                level[edge->to] = next;
+            }
+            if (!--pending[edge->to]) {
+                queue[tail++] = edge->to;
+            }
+        }
+    }
+
+    // Every needed node has to have come off the queue
+    uint8_t count = 0;
+    for (uint8_t n = 0; n < graph->node_cnt; n++) {
+        count += needed[n];
+    }
+    return tail == count ? GRAPH_SUCCESS : GRAPH_CYCLE;
+}
+
+uint8_t graph_plan(GRAPH *graph, GRAPH_PLAN *plan) {
+    plan->count   = 0;
+    plan->levels  = 0;
+    plan->buffers = 0;
+    if (graph->output >= graph->node_cnt) {
+        return GRAPH_SUCCESS;
+    }
+
+    bool needed[GRAPH_MAX_NODES] = {};
+    mark_needed(graph, graph->output, needed);
+
+    uint8_t level[GRAPH_MAX_NODES];
+    if (assign_levels(graph, needed, level) != GRAPH_SUCCESS) {
+        return GRAPH_CYCLE;
+    }
+
+    // Level each output is last read in, its own level if nothing reads it
+    uint8_t last_read[GRAPH_MAX_NODES][GRAPH_MAX_PORTS];
+    for (uint8_t n = 0; n < graph->node_cnt; n++) {
+        std::fill(last_read[n], last_read[n] + GRAPH_MAX_PORTS, level[n]);
+    }
+    for (uint8_t e = 0; e < graph->edge_cnt; e++) {
+        const GRAPH_EDGE *edge = &graph->edge[e];
+        if (needed[edge->to]) {
+            uint8_t *last = &last_read[edge->from][edge->from_port];
+            *last = std::max(*last, level[edge->to]);
+        }
+    }
+    std::fill(last_read[graph->output], last_read[graph->output] + 2,
+              GRAPH_NONE);
+
+    uint8_t free_list[GRAPH_MAX_BUFFERS];
+    uint8_t free_cnt = GRAPH_MAX_BUFFERS;
+    for (uint8_t b = 0; b < GRAPH_MAX_BUFFERS; b++) {
+        free_list[b] = GRAPH_MAX_BUFFERS - 1 - b;
+    }
+
+    uint8_t held[GRAPH_MAX_NODES][GRAPH_MAX_PORTS];
+    uint8_t step_of[GRAPH_MAX_NODES];
+    for (uint8_t l = 0; plan->count < GRAPH_MAX_NODES; l++) {
+        uint8_t first = plan->count;
+        for (uint8_t n = 0; n < graph->node_cnt; n++) {
+            if (level[n] != l) {
+                continue;
+            }
+
+            const GRAPH_NODE *node = &graph->node[n];
+            GRAPH_STEP       *step = &plan->step[plan->count];
+            step_of[n]    = plan->count++;
+            step->process = node->process;
+            step->ctx     = node->ctx;
+            step->node    = n;
+            step->level   = l;
+            std::fill(step->in, step->in + GRAPH_MAX_PORTS, graph->silence);
+            std::fill(step->out, step->out + GRAPH_MAX_PORTS, nullptr);
+
+            // Most recently freed first, still in cache
+            for (uint8_t p = 0; p < node->outputs; p++) {
+                if (!free_cnt) {
+                    return GRAPH_NOBUFS;
+                }
+                held[n][p]   = free_list[--free_cnt];
+                step->out[p] = graph->buffers[held[n][p]];
+            }
+            plan->buffers = std::max<uint8_t>(plan->buffers,
+                                              GRAPH_MAX_BUFFERS - free_cnt);
+        }
+
+        if (plan->count == first) {
+            break;
+        }
+        plan->level_start[plan->levels++] = first;
+
+        // Only free after the whole level has its buffers, steps of one
+        // level may run at the same time
+        for (uint8_t s = 0; s < plan->count; s++) {
+            uint8_t n = plan->step[s].node;
+            for (uint8_t p = 0; p < graph->node[n].outputs; p++) {
+                if (last_read[n][p] == l) {
+                    free_list[free_cnt++] = held[n][p];
+                }
+            }
+        }
+    }
+    plan->level_start[plan->levels] = plan->count;
+
+    for (uint8_t e = 0; e < graph->edge_cnt; e++) {
+        const GRAPH_EDGE *edge = &graph->edge[e];
+        if (needed[edge->to]) {
+            plan->step[step_of[edge->to]].in[edge->to_port] =
+                plan->step[step_of[edge->from]].out[edge->from_port];
+        }
+    }
+
+    const GRAPH_STEP *out = &plan->step[step_of[graph->output]];
+    plan->output[0] = graph->node[graph->output].outputs > 0
+                      ? out->out[0] : graph->silence;
+    plan->output[1] = graph->node[graph->output].outputs > 1
+                      ? out->out[1] : plan->output[0];
+    return GRAPH_SUCCESS;
+}
+
+void graph_run(const GRAPH_PLAN *plan, float *out, unsigned int frames) {
+    for (uint8_t s = 0; s < plan->count; s++) {
+        const GRAPH_STEP *step = &plan->step[s];
+        step->process(step->ctx, step->in, step->out, frames);
+    }
+
+    if (!plan->count) {
+        std::fill(out, out + 2 * frames, 0.0f);
+        return;
+    }
+
+    const float *left  = plan->output[0];
+    const float *right = plan->output[1];
+    for (unsigned int i = 0; i < frames; i++) {
+        *out++ = left[i];
+        *out++ = right[i];
+    }
+}
@@ -1,10 +1,14 @@
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <wiringPi.h>
 #include <wiringPiI2C.h>
 
+#include "config.hpp"
 #include "keys.hpp"
 #include "led.hpp"
+#include "midi.hpp"
+#include "sequencer.hpp"
 #include "sound.hpp"
 #include "theory.hpp"
 
@@ -13,7 +17,6 @@
 #define KEY_WIP_INI 1
 
 // Register map
-#define MCP23017_ADDR   0x20
 #define IODIRA          0x00
     #define IODIRA0_7       0xFF
 #define IODIRB          0x01
@@ -25,21 +28,8 @@
 #define GPIOA           0x12
 #define GPIOB           0x13
 
-key keys[] = {
-    // Need updates
-    {"Do" , 0b1}, // C     - Do
-    {"Do#", 0b1}, // C#/Db - Do sos. / Re bemol
-    {"Re" , 0b1}, // D     - Re
-    {"Re#", 0b1}, // D#/Eb - Do sos. / Mi bemol
-    {"Mi" , 0b1}, // E     - Mi
-    {"Fa" , 0b1}, // F     - Fa
-    {"Fa#", 0b1}, // F#/Gb - Fa sos. / Sol bemol
-    {"Sol" , 0b1}, // G     - Sol
-    {"Sol#", 0b1}, // G#/Ab - Sol sos. / La bemol
-    {"La" , 0b1}, // A     - La
-    {"La#", 0b1}, // A#/Bb - La sos. / Si bemol
-    {"Si" , 0b1}  // B     - Si
-};
+// Names come from the config, all keys start released (pulled up)
+key keys[MAX_KEYS];
 
 static int fd;
 
@@ -60,8 +50,13 @@ static uint8_t get_bit(uint16_t data, uint8_t bit) {
 uint8_t init_keys() {
     std::cout << "- Keys initialization ...\n";
 
+    for (size_t i = 0; i < MAX_KEYS; i++) {
+        strncpy(keys[i].name, config()->key_names[i], sizeof(keys[i].name));
+        keys[i].state = 0b1;
+    }
+
     std::cout << "  * initializing WiringPi module ...\n";
-    fd = wiringPiI2CSetup(MCP23017_ADDR);
+    fd = wiringPiI2CSetup(config()->keys_address);
     if (fd < 0) {
         std::cout << " Failed with code : \n" << KEY_WIP_INI;
         return KEY_WIP_INI;
@@ -91,7 +86,11 @@ void loop_keys() {
             std::cout << "Key " << keys[i].name << " changed to "
                       << static_cast<int>(curr_state) <<"!\n";
             
-            trigger_gate(i);
+            uint8_t note = trigger_gate(i);
+            midi_send_note(note, !curr_state);
+            if (!curr_state) {
+                seq_record(SEQ_KEY_TRACK(i), 1.0f);
+            }
 
             set_led(i, !curr_state);
         }
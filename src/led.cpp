@@ -1,8 +1,13 @@
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 #include "ws2811.h"
 
+#include "config.hpp"
 #include "keys.hpp"
 
 #include "led.hpp"
@@ -10,16 +15,13 @@
 #define E_LED_SUCC 0
 #define E_LED_FAIL 1
 
-#define LED_BRIGHTNESS 3
-#define LED_COLOR      0xF4430D
-    #define LED_COLOR_BLK   0x000000
-    #define LED_COLOR_SCALE 0x4c1403
-    #define LED_COLOR_SUG1  0x00FF00
-    #define LED_COLOR_SUG2  0x0000FF
-#define LED_COUNT      18
-    #define LED_DISP_CNT    6
+#define LED_COLOR_BLK  0x000000
+#define LED_DISP_CNT   6
 #define LED_PIN        18
 
+// The strip is rendered at most this many times per second
+#define LED_FRAME_RATE 60
+
 static ws2811_t ledstring =
 {
     .freq = WS2811_TARGET_FREQ,
@@ -32,7 +34,7 @@ static ws2811_t ledstring =
             .invert = 0,
             .count = LED_COUNT,
             .strip_type = WS2811_STRIP_GRB,
-            .brightness = LED_BRIGHTNESS,
+            .brightness = 0,  // From the config, on init
         },
         [1] =
         {
@@ -44,89 +46,180 @@ static ws2811_t ledstring =
     },
 };
 
-// Array with LED indexes
-// The index represents the Key index
-// The content reporesents the LED index
-static uint8_t key_leds[] = {
-    17,
-    6 ,
-    16,
-    7 ,
-    15,
-    14,
-    8 ,
-    13,
-    9 ,
-    12,
-    10,
-    11
-};
+typedef struct layer {
+    ws2811_led_t color[LED_COUNT];
+    uint32_t     lit;  // Bit per LED, set when the layer covers it
+} LAYER;
+
+static LAYER layers[LED_LAYER_CNT];
+
+static std::mutex        layer_mutex;
+static std::atomic<bool> dirty;
+static std::atomic<bool> render_running;
+static std::thread       render_thread;
+
+// Both return whether the layer actually changed
+static bool layer_set(LED_LAYER layer, uint8_t led, ws2811_led_t color) {
+    bool changed = !(layers[layer].lit & (1u << led))
+                   || layers[layer].color[led] != color;
+    layers[layer].color[led] = color;
+    layers[layer].lit |= (1u << led);
+    return changed;
+}
 
-static uint8_t last_sug1, last_sug2;
+static bool layer_clear(LED_LAYER layer, uint8_t led) {
+    bool changed = layers[layer].lit & (1u << led);
+    layers[layer].lit &= ~(1u << led);
+    return changed;
+}
 
-static uint8_t scale[] = {1, 4, 6, 7, 11};
+// Top-most lit layer wins for every LED; the base layer covers the whole strip
+static void composite() {
+    std::lock_guard<std::mutex> lock(layer_mutex);
+    for (uint8_t led = 0; led < LED_COUNT; led++) {
+        int l = LED_LAYER_CNT - 1;
+        while (l > LED_LAYER_BASE && !(layers[l].lit & (1u << led))) {
+            l--;
+        }
+        ledstring.channel[0].leds[led] = layers[l].color[led];
+    }
+}
 
-static void light_off_led(uint8_t index) {
-    for (const auto& scale_key : scale) {
-        if (scale_key == index) {
-            uint8_t led_i = key_leds[scale_key];
-            ledstring.channel[0].leds[led_i] = LED_COLOR_SCALE;
-            return;
+static void render_loop() {
+    auto period = std::chrono::microseconds(1000000 / LED_FRAME_RATE);
+    auto next   = std::chrono::steady_clock::now();
+
+    while (render_running) {
+        next += period;
+        std::this_thread::sleep_until(next);
+
+        // Any number of changes within a frame cost a single DMA transfer
+        if (dirty.exchange(false)) {
+            composite();
+            ws2811_render(&ledstring);
         }
     }
+}
 
-    uint8_t led_i = key_leds[index];
-    ledstring.channel[0].leds[led_i] = LED_COLOR_BLK;
+// Display backlight and scale keys
+static void paint_base(const DAW_CONFIG *cfg) {
+    for (int i = 0; i < LED_DISP_CNT; ++i) {
+        layer_set(LED_LAYER_BASE, i, cfg->color_pressed);
+    }
+    for (int i = LED_DISP_CNT; i < LED_COUNT; ++i) {
+        layer_set(LED_LAYER_BASE, i, LED_COLOR_BLK);
+    }
+    for (uint8_t key = 0; key < MAX_KEYS; key++) {
+        if (cfg->scale & (1 << key)) {
+            layer_set(LED_LAYER_BASE, cfg->key_leds[key], cfg->color_scale);
+        }
+    }
 }
 
 uint8_t init_led() {
+    ledstring.channel[0].brightness = config()->led_brightness;
     if (ws2811_init(&ledstring) != WS2811_SUCCESS) {
         std::cout << "ws2811_init failed" << std::endl;
         return E_LED_FAIL;
     }
 
-    for (int i = 0; i < LED_DISP_CNT; ++i) {
-        ledstring.channel[0].leds[i] = LED_COLOR;
-    }
-    for (int i = LED_DISP_CNT; i < LED_COUNT; ++i) {
-        ledstring.channel[0].leds[i] = LED_COLOR_BLK;
-    }
-    for (const auto& scale_key : scale) {
-        ledstring.channel[0].leds[key_leds[scale_key]] = LED_COLOR_SCALE;
-    }
+    paint_base(config());
+    composite();
     ws2811_render(&ledstring);
 
+    dirty = false;
+    render_running = true;
+    render_thread = std::thread(render_loop);
+
     return E_LED_SUCC;
 }
 
 void cleanup_led() {
+    if (!render_running.exchange(false)) {
+        return;
+    }
+    render_thread.join();
+
     ws2811_fini(&ledstring);
 }
 
 void set_led(uint8_t index, bool state) {
-    if (!state) {
-        light_off_led(index);
-    } else {
-        uint8_t led_i = key_leds[index];
-        ledstring.channel[0].leds[led_i] = LED_COLOR;
+    if (index >= MAX_KEYS) {
+        return;
     }
 
-    ws2811_render(&ledstring);
+    const DAW_CONFIG *cfg = config();
+
+    std::lock_guard<std::mutex> lock(layer_mutex);
+    if (state) {
+        layer_set(LED_LAYER_PRESSED, cfg->key_leds[index], cfg->color_pressed);
+    } else {
+        layer_clear(LED_LAYER_PRESSED, cfg->key_leds[index]);
+    }
+    dirty = true;
 }
 
 void light_suggestions(uint8_t idx_1, uint8_t idx_2) {
-    uint8_t led_1 = key_leds[idx_1];
-    uint8_t led_2 = key_leds[idx_2];
+    if (idx_1 >= MAX_KEYS || idx_2 >= MAX_KEYS) {
+        return;
+    }
 
-    ledstring.channel[0].leds[led_1] = LED_COLOR_SUG1;
-    ledstring.channel[0].leds[led_2] = LED_COLOR_SUG2;
-    ws2811_render(&ledstring);
+    const DAW_CONFIG *cfg = config();
 
-    last_sug1 = idx_1;
-    last_sug2 = idx_2;
+    std::lock_guard<std::mutex> lock(layer_mutex);
+    layers[LED_LAYER_SUGGEST].lit = 0;
+    layer_set(LED_LAYER_SUGGEST, cfg->key_leds[idx_1], cfg->color_suggest[0]);
+    layer_set(LED_LAYER_SUGGEST, cfg->key_leds[idx_2], cfg->color_suggest[1]);
+    dirty = true;
 }
 
 void turn_off_suggestions() {
-    set_led(last_sug1, false);
-    set_led(last_sug2, false);
+    clear_led_layer(LED_LAYER_SUGGEST);
+}
+
+void refresh_led() {
+    if (!render_running) {
+        return;
+    }
+
+    // Key LEDs may have moved: held keys and suggestions come back on their
+    // next change
+    std::lock_guard<std::mutex> lock(layer_mutex);
+    paint_base(config());
+    layers[LED_LAYER_PRESSED].lit = 0;
+    layers[LED_LAYER_SUGGEST].lit = 0;
+    dirty = true;
+}
+
+void set_led_layer(LED_LAYER layer, uint8_t led, uint32_t color) {
+    if (layer >= LED_LAYER_CNT || led >= LED_COUNT) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(layer_mutex);
+    if (layer_set(layer, led, color)) {
+        dirty = true;
+    }
+}
+
+void clear_led_layer_pixel(LED_LAYER layer, uint8_t led) {
+    // The base layer is never transparent
+    if (layer == LED_LAYER_BASE || layer >= LED_LAYER_CNT || led >= LED_COUNT) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(layer_mutex);
+    if (layer_clear(layer, led)) {
+        dirty = true;
+    }
+}
+
+void clear_led_layer(LED_LAYER layer) {
+    if (layer == LED_LAYER_BASE || layer >= LED_LAYER_CNT) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(layer_mutex);
+    layers[layer].lit = 0;
+    dirty = true;
 }
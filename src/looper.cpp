@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/mman.h>
+
+#include "audio.hpp"
+#include "events.hpp"
+#include "looper.hpp"
+
+#define LOOPER_SUCCESS 0
+#define LOOPER_INITERR 1
+
+#define LOOPER_CHANNELS 2
+
+// Mixing runs in chunks of this many samples so unused layers can point at
+// a silent chunk and the mix stays one fixed-width loop
+#define LOOPER_CHUNK 128
+
+static_assert(LOOPER_LAYERS == 4, "looper_process mixes exactly 4 layers");
+
+typedef struct layer {
+    float   *data;     // Interleaved stereo, max_frames long
+    uint32_t recorded; // Frames written, a layer is only heard once full
+} LAYER;
+
+static LAYER    layers[LOOPER_LAYERS];
+static size_t   layer_bytes;
+static uint32_t max_frames;
+
+// Audio thread only
+static LOOPER_MODE mode;
+static uint32_t    length;   // Loop length, set by the first take
+static uint32_t    position;
+static uint8_t     count;    // Layers in use, the last one may be incomplete
+
+static std::atomic<uint8_t> published_mode;
+
+static const float silence[LOOPER_CHUNK] = {};
+
+uint8_t init_looper(uint32_t max_seconds) {
+    mode     = LOOPER_IDLE;
+    length   = 0;
+    position = 0;
+    count    = 0;
+    published_mode = LOOPER_IDLE;
+
+    max_frames = max_seconds * audio_sample_rate();
+    if (!max_frames) {
+        std::cout << "  * looper disabled\n";
+        return LOOPER_SUCCESS;
+    }
+
+    std::cout << "  * initializing looper ...\n";
+    layer_bytes = static_cast<size_t>(max_frames) * LOOPER_CHANNELS
+                  * sizeof(float);
+
+    for (size_t l = 0; l < LOOPER_LAYERS; l++) {
+        void *data;
+        if (posix_memalign(&data, 64, layer_bytes)) {
+            std::cerr << "Failed to allocate looper layer" << std::endl;
+            cleanup_looper();
+            return LOOPER_INITERR;
+        }
+
+        // Touch every page now, the audio thread must never fault one in
+        memset(data, 0, layer_bytes);
+        if (mlock(data, layer_bytes)) {
+            std::cerr << "Warning: looper layer not locked in memory "
+                         "(check RLIMIT_MEMLOCK)" << std::endl;
+        }
+        layers[l] = {static_cast<float *>(data), 0};
+    }
+
+    std::cout << " Looper Success!\n";
+    return LOOPER_SUCCESS;
+}
+
+void cleanup_looper() {
+    for (size_t l = 0; l < LOOPER_LAYERS; l++) {
+        if (layers[l].data) {
+            munlock(layers[l].data, layer_bytes);
+            free(layers[l].data);
+            layers[l].data = nullptr;
+        }
+    }
+}
+
+void looper_command(LOOPER_COMMAND command) {
+    events_post(EV_LOOPER, command, 1.0f);
+}
+
+LOOPER_MODE looper_mode() {
+    return static_cast<LOOPER_MODE>(published_mode.load());
+}
+
+static bool top_incomplete() {
+    return count && layers[count - 1].recorded < length;
+}
+
+static void reset() {
+    mode     = LOOPER_IDLE;
+    length   = 0;
+    position = 0;
+    count    = 0;
+}
+
+// Ends the first take, its length becomes the loop length
+static void close_take() {
+    length   = layers[0].recorded;
+    position = 0;
+    if (length) {
+        mode = LOOPER_PLAYING;
+    } else {
+        reset();
+    }
+}
+
+void looper_apply(LOOPER_COMMAND command) {
+    if (!max_frames) {
+        return;
+    }
+
+    switch (command) {
+        case LOOPER_REC:
+            if (mode == LOOPER_IDLE) {
+                count = 1;
+                layers[0].recorded = 0;
+                position = 0;
+                mode = LOOPER_RECORDING;
+            } else if (mode == LOOPER_RECORDING) {
+                close_take();
+            } else if (mode == LOOPER_OVERDUBBING) {
+                // The rest of the pass is filled with silence
+                mode = LOOPER_PLAYING;
+            } else if (!top_incomplete() && count < LOOPER_LAYERS) {
+                layers[count++].recorded = 0;
+                mode = LOOPER_OVERDUBBING;
+            }
+            break;
+
+        case LOOPER_PLAY:
+            if (mode == LOOPER_RECORDING) {
+                close_take();
+            } else if (mode == LOOPER_PLAYING || mode == LOOPER_OVERDUBBING) {
+                if (top_incomplete()) {
+                    count--;
+                }
+                position = 0;
+                mode = LOOPER_STOPPED;
+            } else if (mode == LOOPER_STOPPED) {
+                mode = LOOPER_PLAYING;
+            }
+            break;
+
+        case LOOPER_UNDO:
+            if (mode == LOOPER_RECORDING || count <= 1) {
+                reset();
+            } else {
+                count--;
+                if (mode == LOOPER_OVERDUBBING) {
+                    mode = LOOPER_PLAYING;
+                }
+            }
+            break;
+
+        case LOOPER_CLEAR:
+            reset();
+            break;
+    }
+
+    published_mode.store(mode, std::memory_order_relaxed);
+}
+
+static void record(float *buffer, unsigned int frames) {
+    LAYER   *take = &layers[0];
+    uint32_t n    = std::min<uint32_t>(frames, max_frames - take->recorded);
+
+    memcpy(take->data + static_cast<size_t>(take->recorded) * LOOPER_CHANNELS,
+           buffer, n * LOOPER_CHANNELS * sizeof(float));
+    take->recorded += n;
+
+    if (take->recorded == max_frames) {
+        close_take();
+        published_mode.store(mode, std::memory_order_relaxed);
+    }
+}
+
+/*
+ * Writes the pass of the layer being recorded. A layer is recorded from the
+ * play head for exactly one loop length, so it only becomes audible once the
+ * head comes back to where it started and it is full: nothing stale from an
+ * undone layer is ever played and layers never need clearing.
+ */
+static void dub(LAYER *top, float *__restrict out, size_t samples) {
+    float *__restrict data = top->data
+                             + static_cast<size_t>(position) * LOOPER_CHANNELS;
+    bool full = top->recorded == length;
+    bool live = mode == LOOPER_OVERDUBBING;
+
+    if (full) {
+        for (size_t i = 0; i < samples; i++) {
+            float old = data[i];
+            data[i]   = old + out[i];
+            out[i]   += old;
+        }
+    } else if (live) {
+        memcpy(data, out, samples * sizeof(float));
+    } else {
+        memset(data, 0, samples * sizeof(float));
+    }
+}
+
+static void mix(const bool *audible, float *__restrict out, size_t samples) {
+    size_t offset = static_cast<size_t>(position) * LOOPER_CHANNELS;
+
+    for (size_t done = 0; done < samples; done += LOOPER_CHUNK) {
+        size_t n = std::min<size_t>(LOOPER_CHUNK, samples - done);
+        const float *src[LOOPER_LAYERS];
+        for (size_t l = 0; l < LOOPER_LAYERS; l++) {
+            src[l] = audible[l] ? layers[l].data + offset + done : silence;
+        }
+
+        const float *__restrict a = src[0];
+        const float *__restrict b = src[1];
+        const float *__restrict c = src[2];
+        const float *__restrict d = src[3];
+        float       *__restrict o = out + done;
+        for (size_t i = 0; i < n; i++) {
+            o[i] += (a[i] + b[i]) + (c[i] + d[i]);
+        }
+    }
+}
+
+void looper_process(float *buffer, unsigned int frames) {
+    if (mode == LOOPER_RECORDING) {
+        record(buffer, frames);
+        return;
+    }
+
+    if (mode != LOOPER_PLAYING && mode != LOOPER_OVERDUBBING) {
+        return;
+    }
+
+    while (frames) {
+        uint32_t span    = std::min<uint32_t>(frames, length - position);
+        size_t   samples = static_cast<size_t>(span) * LOOPER_CHANNELS;
+
+        LAYER *top    = &layers[count - 1];
+        bool   dubbed = top_incomplete() || mode == LOOPER_OVERDUBBING;
+
+        bool audible[LOOPER_LAYERS] = {};
+        for (uint8_t l = 0; l < count; l++) {
+            audible[l] = layers[l].recorded == length;
+        }
+
+        // The dubbed layer is mixed by dub(), before the new input lands in it
+        if (dubbed) {
+            dub(top, buffer, samples);
+            audible[count - 1] = false;
+            if (top->recorded < length) {
+                top->recorded += span;
+            }
+        }
+
+        mix(audible, buffer, samples);
+
+        buffer   += samples;
+        frames   -= span;
+        position += span;
+        if (position == length) {
+            position = 0;
+        }
+    }
+}
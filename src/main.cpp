@@ -5,9 +5,13 @@
 #include "accel.hpp"
 #include "analog.hpp"
 #include "cam.hpp"
+#include "config.hpp"
+#include "detect.hpp"
 #include "disp.hpp"
 #include "keys.hpp"
 #include "led.hpp"
+#include "meter.hpp"
+#include "midi.hpp"
 #include "signal.hpp"
 #include "sound.hpp"
 #include "touch.hpp"
@@ -16,14 +20,18 @@
 int main() {
     std::cout << "<<< DAW-DEV App >>>\n";
 
+    RET_IF_ERR(init_config());
     RET_IF_ERR(init_keys());
     RET_IF_ERR(init_sound());
     RET_IF_ERR(init_disp());
     RET_IF_ERR(init_led());
+    RET_IF_ERR(init_meter());
+    RET_IF_ERR(init_detect());
     RET_IF_ERR(init_analog());
     RET_IF_ERR(init_touch());
     init_accel();
     init_cam();
+    init_midi();
 
     // Register the signal handler for SIGINT
     std::signal(SIGINT, signalHandler);
@@ -33,13 +41,20 @@ int main() {
         loop_touch();
         loop_accel();
         loop_analog();
+        loop_detect();
 
         cam_check_gesture();
     }
 
+    // Stops config reloads reaching into modules being torn down
+    cleanup_config();
+    cleanup_midi();
+    cleanup_detect();
     cleanup_sound();
+    cleanup_meter();
     cleanup_disp();
     cleanup_led();
+    cleanup_cam();
 
     std::cout << "... exiting app ...\n";
     return 0;
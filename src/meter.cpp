@@ -0,0 +1,178 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "disp.hpp"
+#include "keys.hpp"
+#include "led.hpp"
+#include "ring.hpp"
+
+#include "meter.hpp"
+
+#define METER_SUCCESS 0
+
+// ~1.5 s of 256 frame blocks, so a stalled consumer loses nothing visible
+#define METER_RING_SIZE 256
+#define METER_RATE      30     // Hz, LED and display refresh
+
+#define METER_FLOOR_DB   -48.0f
+#define METER_RELEASE_DB 1.5f  // dB per meter frame
+#define METER_CLIP_LEVEL 1.0f
+#define METER_CLIP_HOLD  METER_RATE // frames (1 s)
+
+// VU segments use the LEDs under the display (strip positions 0..5)
+#define METER_LED_CNT 6
+#define METER_COLOR_LOW  0x00FF00
+#define METER_COLOR_MID  0xFFB000
+#define METER_COLOR_HIGH 0xFF0000
+
+static const float led_thresholds_db[METER_LED_CNT] = {
+    -42.0f, -30.0f, -18.0f, -12.0f, -6.0f, -2.0f
+};
+
+static const uint32_t led_colors[METER_LED_CNT] = {
+    METER_COLOR_LOW, METER_COLOR_LOW, METER_COLOR_LOW,
+    METER_COLOR_MID, METER_COLOR_MID, METER_COLOR_HIGH
+};
+
+static SpscRing<METER_BLOCK, METER_RING_SIZE> ring;
+
+static std::atomic<float> voice_levels[MAX_KEYS];
+static std::atomic<float> voice_peaks[MAX_KEYS];
+static std::atomic<float> master_level;
+
+static std::atomic<bool> meter_running;
+static std::thread       meter_thread;
+
+static float to_db(float amplitude) {
+    if (amplitude <= 0.0f) {
+        return METER_FLOOR_DB;
+    }
+    return std::fmax(20.0f * std::log10(amplitude), METER_FLOOR_DB);
+}
+
+static void show_levels(float master_db, bool clipped) {
+    for (uint8_t i = 0; i < METER_LED_CNT; i++) {
+        if (master_db >= led_thresholds_db[i]) {
+            set_led_layer(LED_LAYER_ANIM, i, led_colors[i]);
+        } else {
+            clear_led_layer_pixel(LED_LAYER_ANIM, i);
+        }
+    }
+
+    // Quantize so the display only hears about audible changes
+    int percent = static_cast<int>((master_db - METER_FLOOR_DB) * 100.0f
+                                   / -METER_FLOOR_DB);
+    percent -= percent % 5;
+    set_disp_field(DISP_LEVEL, std::to_string(percent));
+    set_disp_field(DISP_CLIP, clipped ? "CLIP" : "");
+    disp_commit();
+}
+
+static void meter_loop() {
+    auto period = std::chrono::microseconds(1000000 / METER_RATE);
+    auto next   = std::chrono::steady_clock::now();
+
+    float voice_peak[MAX_KEYS];
+    float voice_sum_sq[MAX_KEYS];
+    float master_peak, master_sum_sq;
+    float shown_db   = METER_FLOOR_DB;
+    int   clip_hold  = 0;
+    float last_shown = 1.0f;  // Forces the first update
+    bool  last_clip  = true;
+
+    while (meter_running) {
+        next += period;
+        std::this_thread::sleep_until(next);
+
+        // Fold every block published since the last frame into one reading
+        uint32_t frames = 0;
+        master_peak = master_sum_sq = 0.0f;
+        for (size_t i = 0; i < MAX_KEYS; i++) {
+            voice_peak[i] = voice_sum_sq[i] = 0.0f;
+        }
+
+        METER_BLOCK block;
+        while (ring.pop(block)) {
+            frames += block.frames;
+            master_peak    = std::fmax(master_peak, block.master_peak);
+            master_sum_sq += block.master_sum_sq;
+            for (size_t i = 0; i < MAX_KEYS; i++) {
+                voice_peak[i]    = std::fmax(voice_peak[i], block.voice_peak[i]);
+                voice_sum_sq[i] += block.voice_sum_sq[i];
+            }
+        }
+
+        if (frames == 0) {
+            continue;
+        }
+
+        float master_rms = std::sqrt(master_sum_sq / frames);
+        master_level.store(master_rms, std::memory_order_relaxed);
+        for (size_t i = 0; i < MAX_KEYS; i++) {
+            voice_levels[i].store(std::sqrt(voice_sum_sq[i] / frames),
+                                  std::memory_order_relaxed);
+            voice_peaks[i].store(voice_peak[i], std::memory_order_relaxed);
+        }
+
+        shown_db = std::fmax(to_db(master_rms), shown_db - METER_RELEASE_DB);
+
+        if (master_peak >= METER_CLIP_LEVEL) {
+            clip_hold = METER_CLIP_HOLD;
+        } else if (clip_hold > 0) {
+            clip_hold--;
+        }
+
+        bool clipped = clip_hold > 0;
+        if (shown_db != last_shown || clipped != last_clip) {
+            show_levels(shown_db, clipped);
+            last_shown = shown_db;
+            last_clip  = clipped;
+        }
+    }
+}
+
+uint8_t init_meter() {
+    for (size_t i = 0; i < MAX_KEYS; i++) {
+        voice_levels[i] = 0.0f;
+        voice_peaks[i]  = 0.0f;
+    }
+    master_level = 0.0f;
+
+    meter_running = true;
+    meter_thread = std::thread(meter_loop);
+
+    return METER_SUCCESS;
+}
+
+void cleanup_meter() {
+    if (!meter_running.exchange(false)) {
+        return;
+    }
+    meter_thread.join();
+}
+
+void meter_publish(const METER_BLOCK& block) {
+    ring.push(block);
+}
+
+float meter_voice_level(uint8_t index) {
+    if (index >= MAX_KEYS) {
+        return 0.0f;
+    }
+    return voice_levels[index].load(std::memory_order_relaxed);
+}
+
+float meter_voice_peak(uint8_t index) {
+    if (index >= MAX_KEYS) {
+        return 0.0f;
+    }
+    return voice_peaks[index].load(std::memory_order_relaxed);
+}
+
+float meter_master_level() {
+    return master_level.load(std::memory_order_relaxed);
+}
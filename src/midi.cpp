@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <alsa/asoundlib.h>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "audio.hpp"
+#include "events.hpp"
+#include "keys.hpp"
+#include "looper.hpp"
+#include "midi.hpp"
+#include "recorder.hpp"
+#include "sequencer.hpp"
+#include "sound.hpp"
+#include "tuning.hpp"
+
+#define MIDI_SUCCESS 0
+#define MIDI_INITERR 1
+
+#define MIDI_CLIENT_NAME "DAW-DEV"
+
+#define MIDI_KEY_CHANNEL  0
+#define MIDI_DRUM_CHANNEL 9  // Channel 10, General MIDI percussion
+#define MIDI_BASE_NOTE    60 // C4, the first key in the middle octave
+
+#define MIDI_BEND_RANGE 2.0f // semitones
+#define MIDI_BEND_MAX   8192.0f
+
+#define MIDI_POLL_MS 100
+#define MIDI_MAX_FDS 4
+
+// General MIDI kick, snare, closed hi hat
+static const uint8_t drum_notes[SAMPLE_CNT] = {36, 38, 42};
+
+static snd_seq_t *seq;
+static int        port;
+static int        queue;
+
+static std::thread       input;
+static std::atomic<bool> running;
+
+// Input thread only, for edge detection on switch-like controllers
+static int8_t last_in_cc[128];
+
+// Output comes from the control loop, input from its own thread
+static std::mutex output_mutex;
+static int8_t     last_out_cc[128];
+
+static uint64_t queue_ns(const snd_seq_real_time_t *time) {
+    return static_cast<uint64_t>(time->tv_sec) * 1000000000ULL + time->tv_nsec;
+}
+
+/*
+ * The port stamps incoming events with the queue's real time on arrival. The
+ * age of an event when it gets read is subtracted from the current stream
+ * time, so a burst read late still plays with its original spacing.
+ */
+static uint64_t event_frame(const snd_seq_event_t *ev) {
+    uint64_t now = events_now();
+    if (!(ev->flags & SND_SEQ_TIME_STAMP_REAL)) {
+        return now;
+    }
+
+    snd_seq_queue_status_t *status;
+    snd_seq_queue_status_alloca(&status);
+    if (snd_seq_get_queue_status(seq, queue, status) < 0) {
+        return now;
+    }
+
+    uint64_t read_ns    = queue_ns(snd_seq_queue_status_get_real_time(status));
+    uint64_t arrival_ns = queue_ns(&ev->time.time);
+    if (read_ns <= arrival_ns) {
+        return now;
+    }
+
+    uint64_t age = (read_ns - arrival_ns) * audio_sample_rate()
+                   / 1000000000ULL;
+    return now > age ? now - age : 0;
+}
+
+// MIDI_BASE_NOTE is the first key in the middle octave, notes out of the
+// keyboard's reach are folded back by octaves
+static uint8_t engine_note(uint8_t note) {
+    int n = note - MIDI_BASE_NOTE + TUNING_NOTE(0, 0);
+    while (n < 0) {
+        n += MAX_KEYS;
+    }
+    while (n >= TUNING_NOTES) {
+        n -= MAX_KEYS;
+    }
+    return n;
+}
+
+static void handle_note(const snd_seq_event_t *ev, bool on) {
+    uint8_t  note     = ev->data.note.note;
+    float    velocity = ev->data.note.velocity / 127.0f;
+    uint64_t frame    = event_frame(ev);
+
+    // Note on with velocity 0 is a note off
+    if (on && !ev->data.note.velocity) {
+        on = false;
+    }
+
+    if (ev->data.note.channel == MIDI_DRUM_CHANNEL) {
+        for (uint8_t s = 0; s < SAMPLE_CNT; s++) {
+            if (on && note == drum_notes[s]) {
+                play_sample(s, velocity, frame);
+                seq_record(SEQ_SAMPLE_TRACK(s), velocity);
+            }
+        }
+        return;
+    }
+
+    if (on) {
+        note_on(engine_note(note), velocity, frame);
+        seq_record(SEQ_KEY_TRACK(engine_note(note) % MAX_KEYS), velocity);
+    } else {
+        note_off(engine_note(note), frame);
+    }
+}
+
+static void handle_control(const snd_seq_event_t *ev) {
+    unsigned int cc    = ev->data.control.param;
+    int          value = ev->data.control.value;
+
+    if (cc >= 128) {
+        return;
+    }
+
+    switch (cc) {
+        case MIDI_CC_MODULATION:
+            set_mod_source(MOD_SRC_WHEEL, value / 127.0f);
+            if (value >= 64 && last_in_cc[cc] < 64) {
+                trigger_vibrato();
+            }
+            break;
+
+        case MIDI_CC_VOLUME:
+            set_volume(value / 127.0f);
+            break;
+
+        case MIDI_CC_REVERB:
+            set_reverb(value >= 64);
+            break;
+
+        case MIDI_CC_CUTOFF:
+            set_expression(EXPR_CUTOFF, value / 127.0f);
+            break;
+
+        case MIDI_CC_LOOPER + LOOPER_REC:
+        case MIDI_CC_LOOPER + LOOPER_PLAY:
+        case MIDI_CC_LOOPER + LOOPER_UNDO:
+        case MIDI_CC_LOOPER + LOOPER_CLEAR:
+            if (value >= 64 && last_in_cc[cc] < 64) {
+                looper_command(static_cast<LOOPER_COMMAND>(cc - MIDI_CC_LOOPER));
+            }
+            break;
+
+        case MIDI_CC_RECORD:
+            if (value >= 64 && last_in_cc[cc] < 64) {
+                recorder_toggle();
+            }
+            break;
+
+        case MIDI_CC_SEQ_RUN:
+            if (value >= 64 && last_in_cc[cc] < 64) {
+                seq_toggle_running();
+            }
+            break;
+
+        case MIDI_CC_SEQ_TEMPO:
+            seq_set_tempo(SEQ_MIN_BPM
+                          + (SEQ_MAX_BPM - SEQ_MIN_BPM) * value / 127.0f);
+            break;
+
+        case MIDI_CC_SEQ_SWING:
+            seq_set_swing(SEQ_MAX_SWING * value / 127.0f);
+            break;
+
+        case MIDI_CC_SEQ_STEP:
+            if (value >= 64 && last_in_cc[cc] < 64) {
+                seq_toggle_record();
+            }
+            break;
+
+        case MIDI_CC_SEQ_CLEAR:
+            if (value >= 64 && last_in_cc[cc] < 64) {
+                seq_clear();
+            }
+            break;
+
+        default:
+            return;
+    }
+
+    last_in_cc[cc] = value;
+}
+
+static void input_thread() {
+    struct pollfd fds[MIDI_MAX_FDS];
+    int count = snd_seq_poll_descriptors(seq, fds, MIDI_MAX_FDS, POLLIN);
+
+    while (running.load()) {
+        if (poll(fds, count, MIDI_POLL_MS) <= 0) {
+            continue;
+        }
+
+        snd_seq_event_t *ev;
+        while (snd_seq_event_input(seq, &ev) >= 0) {
+            switch (ev->type) {
+                case SND_SEQ_EVENT_NOTEON:
+                    handle_note(ev, true);
+                    break;
+
+                case SND_SEQ_EVENT_NOTEOFF:
+                    handle_note(ev, false);
+                    break;
+
+                case SND_SEQ_EVENT_CONTROLLER:
+                    handle_control(ev);
+                    break;
+
+                case SND_SEQ_EVENT_PITCHBEND:
+                    set_expression(EXPR_PITCH_BEND, MIDI_BEND_RANGE
+                                   * ev->data.control.value / MIDI_BEND_MAX);
+                    break;
+
+                default:
+                    break;
+            }
+
+            if (!snd_seq_event_input_pending(seq, 1)) {
+                break;
+            }
+        }
+    }
+}
+
+uint8_t init_midi() {
+    std::cout << "  * initializing midi ...\n";
+
+    int err = snd_seq_open(&seq, "default", SND_SEQ_OPEN_DUPLEX,
+                           SND_SEQ_NONBLOCK);
+    if (err < 0) {
+        std::cerr << "Failed to open ALSA sequencer: " << snd_strerror(err)
+                  << std::endl;
+        seq = nullptr;
+        return MIDI_INITERR;
+    }
+    snd_seq_set_client_name(seq, MIDI_CLIENT_NAME);
+
+    queue = snd_seq_alloc_named_queue(seq, MIDI_CLIENT_NAME);
+
+    snd_seq_port_info_t *info;
+    snd_seq_port_info_alloca(&info);
+    snd_seq_port_info_set_name(info, MIDI_CLIENT_NAME);
+    snd_seq_port_info_set_capability(info,
+        SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE
+        | SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ);
+    snd_seq_port_info_set_type(info, SND_SEQ_PORT_TYPE_MIDI_GENERIC
+                                     | SND_SEQ_PORT_TYPE_APPLICATION);
+    snd_seq_port_info_set_timestamping(info, 1);
+    snd_seq_port_info_set_timestamp_real(info, 1);
+    snd_seq_port_info_set_timestamp_queue(info, queue);
+
+    err = snd_seq_create_port(seq, info);
+    if (err < 0) {
+        std::cerr << "Failed to create MIDI port: " << snd_strerror(err)
+                  << std::endl;
+        snd_seq_close(seq);
+        seq = nullptr;
+        return MIDI_INITERR;
+    }
+    port = snd_seq_port_info_get_port(info);
+
+    snd_seq_start_queue(seq, queue, nullptr);
+    snd_seq_drain_output(seq);
+
+    for (size_t cc = 0; cc < 128; cc++) {
+        last_in_cc[cc]  = 0;
+        last_out_cc[cc] = -1;
+    }
+
+    running = true;
+    input = std::thread(input_thread);
+
+    std::cout << " MIDI Success!\n";
+    return MIDI_SUCCESS;
+}
+
+void cleanup_midi() {
+    if (!seq) {
+        return;
+    }
+
+    running = false;
+    if (input.joinable()) {
+        input.join();
+    }
+
+    snd_seq_stop_queue(seq, queue, nullptr);
+    snd_seq_free_queue(seq, queue);
+    snd_seq_close(seq);
+    seq = nullptr;
+}
+
+static void send(snd_seq_event_t *ev) {
+    if (!seq) {
+        return;
+    }
+
+    snd_seq_ev_set_source(ev, port);
+    snd_seq_ev_set_subs(ev);
+    snd_seq_ev_set_direct(ev);
+
+    std::lock_guard<std::mutex> lock(output_mutex);
+    snd_seq_event_output_direct(seq, ev);
+}
+
+// The inverse of engine_note(), for notes the keyboard can reach
+static uint8_t midi_note(uint8_t note) {
+    return note - TUNING_NOTE(0, 0) + MIDI_BASE_NOTE;
+}
+
+void midi_send_note(uint8_t note, bool on) {
+    if (note >= TUNING_NOTES) {
+        return;
+    }
+
+    snd_seq_event_t ev;
+    snd_seq_ev_clear(&ev);
+    if (on) {
+        snd_seq_ev_set_noteon(&ev, MIDI_KEY_CHANNEL, midi_note(note), 100);
+    } else {
+        snd_seq_ev_set_noteoff(&ev, MIDI_KEY_CHANNEL, midi_note(note), 0);
+    }
+    send(&ev);
+}
+
+void midi_send_sample(uint8_t sample) {
+    if (sample >= SAMPLE_CNT) {
+        return;
+    }
+
+    // Drums are one-shots: note on and off back to back
+    snd_seq_event_t ev;
+    snd_seq_ev_clear(&ev);
+    snd_seq_ev_set_noteon(&ev, MIDI_DRUM_CHANNEL, drum_notes[sample], 100);
+    send(&ev);
+
+    snd_seq_ev_clear(&ev);
+    snd_seq_ev_set_noteoff(&ev, MIDI_DRUM_CHANNEL, drum_notes[sample], 0);
+    send(&ev);
+}
+
+void midi_send_control(uint8_t cc, float value) {
+    if (cc >= 128) {
+        return;
+    }
+
+    int8_t scaled = static_cast<int8_t>(std::clamp(value, 0.0f, 1.0f)
+                                        * 127.0f + 0.5f);
+    {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        if (scaled == last_out_cc[cc]) {
+            return;
+        }
+        last_out_cc[cc] = scaled;
+    }
+
+    snd_seq_event_t ev;
+    snd_seq_ev_clear(&ev);
+    snd_seq_ev_set_controller(&ev, MIDI_KEY_CHANNEL, cc, scaled);
+    send(&ev);
+}
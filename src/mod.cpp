@@ -0,0 +1,60 @@
+#include <algorithm>
+#include <cstdint>
+#include <math.h>
+
+#include "mod.hpp"
+
+void mod_lfo_reset(LFO *lfo, uint32_t seed) {
+    lfo->phase = 0.0f;
+    lfo->held  = 0.0f;
+    lfo->noise = seed | 1;
+}
+
+// xorshift32, same as the string excitation
+static float next_level(LFO *lfo) {
+    uint32_t x = lfo->noise;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    lfo->noise = x;
+    return static_cast<float>(x) / 4294967295.0f * 2.0f - 1.0f;
+}
+
+float mod_lfo_advance(LFO *lfo, LFO_SHAPE shape, float rate_hz,
+                      float sample_rate, unsigned int frames) {
+    lfo->phase += rate_hz * frames / sample_rate;
+    if (lfo->phase >= 1.0f) {
+        lfo->phase -= floorf(lfo->phase);
+        lfo->held   = next_level(lfo);
+    }
+
+    float t = lfo->phase;
+    switch (shape) {
+        case LFO_TRIANGLE:
+            return t < 0.5f ? 4.0f * t - 1.0f : 3.0f - 4.0f * t;
+
+        case LFO_SAW:
+            return 2.0f * t - 1.0f;
+
+        case LFO_SQUARE:
+            return t < 0.5f ? 1.0f : -1.0f;
+
+        case LFO_RANDOM:
+            return lfo->held;
+
+        default:
+            return sinf(2.0f * (float)M_PI * t);
+    }
+}
+
+// sources[MOD_SRC_NONE] is 1, so a route without a via needs no branch
+void mod_evaluate(const MOD_SETTINGS *settings, const float *sources,
+                  float *dest) {
+    std::fill(dest, dest + MOD_DEST_CNT, 0.0f);
+
+    for (uint8_t r = 0; r < settings->routes.count; r++) {
+        const MOD_ROUTE *route = &settings->routes.route[r];
+        dest[route->dest] += route->depth * sources[route->source]
+                             * sources[route->via];
+    }
+}
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "oscillator.hpp"
+
+// Frames per pass, the phases of a pass stay on the stack
+#define OSC_CHUNK 256
+
+/*
+ * What has to be added to a naive unit step (-1 to 1 is twice that) around
+ * the jump to band-limit it, t being the phase after the jump. Zero outside
+ * one frame either side of it.
+ */
+static inline float blep(float t, float dt) {
+    float after  = t / dt;
+    float before = (t - 1.0f) / dt;
+    float a = after - 0.5f * after * after - 0.5f;
+    float b = 0.5f * before * before + before + 0.5f;
+    return t < dt ? a : (t > 1.0f - dt ? b : 0.0f);
+}
+
+// Same for a corner, per unit change of slope per frame
+static inline float blamp(float t, float dt) {
+    float after  = 1.0f - t / dt;
+    float before = (t - 1.0f) / dt + 1.0f;
+    float a = after * after * after * (1.0f / 6.0f);
+    float b = before * before * before * (1.0f / 6.0f);
+    return t < dt ? a : (t > 1.0f - dt ? b : 0.0f);
+}
+
+// The only serial part: phase of every frame in the pass, in [0, 1)
+static void advance(float *phase, const float *__restrict step,
+                    float *__restrict at, unsigned int n) {
+    float p = *phase;
+    for (unsigned int i = 0; i < n; i++) {
+        at[i] = p;
+        p += step[i];
+        p -= p >= 1.0f ? 1.0f : 0.0f;
+    }
+    *phase = p;
+}
+
+void osc_saw(float *phase, const float *step, float *out, unsigned int frames) {
+    float at[OSC_CHUNK];
+
+    for (unsigned int done = 0; done < frames; done += OSC_CHUNK) {
+        unsigned int n = std::min<unsigned int>(OSC_CHUNK, frames - done);
+        const float *__restrict s = step + done;
+        float       *__restrict o = out + done;
+        advance(phase, s, at, n);
+
+        // Falls by 2 at the wrap
+        for (unsigned int i = 0; i < n; i++) {
+            o[i] = 2.0f * at[i] - 1.0f - 2.0f * blep(at[i], s[i]);
+        }
+    }
+}
+
+void osc_pulse(float *phase, const float *step, float width, float *out,
+               unsigned int frames) {
+    float at[OSC_CHUNK];
+    width = std::clamp(width, OSC_MIN_WIDTH, OSC_MAX_WIDTH);
+
+    for (unsigned int done = 0; done < frames; done += OSC_CHUNK) {
+        unsigned int n = std::min<unsigned int>(OSC_CHUNK, frames - done);
+        const float *__restrict s = step + done;
+        float       *__restrict o = out + done;
+        advance(phase, s, at, n);
+
+        // Rises by 2 at the wrap, falls by 2 at width
+        for (unsigned int i = 0; i < n; i++) {
+            float t    = at[i];
+            float fall = t - width + (t < width ? 1.0f : 0.0f);
+            o[i] = (t < width ? 1.0f : -1.0f)
+                   + 2.0f * blep(t, s[i]) - 2.0f * blep(fall, s[i]);
+        }
+    }
+}
+
+void osc_triangle(float *phase, const float *step, float *out,
+                  unsigned int frames) {
+    float at[OSC_CHUNK];
+
+    for (unsigned int done = 0; done < frames; done += OSC_CHUNK) {
+        unsigned int n = std::min<unsigned int>(OSC_CHUNK, frames - done);
+        const float *__restrict s = step + done;
+        float       *__restrict o = out + done;
+        advance(phase, s, at, n);
+
+        // Slope of 4 a cycle, turning down at the wrap and up half way
+        for (unsigned int i = 0; i < n; i++) {
+            float t    = at[i];
+            float half = t + (t < 0.5f ? 0.5f : -0.5f);
+            float bend = 8.0f * s[i];
+            o[i] = 4.0f * (t < 0.5f ? 0.5f - t : t - 0.5f) - 1.0f
+                   - bend * blamp(t, s[i]) + bend * blamp(half, s[i]);
+        }
+    }
+}
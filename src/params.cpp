@@ -0,0 +1,95 @@
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "events.hpp"
+#include "params.hpp"
+
+#define PARAMS_SUCCESS 0
+
+/*
+ * Reclamation works on audio block epochs: a snapshot swapped out while block
+ * E was running can only still be referenced by block E, so it is freed once
+ * the callback has completed more than E blocks. All of it happens on the
+ * control side, the callback only bumps a counter.
+ */
+typedef struct retired_params {
+    ENGINE_PARAMS *params;
+    uint64_t       epoch;
+} RETIRED_PARAMS;
+
+static std::atomic<ENGINE_PARAMS *> current_params;
+static std::atomic<uint64_t>        audio_epoch;
+
+static std::mutex                  writer_mutex;
+static ENGINE_PARAMS              *draft;
+static std::vector<RETIRED_PARAMS> retired;
+
+static void reclaim() {
+    uint64_t epoch = audio_epoch.load();
+
+    size_t kept = 0;
+    for (const auto& old : retired) {
+        if (epoch > old.epoch) {
+            delete old.params;
+        } else {
+            retired[kept++] = old;
+        }
+    }
+    retired.resize(kept);
+}
+
+uint8_t init_params(const ENGINE_PARAMS& initial) {
+    audio_epoch = 0;
+    current_params = new ENGINE_PARAMS(initial);
+    current_params.load()->serial = 1;
+    return PARAMS_SUCCESS;
+}
+
+// Only valid once the audio stream is stopped
+void cleanup_params() {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    for (const auto& old : retired) {
+        delete old.params;
+    }
+    retired.clear();
+    delete current_params.exchange(nullptr);
+}
+
+ENGINE_PARAMS *params_begin() {
+    writer_mutex.lock();
+    draft = new ENGINE_PARAMS(*current_params.load());
+    return draft;
+}
+
+void params_commit() {
+    draft->serial++;
+    draft->frame = events_now();
+    ENGINE_PARAMS *old = current_params.exchange(draft);
+    draft = nullptr;
+
+    retired.push_back({old, audio_epoch.load()});
+    reclaim();
+
+    writer_mutex.unlock();
+}
+
+void params_abort() {
+    delete draft;
+    draft = nullptr;
+    writer_mutex.unlock();
+}
+
+int8_t params_octave() {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    return current_params.load()->octave;
+}
+
+const ENGINE_PARAMS *params_acquire() {
+    return current_params.load();
+}
+
+void params_release() {
+    audio_epoch.fetch_add(1);
+}
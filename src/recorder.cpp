@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <sndfile.h>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+#include "audio.hpp"
+#include "config.hpp"
+#include "recorder.hpp"
+#include "ring.hpp"
+
+#define RECORDER_SUCCESS 0
+#define RECORDER_OPENERR 1
+#define RECORDER_BUSYERR 2
+
+#define RECORDER_CHANNELS AUDIO_CHANNELS
+
+// 4096 blocks of 256 frames: ~24 s of slack at 44.1 kHz before anything is
+// dropped. Short periods are gathered into a block before it is handed over,
+// long ones are split.
+#define RECORDER_BLOCK_FRAMES 256
+#define RECORDER_RING_BLOCKS  4096
+
+// Frames per write. 64k stereo floats is 512 KiB, a multiple of any flash
+// erase block, so the card sees large aligned sequential writes.
+#define RECORDER_CHUNK_FRAMES 65536
+
+#define RECORDER_POLL_MS 20
+
+typedef struct rec_block {
+    uint32_t frames;
+    float    samples[RECORDER_BLOCK_FRAMES * RECORDER_CHANNELS];
+} REC_BLOCK;
+
+static SpscRing<REC_BLOCK, RECORDER_RING_BLOCKS> ring;
+
+static std::atomic<bool>     recording;
+static std::atomic<uint32_t> dropped;
+static std::atomic<uint32_t> take;     // Bumped by every recorder_start()
+
+// Callback only: the slot being filled and the take it belongs to
+static REC_BLOCK *filling;
+static uint32_t   filling_take;
+
+static std::thread writer;
+static SNDFILE    *file;
+static int         fd = -1;
+
+// Writer thread only
+static float    chunk[RECORDER_CHUNK_FRAMES * RECORDER_CHANNELS];
+static uint32_t chunk_frames;
+static off_t    previous_offset, previous_length;
+static uint64_t written_frames;
+
+uint8_t init_recorder() {
+    // The callback writes into the ring, fault it in and keep it resident
+    if (mlock(&ring, sizeof(ring))) {
+        std::cerr << "Warning: recorder ring not locked in memory "
+                     "(check RLIMIT_MEMLOCK)" << std::endl;
+    }
+    return RECORDER_SUCCESS;
+}
+
+void cleanup_recorder() {
+    recorder_stop();
+    munlock(&ring, sizeof(ring));
+}
+
+/*
+ * Hands a chunk to the kernel and keeps the page cache from filling up with
+ * the take: writeback of this chunk is started right away, the previous one
+ * is waited for (on this thread only) and dropped from the cache.
+ */
+static void flush_chunk() {
+    if (!chunk_frames) {
+        return;
+    }
+
+    off_t start = lseek(fd, 0, SEEK_CUR);
+    sf_writef_float(file, chunk, chunk_frames);
+    off_t end = lseek(fd, 0, SEEK_CUR);
+
+    written_frames += chunk_frames;
+    chunk_frames = 0;
+
+    if (start < 0 || end <= start) {
+        return;
+    }
+
+    sync_file_range(fd, start, end - start, SYNC_FILE_RANGE_WRITE);
+    if (previous_length) {
+        sync_file_range(fd, previous_offset, previous_length,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE
+                        | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fd, previous_offset, previous_length,
+                      POSIX_FADV_DONTNEED);
+    }
+    previous_offset = start;
+    previous_length = end - start;
+}
+
+static void writer_thread() {
+    uint32_t reported = 0;
+
+    while (true) {
+        bool stopping = !recording.load();
+
+        // Read in place, the only copy is into the chunk
+        while (const REC_BLOCK *block = ring.front()) {
+            uint32_t done = 0;
+            while (done < block->frames) {
+                uint32_t n = std::min(block->frames - done,
+                                      RECORDER_CHUNK_FRAMES - chunk_frames);
+                memcpy(&chunk[chunk_frames * RECORDER_CHANNELS],
+                       &block->samples[done * RECORDER_CHANNELS],
+                       n * RECORDER_CHANNELS * sizeof(float));
+                chunk_frames += n;
+                done += n;
+
+                if (chunk_frames == RECORDER_CHUNK_FRAMES) {
+                    flush_chunk();
+                }
+            }
+            ring.release();
+        }
+
+        uint32_t lost = dropped.load();
+        if (lost != reported) {
+            std::cerr << "Recorder: " << lost - reported
+                      << " blocks dropped, disk too slow" << std::endl;
+            reported = lost;
+        }
+
+        if (stopping) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(RECORDER_POLL_MS));
+    }
+
+    flush_chunk();
+}
+
+uint8_t recorder_start(const char *path) {
+    if (recording.load() || writer.joinable()) {
+        return RECORDER_BUSYERR;
+    }
+
+    std::string name(path);
+    bool flac = name.size() >= 5
+                && name.compare(name.size() - 5, 5, ".flac") == 0;
+
+    SF_INFO info = {};
+    info.samplerate = audio_sample_rate();
+    info.channels   = RECORDER_CHANNELS;
+    info.format     = flac ? (SF_FORMAT_FLAC | SF_FORMAT_PCM_24)
+                           : (SF_FORMAT_WAV | SF_FORMAT_FLOAT);
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to create " << path << std::endl;
+        return RECORDER_OPENERR;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    file = sf_open_fd(fd, SFM_WRITE, &info, false);
+    if (!file) {
+        std::cerr << "Failed to open " << path << ": " << sf_strerror(nullptr)
+                  << std::endl;
+        close(fd);
+        fd = -1;
+        return RECORDER_OPENERR;
+    }
+
+    // Leftovers from a block pushed while the previous take was stopping
+    while (ring.front()) {
+        ring.release();
+    }
+
+    chunk_frames    = 0;
+    previous_offset = 0;
+    previous_length = 0;
+    written_frames  = 0;
+    dropped         = 0;
+
+    take.fetch_add(1);
+    recording = true;
+    writer = std::thread(writer_thread);
+
+    std::cout << "Recording to " << path << "\n";
+    return RECORDER_SUCCESS;
+}
+
+void recorder_stop() {
+    if (!writer.joinable()) {
+        return;
+    }
+
+    recording = false;
+    writer.join();
+
+    sf_close(file);
+    file = nullptr;
+    fsync(fd);
+    close(fd);
+    fd = -1;
+
+    std::cout << "Recorded " << written_frames << " frames ("
+              << written_frames / audio_sample_rate() << " s), "
+              << dropped.load() << " blocks dropped\n";
+}
+
+uint8_t recorder_toggle() {
+    if (recording.load()) {
+        recorder_stop();
+        return RECORDER_SUCCESS;
+    }
+
+    const DAW_CONFIG *cfg = config();
+    char   stamp[32];
+    time_t now = time(nullptr);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+
+    std::string path = std::string(cfg->record_dir) + "/take-" + stamp
+                       + (cfg->record_flac ? ".flac" : ".wav");
+    return recorder_start(path.c_str());
+}
+
+bool recorder_active() {
+    return recording.load(std::memory_order_relaxed);
+}
+
+uint32_t recorder_dropped() {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+/*
+ * Periods are copied straight into the slot at the head of the ring, which is
+ * only handed to the writer once it holds a whole block, so a 64 frame period
+ * doesn't cost a whole slot. The tail of a take, less than a block, is
+ * handed over once the callback sees the take stopped and is written if the
+ * writer is still draining; a slot left from an older take is dropped.
+ */
+void recorder_write(const float *buffer, unsigned int frames) {
+    uint32_t current = take.load(std::memory_order_relaxed);
+
+    if (!recording.load(std::memory_order_acquire)) {
+        if (filling && filling_take == current && filling->frames) {
+            ring.publish();
+        }
+        filling = nullptr;
+        return;
+    }
+
+    if (filling && filling_take != current) {
+        filling = nullptr;
+    }
+
+    while (frames) {
+        if (!filling) {
+            filling = ring.claim();
+            if (!filling) {
+                // Full: the rest of this period is lost
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            filling->frames = 0;
+            filling_take    = current;
+        }
+
+        uint32_t n = std::min<uint32_t>(frames,
+                                        RECORDER_BLOCK_FRAMES - filling->frames);
+        memcpy(&filling->samples[filling->frames * RECORDER_CHANNELS], buffer,
+               n * RECORDER_CHANNELS * sizeof(float));
+        filling->frames += n;
+        buffer += n * RECORDER_CHANNELS;
+        frames -= n;
+
+        if (filling->frames == RECORDER_BLOCK_FRAMES) {
+            ring.publish();
+            filling = nullptr;
+        }
+    }
+}
@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include "audio.hpp"
+#include "params.hpp"
+#include "sequencer.hpp"
+#include "tuning.hpp"
+
+// Synth notes are released half way through their step
+#define SEQ_GATE_LENGTH 0.5
+
+static std::atomic<bool>    recording;
+
+// Step last started by the callback, SEQ_MAX_STEPS while stopped
+static std::atomic<uint8_t> playing{SEQ_MAX_STEPS};
+
+void seq_toggle_running() {
+    ENGINE_PARAMS *params = params_begin();
+    params->seq.running = !params->seq.running;
+    params_commit();
+}
+
+void seq_set_tempo(float bpm) {
+    ENGINE_PARAMS *params = params_begin();
+    params->seq.bpm = std::clamp(bpm, SEQ_MIN_BPM, SEQ_MAX_BPM);
+    params_commit();
+}
+
+void seq_set_swing(float swing) {
+    ENGINE_PARAMS *params = params_begin();
+    params->seq.swing = std::clamp(swing, 0.0f, SEQ_MAX_SWING);
+    params_commit();
+}
+
+void seq_set_step(uint8_t track, uint8_t step, float velocity) {
+    if (track >= SEQ_TRACKS || step >= SEQ_MAX_STEPS) {
+        return;
+    }
+
+    ENGINE_PARAMS *params = params_begin();
+    params->seq.velocity[track][step] = std::clamp(velocity, 0.0f, 1.0f);
+    params_commit();
+}
+
+void seq_clear() {
+    ENGINE_PARAMS *params = params_begin();
+    memset(params->seq.velocity, 0, sizeof(params->seq.velocity));
+    params_commit();
+}
+
+void seq_toggle_record() {
+    bool on = !recording.load();
+    recording = on;
+    std::cout << "Step recording " << (on ? "on" : "off") << "\n";
+}
+
+void seq_record(uint8_t track, float velocity) {
+    uint8_t step = playing.load(std::memory_order_relaxed);
+    if (!recording.load(std::memory_order_relaxed) || step >= SEQ_MAX_STEPS) {
+        return;
+    }
+    seq_set_step(track, step, velocity);
+}
+
+static void add_event(EVENT *events, uint8_t *count, uint64_t frame,
+                      EVENT_TYPE type, uint8_t index, float value) {
+    // Insertion keeps the list sorted, it never holds more than a handful
+    uint8_t i = (*count)++;
+    while (i > 0 && events[i - 1].frame > frame) {
+        events[i] = events[i - 1];
+        i--;
+    }
+    events[i] = {frame, type, index, value};
+}
+
+uint8_t seq_render(SEQ_STATE *state, const SEQ_PATTERN *pattern,
+                   int8_t octave, uint64_t start, uint64_t end,
+                   EVENT *events) {
+    uint8_t count = 0;
+
+    if (!pattern->running) {
+        // Don't leave notes hanging on stop
+        if (state->running) {
+            for (uint8_t key = 0; key < MAX_KEYS; key++) {
+                if (state->note_off[key]) {
+                    add_event(events, &count, start, EV_NOTE_OFF,
+                              state->note[key], 0.0f);
+                    state->note_off[key] = 0;
+                }
+            }
+            state->running = false;
+            playing.store(SEQ_MAX_STEPS, std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    if (!state->running) {
+        state->running = true;
+        state->step    = 0;
+        state->grid    = start;
+    }
+
+    for (uint8_t key = 0; key < MAX_KEYS; key++) {
+        if (state->note_off[key] && state->note_off[key] < end) {
+            add_event(events, &count, std::max(state->note_off[key], start),
+                      EV_NOTE_OFF, state->note[key], 0.0f);
+            state->note_off[key] = 0;
+        }
+    }
+
+    double length = audio_sample_rate() * 60.0 / (pattern->bpm * 4.0);
+
+    // Room for one more step: a trigger on every track, and up to two note
+    // offs per key
+    while (count + SEQ_TRACKS + 2 * MAX_KEYS <= SEQ_MAX_EVENTS) {
+        state->step %= pattern->steps;
+
+        double at = state->grid;
+        if (state->step & 1) {
+            at += pattern->swing * length;
+        }
+
+        uint64_t frame = static_cast<uint64_t>(at);
+        if (frame >= end) {
+            break;
+        }
+        frame = std::max(frame, start);
+        playing.store(state->step, std::memory_order_relaxed);
+
+        for (uint8_t track = 0; track < SEQ_TRACKS; track++) {
+            float velocity = pattern->velocity[track][state->step];
+            if (velocity <= 0.0f) {
+                continue;
+            }
+
+            if (track < SAMPLE_CNT) {
+                add_event(events, &count, frame, EV_SAMPLE, track, velocity);
+                continue;
+            }
+
+            uint8_t  key  = track - SAMPLE_CNT;
+            uint8_t  note = TUNING_NOTE(key, octave);
+            uint64_t off  = frame + static_cast<uint64_t>(length
+                                                          * SEQ_GATE_LENGTH);
+            // The octave moved under a note still held: let that one go
+            if (state->note_off[key] && state->note[key] != note) {
+                add_event(events, &count, frame, EV_NOTE_OFF,
+                          state->note[key], 0.0f);
+            }
+            add_event(events, &count, frame, EV_NOTE_ON, note, velocity);
+            state->note[key] = note;
+
+            if (off < end) {
+                add_event(events, &count, off, EV_NOTE_OFF, note, 0.0f);
+                state->note_off[key] = 0;
+            } else {
+                state->note_off[key] = off;
+            }
+        }
+
+        state->grid += length;
+        state->step++;
+    }
+
+    return count;
+}
@@ -2,8 +2,12 @@
 #include <cstdint>
 #include <iostream>
 
+#include "cam.hpp"
+#include "config.hpp"
 #include "disp.hpp"
 #include "led.hpp"
+#include "meter.hpp"
+#include "midi.hpp"
 #include "signal.h"
 #include "sound.hpp"
 
@@ -11,9 +15,14 @@ void signalHandler(int signal) {
     if (signal == SIGINT) {
         std::cout << "\nCtrl+C detected. Exiting program safely..." << std::endl;
 
+        // Stops config reloads reaching into modules being torn down
+        cleanup_config();
+        cleanup_midi();
         cleanup_sound();
+        cleanup_meter();
         cleanup_disp();
         cleanup_led();
+        cleanup_cam();
 
         exit(0); // Exit the program
     }
@@ -1,162 +1,219 @@
 #include <algorithm>
+#include <atomic>
+#include <climits>
 #include <cstdint>
+#include <ctime>
 #include <iostream>
 #include <math.h>
-#include <portaudio.h>
 #include <sndfile.h>
-#include <vector>
 
+#include "audio.hpp"
+#include "config.hpp"
+#include "convolution.hpp"
+#include "detect.hpp"
+#include "envelope.hpp"
+#include "events.hpp"
+#include "filter.hpp"
+#include "graph.hpp"
 #include "keys.hpp"
+#include "looper.hpp"
+#include "meter.hpp"
+#include "mod.hpp"
+#include "oscillator.hpp"
+#include "params.hpp"
+#include "recorder.hpp"
+#include "sequencer.hpp"
 #include "sound.hpp"
+#include "tuning.hpp"
+#include "voices.hpp"
+#include "workers.hpp"
 
-#define SAMPLE_RATE 44100
-#define FRAMES_PER_BUFFER 256
-
-#define KICK_SAMPLE_PATH   "sounds/kick.wav"
-#define SNARE_SAMPLE_PATH  "sounds/snare.wav"
-#define HI_HAT_SAMPLE_PATH "sounds/hi-hat.wav"
-
-#define VIBRATO_FREQUENCY   10.0f // 5 Hz vibrato
-#define VIBRATO_DEPTH       10.0f // deviation in Hz
-#define MAX_VIBRATO_WINDOWS 200
+// How long MOD_SRC_VIBRATO takes to fade out after trigger_vibrato()
+#define VIBRATO_SECONDS 1.2f
 
 #define DEFAULT_AMPLITUDE   0.25f
 #define DEFAULT_PHASE       0.0f
 
-#define C_FREQ  261.63f
-#define Db_FREQ 277.18f
-#define D_FREQ  293.66f
-#define Eb_FREQ 311.13f
-#define E_FREQ  329.63f
-#define F_FREQ  349.23f
-#define Gb_FREQ 369.99f
-#define G_FREQ  392.00f
-#define Ab_FREQ 415.30f
-#define A_FREQ  440.00f
-#define Bb_FREQ 466.16f
-#define B_FREQ  493.88f
-
 // For Karplus-Strong
 #define KS_DECAY    0.996f // Damping factor
+// Longest string: MAX_SAMPLE_RATE / lowest note (C two octaves down, 65.4 Hz)
+#define KS_MAX_LENGTH 2048
+// Smallest fractional delay left to the all-pass, it gets sluggish near 0
+#define KS_MIN_FRACTION 0.1f
 
 #define MAX_VOLUME 1.0f
 
 #define REVERB_DECAY 0.5f
 
+// Time the filter cutoff takes to get most of the way to a new setting
+#define CUTOFF_GLIDE_MS 30.0f
+
+#define MAX_PITCH_BEND 12.0f // semitones
+
 #define MAX_INC_OCTAVE 2
 #define MAX_DEC_OCTAVE -2
 
+static_assert(MAX_INC_OCTAVE <= TUNING_HIGHEST_OCTAVE
+              && MAX_DEC_OCTAVE >= TUNING_LOWEST_OCTAVE,
+              "octave range outside the tuning table");
+
 typedef struct wave {
     float amplitude;
-    float frequency;
-    float phase;
+    float phase;      // Cycles, 0..1
 } WAVE;
 
+// Buffers are sized for the lowest note so octave changes never allocate
 typedef struct ks {
-    std::vector<float> buffer;
-    int                index;
+    float buffer[KS_MAX_LENGTH];
+    int   length;
+    int   index;
+    float allpass;   // Coefficient tuning in the fraction of a sample
+    float ap_in;     // All-pass state
+    float ap_out;
 } KS;
 
 typedef struct signal {
-    bool        gate;
+    float       velocity;
     SIGNAL_TYPE type;
+    uint8_t     note;  // Index into the tuning table
     WAVE        wave;
     KS          ks;
+    ENVELOPE    envelope;
+    float       gain;       // Envelope over the current block, see
+    float       gain_step;  // envelope_block()
+    ENVELOPE    mod_envelope;
+    float       mod[MOD_DEST_CNT];  // Matrix output at the last evaluation
 } SIGNAL;
 
-typedef struct vibrato {
-    volatile float   vibratoPhase;
-    volatile uint8_t repetitions_left;
-} VIBRATO;
-
+/*
+ * The stretch being rendered, shared by every voice. Backends never hand
+ * over more than MAX_PERIOD frames at once.
+ */
+typedef struct block {
+    float        bend[MAX_PERIOD];  // Pitch bend as a frequency ratio
+    unsigned int frames;
+    bool         sounding[MAX_VOICES];
+    uint8_t      groups[FILTER_GROUPS];  // Filter groups with a voice on
+    uint8_t      group_cnt;
+    float       *out[3];                 // Outputs of the voices node
+    float        mod[MAX_VOICES][MOD_DEST_CNT];  // Matrix at its end
+    float        peak[MAX_VOICES];       // Level taps, folded in once the
+    float        sum_sq[MAX_VOICES];     // groups are done
+} BLOCK;
+
+// Working buffers of each thread rendering voice groups
+typedef struct scratch {
+    float step[MAX_PERIOD];     // Phase step of the voice being rendered
+    float voice[MAX_PERIOD];    // Output of the voice being rendered
+    v4f   lanes[MAX_PERIOD];    // Filter group being rendered
+    float partial[3][MAX_PERIOD];  // Workers mix here, the audio thread
+    bool  used;                    // straight into the node outputs
+} SCRATCH;
+
+// Room for a second of delay, whatever the sample rate
 typedef struct reverb {
-    volatile bool     enabled;
-    volatile uint16_t index;
-    volatile float    buffer[SAMPLE_RATE];
+    bool     enabled;
+    uint32_t index;
+    uint32_t length;
+    float    buffer[MAX_SAMPLE_RATE];
 } REVERB;
 
-typedef struct stream_data {
-    SIGNAL           signals[MAX_KEYS];
-    volatile VIBRATO vibrato;
-    volatile float   volume;
-    REVERB           reverb;
-} STREAM_DATA;
-
-static STREAM_DATA stream_data = {
-    {
-        {false, WAVE_e,
-            {DEFAULT_AMPLITUDE, C_FREQ, DEFAULT_PHASE},
-            {{}, 0}
-        },
-        {false, WAVE_e,
-            {DEFAULT_AMPLITUDE, Db_FREQ, DEFAULT_PHASE},
-            {{}, 0}
-        },
-        {false, WAVE_e,
-            {DEFAULT_AMPLITUDE, D_FREQ, DEFAULT_PHASE},
-            {{}, 0}
-        },
-        {false, WAVE_e,
-            {DEFAULT_AMPLITUDE, Eb_FREQ, DEFAULT_PHASE},
-            {{}, 0}
-        },
-        {false, WAVE_e,
-            {DEFAULT_AMPLITUDE, E_FREQ, DEFAULT_PHASE},
-            {{}, 0}
-        },
-        {false, WAVE_e,
-            {DEFAULT_AMPLITUDE, F_FREQ, DEFAULT_PHASE},
-            {{}, 0}
-        },
-        {false, WAVE_e,
-            {DEFAULT_AMPLITUDE, Gb_FREQ, DEFAULT_PHASE},
-            {{}, 0}
-        },
-        {false, WAVE_e,
-            {DEFAULT_AMPLITUDE, G_FREQ, DEFAULT_PHASE},
-            {{}, 0}
-        },
-        {false, WAVE_e,
-            {DEFAULT_AMPLITUDE, Ab_FREQ, DEFAULT_PHASE},
-            {{}, 0}
-        },
-        {false, WAVE_e,
-            {DEFAULT_AMPLITUDE, A_FREQ, DEFAULT_PHASE},
-            {{}, 0}
-        },
-        {false, WAVE_e,
-            {DEFAULT_AMPLITUDE, Bb_FREQ, DEFAULT_PHASE},
-            {{}, 0}
-        },
-        {false, WAVE_e,
-            {DEFAULT_AMPLITUDE, B_FREQ, DEFAULT_PHASE},
-            {{}, 0}
-        }
-    },
-    {DEFAULT_PHASE, 0},
-    MAX_VOLUME,
-    {false, 0, {0}}
-};
-
-static PaStream *stream;
-
 struct Sample {
     float* data;       // Interleaved stereo or mono
     int length;        // In frames
     int channels;
     int sampleRate;
-    volatile int position;      // Playback position
-    volatile bool playing;
+    int position;      // Playback position
+    float gain;        // Velocity of the current hit
+    bool playing;
 };
 
-static Sample kick_sample;
-static Sample snare_sample;
-static Sample hi_hat_sample;
+/*
+ * Everything in here belongs to the audio callback. The control side only
+ * talks to it through parameter snapshots (params.hpp), the event queue
+ * (events.hpp) and the expression targets below.
+ */
+typedef struct stream_data {
+    SIGNAL      signals[MAX_VOICES];
+    VOICE_POOL  voices;
+    SIGNAL_TYPE type;        // Given to every new voice
+    ENVELOPE_SETTINGS envelope;
+    float       pulse_width; // Of every SQUARE_e voice
+    FILTER_SETTINGS filter;
+    FILTER_BANK filters;
+    float       cutoff;      // Smoothed EXPR_CUTOFF
+    BLOCK       block;
+    SCRATCH     scratch[WORKER_THREADS];
+    MOD_SETTINGS mod;
+    LFO         lfos[MOD_LFOS];
+    float       sources[MOD_SRC_CNT]; // Global sources, end of the stretch
+    uint32_t    vibrato_left;         // Frames until MOD_SRC_VIBRATO is 0
+    uint32_t    vibrato_length;
+    float       volume;
+    REVERB      reverb;
+    CONVOLUTION conv;        // Loaded when [convolution] names a response
+    float       conv_wet;
+    const AUDIO_INPUT *input;    // Capture of the current block
+    unsigned int input_at;       // Frame of it the graph is on
+    float       input_gain;
+    float       input_send;
+    bool        input_filtered;
+    FILTER_BANK input_filter;    // Left and right, lanes 0 and 1 of group 0
+    v4f         input_lanes[MAX_PERIOD];
+    uint32_t    latency_min;     // Input to output, as measured, frames
+    uint32_t    latency_max;
+    METER_BLOCK meter;
+    float       bend_ratio; // Current pitch bend as a frequency ratio
+    float       bend_step;  // Per frame over the current block
+    float       level;
+    float       level_step;
+    Sample      samples[SAMPLE_CNT];
+
+    SEQ_STATE   seq;
+    uint64_t    applied;     // Serial of the last snapshot applied
+    GRAPH_PLAN  plan;
+    const TUNING_TABLE *tuning;
+    uint64_t    frame;       // Stream frame the current block starts on
+    float       rate;        // Sample rate of the open device
+    float       step_per_hz; // Phase step of 1 Hz at that rate, cycles
+    uint32_t    noise_state; // Karplus-Strong excitation
+} STREAM_DATA;
 
-static volatile bool vibrato;
-static float vibratoDepth;
+static STREAM_DATA stream_data;
 
-static int octave_increment;
+static const char *sample_names[SAMPLE_CNT] = {"kick", "snare", "hi hat"};
+
+static bool running;
+
+// Control-side view of the gates, trigger_gate() toggles them
+static std::atomic<uint16_t> gates;
+
+// Note each held key started, the octave may change before it is released
+static uint8_t key_notes[MAX_KEYS];
+
+// Written by the control side, picked up once per block by the callback
+static std::atomic<float> expression_targets[EXPR_CNT];
+static std::atomic<float> mod_sources[MOD_SRC_CNT];
+
+// Of the last block with input, frames
+static std::atomic<uint32_t> input_latency;
+
+// Ports of the nodes rendered here
+enum { VOICES_LEFT = 0, VOICES_RIGHT, VOICES_SEND };
+enum { MASTER_SYNTH_LEFT = 0, MASTER_SYNTH_RIGHT, MASTER_SAMPLES_LEFT,
+       MASTER_SAMPLES_RIGHT };
+
+/*
+ * Routing of the callback, edited under params_begin() and planned into the
+ * snapshot so a new plan lands on a block boundary with whatever else
+ * changed along with it.
+ */
+static GRAPH graph;
+static uint8_t voices_node, samples_node, reverb_node, convolution_node,
+               input_node, master_node;
+
+// Where the dry synth comes out, the voices or the input bus after them
+static uint8_t synth_node;
 
 float* loadWavFile(const char *path, int *numFrames, int *numChannels, int *sampleRate) {
     SF_INFO sfinfo;
@@ -176,367 +233,1139 @@ float* loadWavFile(const char *path, int *numFrames, int *numChannels, int *samp
     return data;
 }
 
-static void initialize_ks(SIGNAL *signal) {
-    int buffer_size = static_cast<int>(SAMPLE_RATE / signal->wave.frequency);
-    signal->ks.buffer.resize(buffer_size);
+// xorshift32: rand() takes a lock in glibc, not an option on the audio thread
+static float next_noise(STREAM_DATA *data) {
+    uint32_t x = data->noise_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    data->noise_state = x;
+    return static_cast<float>(x) / 4294967295.0f * 2.0f - 1.0f;
+}
+
+/*
+ * The loop of a string delays length - 0.5 samples (the two-point average)
+ * plus whatever the all-pass adds. Handing the fraction of the period to the
+ * all-pass instead of truncating it keeps high strings in tune.
+ */
+static void initialize_ks(STREAM_DATA *data, SIGNAL *signal) {
+    float period = std::clamp(data->tuning->period[signal->note] + 0.5f,
+                              1.0f + KS_MIN_FRACTION,
+                              static_cast<float>(KS_MAX_LENGTH));
+    int   buffer_size = static_cast<int>(period - KS_MIN_FRACTION);
+    float fraction    = period - buffer_size;
+
     for (int i = 0; i < buffer_size; ++i) {
-        signal->ks.buffer[i] = static_cast<float>((rand() / (float)RAND_MAX)
-                                                  * 2.0 - 1.0);
+        signal->ks.buffer[i] = next_noise(data);
+    }
+    signal->ks.length  = buffer_size;
+    signal->ks.index   = 0;
+    signal->ks.allpass = (1.0f - fraction) / (1.0f + fraction);
+    signal->ks.ap_in   = 0.0f;
+    signal->ks.ap_out  = 0.0f;
+}
+
+// Brings the callback state in line with a snapshot. Idempotent.
+static void apply_params(STREAM_DATA *data, const ENGINE_PARAMS *params) {
+    data->applied = params->serial;
+    data->volume  = params->volume;
+
+    // Sounding voices keep their note and type, new ones pick these up
+    data->tuning = params->tuning;
+    data->type   = params->type;
+
+    // Envelopes and pulses follow new settings from wherever they are
+    data->envelope    = params->envelope;
+    data->pulse_width = params->pulse_width;
+    data->filter      = params->filter;
+    data->mod         = params->mod;
+    data->plan        = params->graph;
+
+    // Start every reverb with an empty tail
+    if (params->reverb != data->reverb.enabled) {
+        data->reverb.enabled = params->reverb;
+        if (data->reverb.enabled) {
+            data->reverb.index = 0;
+            std::fill(data->reverb.buffer,
+                      data->reverb.buffer + data->reverb.length, 0.0f);
+        }
+    }
+}
+
+/*
+ * Works out every envelope over the next frames. A voice whose release ran
+ * out in an earlier stretch is dropped here, so voices that went quiet cost
+ * nothing from then on.
+ */
+static void run_envelopes(STREAM_DATA *data, unsigned int frames) {
+    VOICE_POOL *pool = &data->voices;
+    for (uint8_t a = pool->active_cnt; a-- > 0;) {
+        uint8_t voice  = pool->active[a];
+        SIGNAL *signal = &data->signals[voice];
+        if (!envelope_block(&signal->envelope, &data->envelope, data->rate,
+                            frames, &signal->gain, &signal->gain_step)) {
+            voices_free(pool, voice);
+            continue;
+        }
+
+        // Only its level is of use
+        float gain, step;
+        envelope_block(&signal->mod_envelope, &data->mod.envelope,
+                       data->rate, frames, &gain, &step);
     }
-    signal->ks.index = 0;
 }
 
-void compute_waves(STREAM_DATA *data, float *left_sample, float *right_sample) {
-    // Compute vibrato modulation if enabled
-    float vibratoMod = vibrato ? vibratoDepth * sinf(data->vibrato.vibratoPhase)
-                                 : 0.0f;
+// Moves the LFOs and the vibrato fade to the end of the stretch
+static void run_sources(STREAM_DATA *data, unsigned int frames) {
+    for (uint8_t l = 0; l < MOD_LFOS; l++) {
+        data->sources[MOD_SRC_LFO1 + l] =
+            mod_lfo_advance(&data->lfos[l],
+                            static_cast<LFO_SHAPE>(data->mod.lfo_shape[l]),
+                            data->mod.lfo_rate[l], data->rate, frames);
+    }
 
-    for (size_t i = 0; i < MAX_KEYS; i++) {
-        float sample = 0.0f;
+    data->vibrato_left -= std::min(data->vibrato_left, frames);
+    data->sources[MOD_SRC_VIBRATO] = static_cast<float>(data->vibrato_left)
+                                     / data->vibrato_length;
+}
 
-        // If normal wave:
-        if (data->signals[i].type == WAVE_e) {
-            // Add vibrato modulation to wave frequency if needed (FM mod.)
-            float current_frequency = data->signals[i].wave.frequency
-                                      + vibratoMod;
+// Matrix output for a voice, from the global sources and its envelopes
+static void modulate(STREAM_DATA *data, const SIGNAL *signal, float *dest) {
+    float sources[MOD_SRC_CNT];
+    std::copy(data->sources, data->sources + MOD_SRC_CNT, sources);
+    sources[MOD_SRC_ENVELOPE]     = envelope_amount(&signal->envelope);
+    sources[MOD_SRC_MOD_ENVELOPE] = envelope_amount(&signal->mod_envelope);
+    mod_evaluate(&data->mod, sources, dest);
+}
 
-            // Generate wave (sine wave is the only one supported at the moment)
-            sample = data->signals[i].gate
-                     ? data->volume * data->signals[i].wave.amplitude
-                       * sinf(data->signals[i].wave.phase)
-                     : 0.0f;
+static void apply_event(STREAM_DATA *data, const EVENT *event) {
+    switch (event->type) {
+        case EV_NOTE_ON: {
+            if (event->index >= TUNING_NOTES) {
+                break;
+            }
 
-            // Update wave phase
-            data->signals[i].wave.phase += 2.0f * (float)M_PI
-                                           * current_frequency / SAMPLE_RATE;
-            if (data->signals[i].wave.phase >= 2.0f * (float)M_PI) {
-                data->signals[i].wave.phase -= 2.0f * (float)M_PI;
+            // A retriggered note keeps its tail on its own voice
+            uint8_t old = voices_release(&data->voices, event->index);
+            if (old != VOICE_NONE) {
+                envelope_release(&data->signals[old].envelope);
+                envelope_release(&data->signals[old].mod_envelope);
             }
-        }
 
-        // If Karplus-Strong synthesis:
-        else if (data->signals[i].type == KS_e) {
-            if (data->signals[i].gate) {
-                // Apply Karplus-Strong feedback
-                float first = data->signals[i].ks.buffer[data->signals[i].ks.index];
-                float next  = data->signals[i].ks.buffer[(data->signals[i].ks.index + 1)
-                              % data->signals[i].ks.buffer.size()];
-                float new_sample = KS_DECAY * 0.5f * (first + next);
+            uint8_t voice  = voices_start(&data->voices, event->index);
+            SIGNAL *signal = &data->signals[voice];
+            signal->velocity = event->value;
+            signal->type     = data->type;
+            signal->note     = event->index;
+            signal->wave     = {DEFAULT_AMPLITUDE, DEFAULT_PHASE};
 
-                data->signals[i].ks.buffer[data->signals[i].ks.index] = new_sample;
-                sample = data->volume * new_sample;
+            // A stolen voice goes on from where it was, filter included
+            if (signal->envelope.stage == ENV_IDLE) {
+                filter_reset(&data->filters, voice);
+            }
+            envelope_start(&signal->envelope);
+            envelope_start(&signal->mod_envelope);
+
+            // Nothing to ramp from on the first stretch
+            modulate(data, signal, signal->mod);
 
-                data->signals[i].ks.index = (data->signals[i].ks.index + 1) % data->signals[i].ks.buffer.size();
+            // Every pluck needs a fresh excitation
+            if (signal->type == KS_e) {
+                initialize_ks(data, signal);
             }
+            break;
         }
 
-        else {
-            std::cout << "Key " << i << " is configured to invalid signal type"
-                      << std::endl;
-            continue;
+        case EV_NOTE_OFF: {
+            if (event->index >= TUNING_NOTES) {
+                break;
+            }
+
+            uint8_t voice = voices_release(&data->voices, event->index);
+            if (voice != VOICE_NONE) {
+                envelope_release(&data->signals[voice].envelope);
+                envelope_release(&data->signals[voice].mod_envelope);
+            }
+            break;
         }
 
-        // Compute reverb effect if enabled
-        if (data->reverb.enabled) {
-            float reverb = data->reverb.buffer[data->reverb.index];
-            sample += REVERB_DECAY * reverb;
-            data->reverb.buffer[data->reverb.index] = sample;
-
-            if (sample > 1.0f) {
-                sample = 1.0f;
-            } else if (sample < -1.0f) {
-                sample = -1.0f;
+        case EV_SAMPLE:
+            if (event->index < SAMPLE_CNT) {
+                data->samples[event->index].position = 0;
+                data->samples[event->index].gain     = event->value;
+                data->samples[event->index].playing  = true;
             }
+            break;
+
+        case EV_VIBRATO:
+            data->vibrato_left = data->vibrato_length;
+            break;
 
-            data->reverb.index = (data->reverb.index + 1) % SAMPLE_RATE;
+        case EV_LOOPER:
+            looper_apply(static_cast<LOOPER_COMMAND>(event->index));
+            break;
+    }
+}
+
+// One stretch of a voice into scratch.voice, before any gain. mod is the
+// matrix output at the end of the stretch.
+static void render_voice(STREAM_DATA *data, SCRATCH *scratch, SIGNAL *signal,
+                         const float *mod, unsigned int frames) {
+    BLOCK *block = &data->block;
+    float *out   = scratch->voice;
+
+    // If Karplus-Strong synthesis: the string sets its own pitch
+    if (signal->type == KS_e) {
+        KS *ks = &signal->ks;
+        for (unsigned int i = 0; i < frames; i++) {
+            // Apply Karplus-Strong feedback
+            float first = ks->buffer[ks->index];
+            float next  = ks->buffer[(ks->index + 1) % ks->length];
+            float averaged = KS_DECAY * 0.5f * (first + next);
+            float new_sample = ks->allpass * (averaged - ks->ap_out)
+                               + ks->ap_in;
+            ks->ap_in  = averaged;
+            ks->ap_out = new_sample;
+
+            ks->buffer[ks->index] = new_sample;
+            out[i] = new_sample;
+
+            ks->index = (ks->index + 1) % ks->length;
         }
+        return;
+    }
 
-        // Save the sample for this signal into left and right full sample
-        *left_sample  += sample;
-        *right_sample += sample;
+    // Waves follow the pitch modulation and the pitch bend
+    float note_step  = data->tuning->step[signal->note];
+    float pitch      = exp2f(signal->mod[MOD_PITCH] / 12.0f);
+    float pitch_step = (exp2f(mod[MOD_PITCH] / 12.0f) - pitch) / frames;
+    for (unsigned int i = 0; i < frames; i++) {
+        pitch += pitch_step;
+        scratch->step[i] = note_step * pitch * block->bend[i];
     }
 
-    // Update vibrato phase
-    data->vibrato.vibratoPhase += 2.0f * (float)M_PI * VIBRATO_FREQUENCY
-                                  / SAMPLE_RATE;
-    if (data->vibrato.vibratoPhase >= 2.0f * (float)M_PI) {
-        data->vibrato.vibratoPhase -= 2.0f * (float)M_PI;
+    switch (signal->type) {
+        case SAW_e:
+            osc_saw(&signal->wave.phase, scratch->step, out, frames);
+            break;
+
+        case SQUARE_e:
+            osc_pulse(&signal->wave.phase, scratch->step,
+                      data->pulse_width + mod[MOD_WIDTH], out, frames);
+            break;
+
+        case TRIANGLE_e:
+            osc_triangle(&signal->wave.phase, scratch->step, out, frames);
+            break;
+
+        default:
+            // Sine, nothing to band-limit
+            for (unsigned int i = 0; i < frames; i++) {
+                out[i] = sinf(2.0f * (float)M_PI * signal->wave.phase);
+                signal->wave.phase += scratch->step[i];
+                if (signal->wave.phase >= 1.0f) {
+                    signal->wave.phase -= 1.0f;
+                }
+            }
+            break;
     }
 }
 
-// Audio callback function
-static int audioCallback(const void *inputBuffer, void *outputBuffer,
-                         unsigned long framesPerBuffer,
-                         const PaStreamCallbackTimeInfo *timeInfo,
-                         PaStreamCallbackFlags statusFlags,
-                         void *userData) {
-    STREAM_DATA *data = (STREAM_DATA *)userData;
-    float       *out  = (float *)outputBuffer;
+// Amplitude, pan and reverb send of a voice, as ramped by mix_voice()
+static void mix_levels(const float *mod, float *amp, float *pan, float *send) {
+    *amp  = exp2f(mod[MOD_AMP] * (3.3219281f / 20.0f));
+    *pan  = std::clamp(mod[MOD_PAN], -1.0f, 1.0f);
+    *send = std::clamp(1.0f + mod[MOD_REVERB], 0.0f, 1.0f);
+}
+
+/*
+ * Scales a rendered voice by its gain, envelope and amplitude modulation and
+ * pans it into the block, with its share of the reverb send. The center
+ * keeps both sides at full level.
+ */
+static void mix_voice(STREAM_DATA *data, const SCRATCH *scratch,
+                      uint8_t voice, float *const *out, unsigned int frames) {
+    BLOCK       *block  = &data->block;
+    SIGNAL      *signal = &data->signals[voice];
+    const float *mod    = block->mod[voice];
+
+    float amp, pan, send, amp_end, pan_end, send_end;
+    mix_levels(signal->mod, &amp, &pan, &send);
+    mix_levels(mod, &amp_end, &pan_end, &send_end);
+    float amp_step  = (amp_end - amp) / frames;
+    float pan_step  = (pan_end - pan) / frames;
+    float send_step = (send_end - send) / frames;
+
+    // Strings are as loud as their excitation, waves get an amplitude
+    float scale = data->volume * signal->velocity
+                  * (signal->type == KS_e ? 1.0f : signal->wave.amplitude);
+    float gain   = signal->gain;
+    float peak   = 0.0f;
+    float sum_sq = 0.0f;
+    for (unsigned int i = 0; i < frames; i++) {
+        amp  += amp_step;
+        pan  += pan_step;
+        send += send_step;
+
+        float sample = scale * gain * amp * scratch->voice[i];
+        gain *= signal->gain_step;
+
+        peak    = fmaxf(peak, fabsf(sample));
+        sum_sq += sample * sample;
+        out[VOICES_LEFT][i]  += sample * fminf(1.0f, 1.0f - pan);
+        out[VOICES_RIGHT][i] += sample * fminf(1.0f, 1.0f + pan);
+        out[VOICES_SEND][i]  += sample * send;
+    }
+    signal->gain = gain;
+
+    block->peak[voice]   = peak;
+    block->sum_sq[voice] = sum_sq;
+}
 
-    for (unsigned int i = 0; i < framesPerBuffer; i++) {
-        /***********************************************************************
-         ************************ Sample playback logic ************************
-         **********************************************************************/
+// Filter coefficients of a voice for the stretch, from the smoothed cutoff
+static void tune_filter(STREAM_DATA *data, uint8_t voice, const float *mod) {
+    const TUNING_TABLE *tuning = data->tuning;
+    float track = tuning->frequency[data->signals[voice].note]
+                  / tuning->frequency[TUNING_NOTE(0, 0)];
+    float hz    = filter_cutoff_hz(data->cutoff)
+                  * powf(track, data->filter.key_track)
+                  * exp2f(mod[MOD_CUTOFF]);
+
+    filter_tune(&data->filters, voice,
+                static_cast<FILTER_MODE>(data->filter.mode),
+                hz * data->step_per_hz, data->filter.resonance);
+}
 
-        // Mix sample playback (kick) if active
-        float left_kick_sample  = 0.0f;
-        float right_kick_sample = 0.0f;
-        if (kick_sample.playing && kick_sample.position < kick_sample.length) {
-            left_kick_sample = kick_sample.data[kick_sample.position * kick_sample.channels];    // Left
-            right_kick_sample = kick_sample.data[kick_sample.position * kick_sample.channels + 1];// Right
+/*
+ * One filter group of the stretch, on whichever thread picked it up. Each
+ * voice is worked out on its own, the filter then runs on the four at once.
+ */
+static void render_group(void *ctx, uint8_t task, uint8_t thread) {
+    STREAM_DATA *data     = static_cast<STREAM_DATA *>(ctx);
+    BLOCK       *block    = &data->block;
+    SCRATCH     *scratch  = &data->scratch[thread];
+    unsigned int frames   = block->frames;
+    bool         filtered = data->filter.mode != FILTER_OFF;
+    uint8_t      group    = block->groups[task];
+    uint8_t      first    = group * FILTER_LANES;
+
+    float *partial[3] = {scratch->partial[0], scratch->partial[1],
+                         scratch->partial[2]};
+    float *const *out = thread ? partial : block->out;
+    if (!scratch->used) {
+        for (uint8_t p = VOICES_LEFT; p <= VOICES_SEND; p++) {
+            std::fill(out[p], out[p] + frames, 0.0f);
+        }
+        scratch->used = true;
+    }
 
-            // Advance sample positions
-            kick_sample.position++;
-            if (kick_sample.position >= kick_sample.length) {
-                kick_sample.playing = false;
+    for (uint8_t lane = 0; lane < FILTER_LANES; lane++) {
+        uint8_t voice = first + lane;
+        if (!block->sounding[voice]) {
+            if (filtered) {
+                for (unsigned int i = 0; i < frames; i++) {
+                    scratch->lanes[i][lane] = 0.0f;
+                }
             }
+            continue;
         }
 
-        float left_snare_sample  = 0.0f;
-        float right_snare_sample = 0.0f;
-        if (snare_sample.playing && snare_sample.position < snare_sample.length) {
-            left_snare_sample = snare_sample.data[snare_sample.position * snare_sample.channels];    // Left
-            right_snare_sample = snare_sample.data[snare_sample.position * snare_sample.channels + 1];// Right
+        modulate(data, &data->signals[voice], block->mod[voice]);
+        render_voice(data, scratch, &data->signals[voice], block->mod[voice],
+                     frames);
+        if (!filtered) {
+            mix_voice(data, scratch, voice, out, frames);
+            continue;
+        }
 
-            // Advance sample positions
-            snare_sample.position++;
-            if (snare_sample.position >= snare_sample.length) {
-                snare_sample.playing = false;
-            }
+        tune_filter(data, voice, block->mod[voice]);
+        for (unsigned int i = 0; i < frames; i++) {
+            scratch->lanes[i][lane] = scratch->voice[i];
+        }
+    }
+
+    if (!filtered) {
+        return;
+    }
+
+    filter_run(&data->filters, group, scratch->lanes, frames);
+    for (uint8_t lane = 0; lane < FILTER_LANES; lane++) {
+        if (!block->sounding[first + lane]) {
+            continue;
+        }
+        for (unsigned int i = 0; i < frames; i++) {
+            scratch->voice[i] = scratch->lanes[i][lane];
+        }
+        mix_voice(data, scratch, first + lane, out, frames);
+    }
+}
+
+/*
+ * Sums one stretch of every sounding voice into out. Voices go by filter
+ * group so each group is filtered in one pass; the allocator hands out the
+ * lowest voices first, so groups with nothing sounding are skipped and the
+ * filter cost follows the polyphony in use. Groups share nothing but what
+ * is read here, so with render workers they are spread over the cores and
+ * their partial mixes summed at the end.
+ *
+ * The matrix is evaluated once per voice and stretch, for its end; every
+ * destination moves there in a straight line from the last evaluation.
+ */
+static void compute_waves(STREAM_DATA *data, float *const *out,
+                          unsigned int frames) {
+    BLOCK *block = &data->block;
+    block->frames = frames;
+    std::copy(out, out + 3, block->out);
+
+    std::fill(block->sounding, block->sounding + MAX_VOICES, false);
+    for (uint8_t a = 0; a < data->voices.active_cnt; a++) {
+        block->sounding[data->voices.active[a]] = true;
+    }
+
+    block->group_cnt = 0;
+    for (uint8_t group = 0; group < FILTER_GROUPS; group++) {
+        const bool *lanes = block->sounding + group * FILTER_LANES;
+        if (std::any_of(lanes, lanes + FILTER_LANES,
+                        [](bool s) { return s; })) {
+            block->groups[block->group_cnt++] = group;
         }
+    }
 
-        float left_hi_hat_sample  = 0.0f;
-        float right_hi_hat_sample = 0.0f;
-        if (hi_hat_sample.playing && hi_hat_sample.position < hi_hat_sample.length) {
-            left_hi_hat_sample = hi_hat_sample.data[hi_hat_sample.position * hi_hat_sample.channels];    // Left
-            right_hi_hat_sample = hi_hat_sample.data[hi_hat_sample.position * hi_hat_sample.channels + 1];// Right
+    // Nothing sounding still leaves silence behind
+    for (uint8_t p = VOICES_LEFT; p <= VOICES_SEND; p++) {
+        std::fill(out[p], out[p] + frames, 0.0f);
+    }
+    data->scratch[0].used = true;
+    for (uint8_t t = 1; t < WORKER_THREADS; t++) {
+        data->scratch[t].used = false;
+    }
 
-            // Advance sample positions
-            hi_hat_sample.position++;
-            if (hi_hat_sample.position >= hi_hat_sample.length) {
-                hi_hat_sample.playing = false;
+    workers_run(render_group, data, block->group_cnt);
+
+    for (uint8_t t = 1; t < WORKER_THREADS; t++) {
+        if (!data->scratch[t].used) {
+            continue;
+        }
+        for (uint8_t p = VOICES_LEFT; p <= VOICES_SEND; p++) {
+            const float *partial = data->scratch[t].partial[p];
+            for (unsigned int i = 0; i < frames; i++) {
+                out[p][i] += partial[i];
             }
         }
+    }
+
+    // Every voice ramped to where it now stands. Level taps: stealing looks
+    // at the voice, the meter at its key.
+    for (uint8_t a = 0; a < data->voices.active_cnt; a++) {
+        uint8_t voice = data->voices.active[a];
+        std::copy(block->mod[voice], block->mod[voice] + MOD_DEST_CNT,
+                  data->signals[voice].mod);
+
+        uint8_t key = data->signals[voice].note % MAX_KEYS;
+        data->voices.peak[voice]    = fmaxf(data->voices.peak[voice],
+                                            block->peak[voice]);
+        data->meter.voice_peak[key] = fmaxf(data->meter.voice_peak[key],
+                                            block->peak[voice]);
+        data->meter.voice_sum_sq[key] += block->sum_sq[voice];
+    }
+}
+
+// Synth node: every voice, dry and panned, plus the summed reverb send
+static void process_voices(void *ctx, const float *const *in,
+                           float *const *out, unsigned int frames) {
+    STREAM_DATA *data  = static_cast<STREAM_DATA *>(ctx);
+    BLOCK       *block = &data->block;
+    run_envelopes(data, frames);
+    run_sources(data, frames);
+
+    // Pitch bend every wave voice follows, frame by frame
+    for (unsigned int i = 0; i < frames; i++) {
+        data->bend_ratio += data->bend_step;
+        block->bend[i]    = data->bend_ratio;
+    }
+
+    compute_waves(data, out, frames);
+}
+
+// Comb on the sends, added to the dry voices. Out of the routing when off.
+static void process_reverb(void *ctx, const float *const *in,
+                           float *const *out, unsigned int frames) {
+    REVERB *reverb = &static_cast<STREAM_DATA *>(ctx)->reverb;
+    for (unsigned int i = 0; i < frames; i++) {
+        float wet = REVERB_DECAY * reverb->buffer[reverb->index];
+        reverb->buffer[reverb->index] = in[VOICES_SEND][i] + wet;
+        out[0][i] = std::clamp(in[VOICES_LEFT][i] + wet, -1.0f, 1.0f);
+        out[1][i] = std::clamp(in[VOICES_RIGHT][i] + wet, -1.0f, 1.0f);
+
+        reverb->index = (reverb->index + 1) % reverb->length;
+    }
+}
+
+static void mix_sample(Sample *sample, float *left, float *right) {
+    if (!sample->playing || sample->position >= sample->length) {
+        return;
+    }
+
+    const float *frame = &sample->data[sample->position * sample->channels];
+    *left  += sample->gain * frame[0];
+    *right += sample->gain * (sample->channels > 1 ? frame[1] : frame[0]);
+
+    // Advance sample positions
+    sample->position++;
+    if (sample->position >= sample->length) {
+        sample->playing = false;
+    }
+}
+
+// Response on the sends, added to the dry synth. Only routed with one loaded.
+static void process_convolution(void *ctx, const float *const *in,
+                                float *const *out, unsigned int frames) {
+    STREAM_DATA *data = static_cast<STREAM_DATA *>(ctx);
+    std::copy(in[VOICES_LEFT], in[VOICES_LEFT] + frames, out[0]);
+    std::copy(in[VOICES_RIGHT], in[VOICES_RIGHT] + frames, out[1]);
+    conv_process(&data->conv, in[VOICES_SEND], out[0], out[1],
+                 data->conv_wet, frames);
+}
+
+/*
+ * Capture added onto the dry voices, with its share of the sends. It is
+ * read where the backend left it, from the frame the graph is on.
+ */
+static void process_input(void *ctx, const float *const *in,
+                          float *const *out, unsigned int frames) {
+    STREAM_DATA *data = static_cast<STREAM_DATA *>(ctx);
+    for (uint8_t p = VOICES_LEFT; p <= VOICES_SEND; p++) {
+        std::copy(in[p], in[p] + frames, out[p]);
+    }
+
+    const AUDIO_INPUT *input = data->input;
+    if (!input->channels) {
+        return;
+    }
+    uint32_t     stride = input->stride;
+    const float *left   = input->channel[0] + data->input_at * stride;
+    const float *right  = input->channel[input->channels > 1 ? 1 : 0]
+                          + data->input_at * stride;
+    float        gain   = data->input_gain;
+    float        send   = 0.5f * data->input_send;
+
+    if (!data->input_filtered || data->filter.mode == FILTER_OFF) {
+        for (unsigned int i = 0; i < frames; i++) {
+            float l = gain * left[i * stride];
+            float r = gain * right[i * stride];
+            out[VOICES_LEFT][i]  += l;
+            out[VOICES_RIGHT][i] += r;
+            out[VOICES_SEND][i]  += send * (l + r);
+        }
+        return;
+    }
+
+    // Both sides at the pot cutoff, nothing to track
+    float cutoff = filter_cutoff_hz(data->cutoff) * data->step_per_hz;
+    for (uint8_t c = 0; c < AUDIO_CHANNELS; c++) {
+        filter_tune(&data->input_filter, c,
+                    static_cast<FILTER_MODE>(data->filter.mode), cutoff,
+                    data->filter.resonance);
+    }
 
-        /***********************************************************************
-         ************************ Wave generation logic ************************
-         **********************************************************************/
+    v4f *lanes = data->input_lanes;
+    for (unsigned int i = 0; i < frames; i++) {
+        lanes[i] = v4f{left[i * stride], right[i * stride], 0.0f, 0.0f};
+    }
+    filter_run(&data->input_filter, 0, lanes, frames);
+    for (unsigned int i = 0; i < frames; i++) {
+        float l = gain * lanes[i][0];
+        float r = gain * lanes[i][1];
+        out[VOICES_LEFT][i]  += l;
+        out[VOICES_RIGHT][i] += r;
+        out[VOICES_SEND][i]  += send * (l + r);
+    }
+}
 
-        float left_wave_samples = 0.0f;
-        float right_wave_samples = 0.0f;
-        compute_waves(data, &left_wave_samples, &right_wave_samples);
+// Drum samples, stereo
+static void process_samples(void *ctx, const float *const *in,
+                            float *const *out, unsigned int frames) {
+    STREAM_DATA *data = static_cast<STREAM_DATA *>(ctx);
+    for (unsigned int i = 0; i < frames; i++) {
+        float left  = 0.0f;
+        float right = 0.0f;
+        for (size_t s = 0; s < SAMPLE_CNT; s++) {
+            mix_sample(&data->samples[s], &left, &right);
+        }
+        out[0][i] = left;
+        out[1][i] = right;
+    }
+}
 
-        /***********************************************************************
-         ************************** Writing to output **************************
-         **********************************************************************/
+// Master bus: the synth under the level control, the samples as they are
+static void process_master(void *ctx, const float *const *in,
+                           float *const *out, unsigned int frames) {
+    STREAM_DATA *data = static_cast<STREAM_DATA *>(ctx);
+    for (unsigned int i = 0; i < frames; i++) {
+        data->level += data->level_step;
+
+        out[0][i] = in[MASTER_SYNTH_LEFT][i] * data->level
+                    + in[MASTER_SAMPLES_LEFT][i];
+        out[1][i] = in[MASTER_SYNTH_RIGHT][i] * data->level
+                    + in[MASTER_SAMPLES_RIGHT][i];
+    }
+}
 
-        *out++ = left_wave_samples + left_kick_sample + left_snare_sample
-                 + left_hi_hat_sample;
-        *out++ = right_wave_samples + right_kick_sample + right_snare_sample
-                 + right_hi_hat_sample;
+/*
+ * Sets the synth path for the reverb setting and plans the graph into the
+ * snapshot being edited. Control side, between params_begin() and commit.
+ */
+static bool route(ENGINE_PARAMS *params) {
+    uint8_t synth = params->reverb ? reverb_node : synth_node;
+    if (convolution_node != GRAPH_NONE) {
+        graph_connect(&graph, synth, 0, convolution_node, VOICES_LEFT);
+        graph_connect(&graph, synth, 1, convolution_node, VOICES_RIGHT);
+        synth = convolution_node;
     }
+    graph_connect(&graph, synth, 0, master_node, MASTER_SYNTH_LEFT);
+    graph_connect(&graph, synth, 1, master_node, MASTER_SYNTH_RIGHT);
 
-    if (vibrato) {
-        data->vibrato.repetitions_left--;
-        if (data->vibrato.repetitions_left == 0) {
-            vibrato = false;
-            std::cout << "Vibrato ended\n";
+    if (graph_plan(&graph, &params->graph) != GRAPH_SUCCESS) {
+        std::cerr << "Audio graph can't be planned" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static void build_graph() {
+    graph_reset(&graph);
+    voices_node  = graph_add(&graph, "voices", process_voices, &stream_data,
+                             0, 3);
+    samples_node = graph_add(&graph, "samples", process_samples, &stream_data,
+                             0, 2);
+    reverb_node  = graph_add(&graph, "reverb", process_reverb, &stream_data,
+                             3, 2);
+    master_node  = graph_add(&graph, "master", process_master, &stream_data,
+                             4, 2);
+
+    // Capture joins the voices before any effect
+    input_node = GRAPH_NONE;
+    synth_node = voices_node;
+    if (audio_input_channels()) {
+        input_node = graph_add(&graph, "input", process_input, &stream_data,
+                               3, 3);
+        for (uint8_t p = VOICES_LEFT; p <= VOICES_SEND; p++) {
+            graph_connect(&graph, voices_node, p, input_node, p);
         }
+        synth_node = input_node;
+    }
+
+    // Next to the comb, after it when both are on
+    convolution_node = GRAPH_NONE;
+    if (stream_data.conv.loaded) {
+        convolution_node = graph_add(&graph, "convolution",
+                                     process_convolution, &stream_data, 3, 2);
+        graph_connect(&graph, synth_node, VOICES_SEND, convolution_node,
+                      VOICES_SEND);
     }
 
-    return paContinue;
+    for (uint8_t p = VOICES_LEFT; p <= VOICES_SEND; p++) {
+        graph_connect(&graph, synth_node, p, reverb_node, p);
+    }
+    graph_connect(&graph, samples_node, 0, master_node, MASTER_SAMPLES_LEFT);
+    graph_connect(&graph, samples_node, 1, master_node, MASTER_SAMPLES_RIGHT);
+    graph.output = master_node;
 }
 
-uint8_t init_sound() {
-    PaError err;
+// Audio callback, whichever backend drives it
+static void render_block(const AUDIO_INPUT *in, float *out,
+                         unsigned int framesPerBuffer, void *userData) {
+    STREAM_DATA *data  = (STREAM_DATA *)userData;
+    uint64_t     start = data->frame;
+    uint64_t     end   = start + framesPerBuffer;
+
+    events_clock(start);
+
+    // Read in place by the input node, only for this block
+    data->input = in;
+    if (in->channels) {
+        data->latency_min = std::min(data->latency_min, in->latency);
+        data->latency_max = std::max(data->latency_max, in->latency);
+        input_latency.store(in->latency, std::memory_order_relaxed);
+        detect_write(in, framesPerBuffer);
+    }
 
-    // For random -> Karplus-Strong
-    srand(time(nullptr));
+    // One snapshot per block, applied on the frame it was stamped with. A
+    // snapshot stamped past this block waits for the next one; the state
+    // from the previous snapshot stays in place until then.
+    const ENGINE_PARAMS *params = params_acquire();
+    // A snapshot stays current over many blocks, it is only applied once
+    bool params_pending = params->serial != data->applied
+                          && params->frame < end;
+    unsigned int params_at = params->frame > start
+                             ? static_cast<unsigned int>(params->frame - start)
+                             : 0;
+
+    // Continuous controls move linearly from last block's value to the
+    // current target, so sparse updates (e.g. 30 fps camera) don't zipper
+    float bend_end   = exp2f((expression_targets[EXPR_PITCH_BEND]
+                              .load(std::memory_order_relaxed)
+                              + expression_targets[EXPR_HAND_BEND]
+                                .load(std::memory_order_relaxed)) / 12.0f);
+    float level_end  = expression_targets[EXPR_LEVEL]
+                       .load(std::memory_order_relaxed);
+    data->bend_step  = (bend_end - data->bend_ratio) / framesPerBuffer;
+    data->level_step = (level_end - data->level) / framesPerBuffer;
+
+    // The cutoff glides instead, filter coefficients are only worked out
+    // once per stretch
+    float cutoff_end = expression_targets[EXPR_CUTOFF]
+                       .load(std::memory_order_relaxed);
+    data->cutoff += (cutoff_end - data->cutoff)
+                    * (1.0f - expf(-1000.0f * framesPerBuffer
+                                   / (CUTOFF_GLIDE_MS * data->rate)));
+
+    // Controllers are read once per block like the expressions, the matrix
+    // smooths them out
+    for (uint8_t s = MOD_SRC_WHEEL; s < MOD_SRC_CNT; s++) {
+        data->sources[s] = mod_sources[s].load(std::memory_order_relaxed);
+    }
 
-    kick_sample.data = loadWavFile(KICK_SAMPLE_PATH,
-                                   &kick_sample.length,
-                                   &kick_sample.channels,
-                                   &kick_sample.sampleRate);
-    kick_sample.position = 0;
-    kick_sample.playing = false;
+    // Pattern steps due in this block, merged with the queued events below
+    EVENT   seq_events[SEQ_MAX_EVENTS];
+    uint8_t seq_count = seq_render(&data->seq, &params->seq, params->octave,
+                                   start, end, seq_events);
+    uint8_t seq_next  = 0;
+
+    // Split the block at every event boundary
+    unsigned int frame = 0;
+    while (frame < framesPerBuffer) {
+        if (params_pending && params_at <= frame) {
+            apply_params(data, params);
+            params_pending = false;
+        }
 
-    if (kick_sample.sampleRate != SAMPLE_RATE) {
-        fprintf(stderr, "Warning: kick sample rate mismatch (sample: %d, stream: %d)\n",
-                kick_sample.sampleRate, SAMPLE_RATE);
-        return 1;
+        EVENT event;
+        while (events_pop(start + frame + 1, &event)) {
+            apply_event(data, &event);
+        }
+        while (seq_next < seq_count
+               && seq_events[seq_next].frame <= start + frame) {
+            apply_event(data, &seq_events[seq_next++]);
+        }
+
+        // The matrix runs at least every MOD_BLOCK frames
+        unsigned int next = std::min(framesPerBuffer, frame + MOD_BLOCK);
+        if (params_pending) {
+            next = std::min(next, params_at);
+        }
+
+        // Anything posted meanwhile with a stale stamp waits one frame
+        uint64_t due = std::max(events_next_due(), start + frame + 1);
+        if (seq_next < seq_count) {
+            due = std::min(due, seq_events[seq_next].frame);
+        }
+        if (due < end) {
+            next = std::min(next, static_cast<unsigned int>(due - start));
+        }
+
+        data->input_at = frame;
+        graph_run(&data->plan, out + 2 * frame, next - frame);
+        looper_process(out + 2 * frame, next - frame);
+        frame = next;
     }
 
-    snare_sample.data = loadWavFile(SNARE_SAMPLE_PATH,
-                                    &snare_sample.length,
-                                    &snare_sample.channels,
-                                    &snare_sample.sampleRate);
-    snare_sample.position = 0;
-    snare_sample.playing = false;
+    // Land exactly on the targets, no rounding drift across blocks
+    data->bend_ratio = bend_end;
+    data->level      = level_end;
+
+    // Stealing in the next block compares the whole of this one
+    voices_block_done(&data->voices);
+
+    // The master meter reads what is played, loop layers included, so the
+    // clip light sees anything the looper pushes over
+    for (unsigned int i = 0; i < 2 * framesPerBuffer; i += 2) {
+        float left  = out[i];
+        float right = out[i + 1];
+        data->meter.master_peak    = fmaxf(data->meter.master_peak,
+                                           fmaxf(fabsf(left), fabsf(right)));
+        data->meter.master_sum_sq += 0.5f * (left * left + right * right);
+    }
+
+    // Bounce the finished block, the writer thread takes it from here
+    recorder_write(out, framesPerBuffer);
+
+    // Hand the block summary to the meters and start a new one
+    data->meter.frames = framesPerBuffer;
+    meter_publish(data->meter);
+    data->meter = {};
+
+    data->frame = end;
+    params_release();
+}
 
-    if (snare_sample.sampleRate != SAMPLE_RATE) {
-        fprintf(stderr, "Warning: snare sample rate mismatch (sample: %d, stream: %d)\n",
-                snare_sample.sampleRate, SAMPLE_RATE);
+uint8_t init_sound() {
+    // The device decides the final rate and period, open it first
+    if (audio_open(audio_default_config(), render_block, &stream_data)) {
+        return 1;
+    }
+    stream_data.rate              = audio_sample_rate();
+    stream_data.step_per_hz    = 1.0f / stream_data.rate;
+    stream_data.vibrato_left   = 0;
+    stream_data.vibrato_length = static_cast<uint32_t>(VIBRATO_SECONDS
+                                                       * stream_data.rate);
+
+    // Every pitch comes out of the table, built for the rate just settled on
+    if (init_tuning()) {
+        audio_close();
         return 1;
     }
+    stream_data.tuning      = tuning_current();
+    stream_data.type        = WAVE_e;
+    stream_data.envelope    = config()->envelope;
+    stream_data.pulse_width = config()->pulse_width;
+    stream_data.filter      = config()->filter;
+    stream_data.cutoff      = 1.0f;
+    stream_data.mod         = config()->mod;
+    std::fill(stream_data.sources, stream_data.sources + MOD_SRC_CNT, 0.0f);
+    stream_data.sources[MOD_SRC_NONE] = 1.0f;
+    for (uint8_t s = 0; s < MOD_SRC_CNT; s++) {
+        mod_sources[s] = 0.0f;
+    }
+    voices_reset(&stream_data.voices, config()->voices,
+                 static_cast<VOICE_STEAL>(config()->voice_steal));
 
-    hi_hat_sample.data = loadWavFile(HI_HAT_SAMPLE_PATH,
-                                     &hi_hat_sample.length,
-                                     &hi_hat_sample.channels,
-                                     &hi_hat_sample.sampleRate);
-    hi_hat_sample.position = 0;
-    hi_hat_sample.playing = false;
+    // For Karplus-Strong excitation
+    stream_data.noise_state = static_cast<uint32_t>(time(nullptr)) | 1;
+    for (uint8_t l = 0; l < MOD_LFOS; l++) {
+        mod_lfo_reset(&stream_data.lfos[l], stream_data.noise_state + 2 * l);
+    }
 
-    if (hi_hat_sample.sampleRate != SAMPLE_RATE) {
-        fprintf(stderr, "Warning: hi hat sample rate mismatch (sample: %d, stream: %d)\n",
-                hi_hat_sample.sampleRate, SAMPLE_RATE);
-        return 1;
+    expression_targets[EXPR_PITCH_BEND] = 0.0f;
+    expression_targets[EXPR_HAND_BEND]  = 0.0f;
+    expression_targets[EXPR_LEVEL]      = 1.0f;
+    expression_targets[EXPR_CUTOFF]     = 1.0f;
+
+    for (size_t v = 0; v < MAX_VOICES; v++) {
+        SIGNAL *signal = &stream_data.signals[v];
+        signal->velocity = 1.0f;
+        signal->type = WAVE_e;
+        signal->note = TUNING_NOTE(0, 0);
+        signal->wave = {DEFAULT_AMPLITUDE, DEFAULT_PHASE};
+        signal->envelope     = {ENV_IDLE, ENV_FLOOR_DB};
+        signal->mod_envelope = {ENV_IDLE, ENV_FLOOR_DB};
     }
+    stream_data.volume        = MAX_VOLUME;
+    stream_data.bend_ratio    = 1.0f;
+    stream_data.level         = 1.0f;
+    stream_data.frame         = 0;
+    stream_data.seq           = {};
+    stream_data.applied       = 0;
+    // The comb used to be stepped once per key and frame, run once on the
+    // voice mix it keeps the delay it had
+    stream_data.reverb.length = audio_sample_rate() / MAX_KEYS;
+
+    for (size_t s = 0; s < SAMPLE_CNT; s++) {
+        Sample *sample = &stream_data.samples[s];
+        sample->data = loadWavFile(config()->sample_paths[s],
+                                   &sample->length,
+                                   &sample->channels,
+                                   &sample->sampleRate);
+        sample->position = 0;
+        sample->gain = 1.0f;
+        sample->playing = false;
+
+        if (!sample->data) {
+            audio_close();
+            return 1;
+        }
 
-    err = Pa_Initialize();
-    if (err != paNoError) {
-        fprintf(stderr, "PortAudio error: %s\n", Pa_GetErrorText(err));
-        return 1;
+        if (static_cast<uint32_t>(sample->sampleRate) != audio_sample_rate()) {
+            fprintf(stderr, "Warning: %s sample rate mismatch (sample: %d, stream: %u)\n",
+                    sample_names[s], sample->sampleRate, audio_sample_rate());
+            audio_close();
+            return 1;
+        }
     }
 
-    PaStreamParameters outputParams;
-    outputParams.device = Pa_GetDefaultOutputDevice();
-    if (outputParams.device == paNoDevice) {
-        fprintf(stderr, "Error: No default output device.\n");
-        Pa_Terminate();
+    gates = 0;
+    init_events();
+    if (init_looper(config()->looper_seconds)) {
+        audio_close();
         return 1;
     }
+    init_recorder();
+
+    // Capture, only routed with input open
+    stream_data.input_gain     = powf(10.0f, config()->input_gain / 20.0f);
+    stream_data.input_send     = config()->input_send;
+    stream_data.input_filtered = config()->input_filter;
+    stream_data.input_filter   = {};
+    stream_data.latency_min    = UINT32_MAX;
+    stream_data.latency_max    = 0;
+    input_latency              = 0;
+
+    // Convolution reverb, only with a response configured
+    stream_data.conv_wet = config()->conv_wet;
+    if (config()->impulse_path[0]) {
+        std::cout << "  * loading impulse response ...\n";
+        if (conv_load(&stream_data.conv, config()->impulse_path,
+                      audio_sample_rate())) {
+            audio_close();
+            return 1;
+        }
+    }
 
-    outputParams.channelCount = 2;
-    outputParams.sampleFormat = paFloat32;
-    outputParams.suggestedLatency =
-        Pa_GetDeviceInfo(outputParams.device)->defaultLowOutputLatency;
-    outputParams.hostApiSpecificStreamInfo = NULL;
-
-    err = Pa_OpenStream(
-        &stream,
-        NULL,              // No input
-        &outputParams,     // Output only
-        SAMPLE_RATE,
-        FRAMES_PER_BUFFER,
-        paClipOff,
-        audioCallback,
-        &stream_data
-    );
-
-    if (err != paNoError) {
-        fprintf(stderr, "Failed to open stream: %s\n", Pa_GetErrorText(err));
-        Pa_Terminate();
+    ENGINE_PARAMS initial = {};
+    initial.volume        = MAX_VOLUME;
+    initial.type          = WAVE_e;
+    initial.envelope      = stream_data.envelope;
+    initial.pulse_width   = stream_data.pulse_width;
+    initial.filter        = stream_data.filter;
+    initial.mod           = stream_data.mod;
+    initial.seq           = config()->sequencer;
+    initial.tuning        = stream_data.tuning;
+
+    std::cout << "  * planning audio graph ...\n";
+    build_graph();
+    if (!route(&initial)) {
+        conv_unload(&stream_data.conv);
+        audio_close();
         return 1;
     }
+    stream_data.plan = initial.graph;
+    init_params(initial);
 
-    err = Pa_StartStream(stream);
-    if (err != paNoError) {
-        fprintf(stderr, "Failed to start stream: %s\n", Pa_GetErrorText(err));
-        Pa_CloseStream(stream);
-        Pa_Terminate();
+    // Voice groups spread over the other cores, if configured
+    if (init_workers(config()->workers)) {
+        conv_unload(&stream_data.conv);
+        audio_close();
         return 1;
     }
 
-    vibrato = false;
-    vibratoDepth = (VIBRATO_DEPTH / VIBRATO_FREQUENCY) * 2.0f * M_PI;
-
-    octave_increment = 0;
+    if (audio_start()) {
+        cleanup_workers();
+        conv_unload(&stream_data.conv);
+        audio_close();
+        return 1;
+    }
 
+    running = true;
     return 0;
 }
 
 void cleanup_sound() {
-    delete[] kick_sample.data;
-    delete[] snare_sample.data;
-    delete[] hi_hat_sample.data;
+    if (!running) {
+        return;
+    }
+    running = false;
+
+    // The callback must be gone before its data is released
+    audio_stop();
+    audio_close();
+    cleanup_workers();
+    conv_unload(&stream_data.conv);
+
+    if (stream_data.latency_max) {
+        std::cout << "  * input to output latency: "
+                  << 1000.0f * stream_data.latency_min / stream_data.rate
+                  << " to "
+                  << 1000.0f * stream_data.latency_max / stream_data.rate
+                  << " ms\n";
+    }
 
-    Pa_StopStream(stream);
-    Pa_CloseStream(stream);
-    Pa_Terminate();
+    cleanup_params();
+    cleanup_events();
+    cleanup_looper();
+    cleanup_recorder();
+    cleanup_tuning();
+
+    for (size_t s = 0; s < SAMPLE_CNT; s++) {
+        delete[] stream_data.samples[s].data;
+        stream_data.samples[s].data = nullptr;
+    }
 }
 
-void trigger_gate(uint8_t index) {
+uint8_t trigger_gate(uint8_t index) {
     if (index < MAX_KEYS) {
-        stream_data.signals[index].gate = !stream_data.signals[index].gate;
-
-        if (stream_data.signals[index].type == KS_e) {
-            // Need to initialize buffer for Karplus-Strong
-            initialize_ks(&stream_data.signals[index]);
+        bool on = !((gates.fetch_xor(1 << index) >> index) & 0b1);
+        if (on) {
+            key_notes[index] = TUNING_NOTE(index, params_octave());
         }
+        events_post(on ? EV_NOTE_ON : EV_NOTE_OFF, key_notes[index], 1.0f);
+        return key_notes[index];
     } else {
         std::cout << "Trigger error: " << index << "is not a valid key!" << std::endl;
+        return TUNING_NOTES;
     }
 }
 
 void trigger_sample(uint8_t index) {
-    switch (index) {
-        case 0:
-            std::cout << "kick trigger\n";
-            kick_sample.position = 0;
-            kick_sample.playing = true;
-            break;
+    if (index >= SAMPLE_CNT) {
+        std::cout << "trigger index ?\n";
+        return;
+    }
 
-        case 1:
-            std::cout << "snare trigger\n";
-            snare_sample.position = 0;
-            snare_sample.playing = true;
-            break;
+    std::cout << sample_names[index] << " trigger\n";
+    events_post(EV_SAMPLE, index, 1.0f);
+}
 
-        case 2:
-            std::cout << "hi hat trigger\n";
-            hi_hat_sample.position = 0;
-            hi_hat_sample.playing = true;
-            break;
+void note_on(uint8_t note, float velocity, uint64_t frame) {
+    if (note < TUNING_NOTES) {
+        events_post_at(EV_NOTE_ON, note, velocity, frame);
+    }
+}
 
-        default:
-            std::cout << "trigger index ?\n";
-            break;
+void note_off(uint8_t note, uint64_t frame) {
+    if (note < TUNING_NOTES) {
+        events_post_at(EV_NOTE_OFF, note, 0.0f, frame);
+    }
+}
+
+void play_sample(uint8_t index, float velocity, uint64_t frame) {
+    if (index < SAMPLE_CNT) {
+        events_post_at(EV_SAMPLE, index, velocity, frame);
     }
 }
 
 void trigger_vibrato() {
-    vibrato = true;
-    stream_data.vibrato.repetitions_left = MAX_VIBRATO_WINDOWS;
+    events_post(EV_VIBRATO, 0, 1.0f);
     std::cout << "Vibrato started\n";
 }
 
 void change_sound_type(SIGNAL_TYPE type) {
-    for (size_t i = 0; i < MAX_KEYS; i++) {
-        stream_data.signals[i].type = type;
-    }
+    ENGINE_PARAMS *params = params_begin();
+    params->type = type;
+    params_commit();
 }
 
 void set_volume(float volume) {
-    stream_data.volume = volume;
+    // Polled continuously from the pots: only publish real changes
+    ENGINE_PARAMS *params = params_begin();
+    if (params->volume == volume) {
+        params_abort();
+        return;
+    }
+    params->volume = volume;
+    params_commit();
 }
 
 void trigger_reverb() {
-    stream_data.reverb.enabled = !stream_data.reverb.enabled;
-    // When turning off, reset values
-    if (!stream_data.reverb.enabled) {
-        stream_data.reverb.index = 0;
-        std::fill(stream_data.reverb.buffer,
-                  stream_data.reverb.buffer + SAMPLE_RATE, 0.0f);
+    ENGINE_PARAMS *params = params_begin();
+    params->reverb = !params->reverb;
+    if (!route(params)) {
+        params_abort();
+        return;
     }
+    params_commit();
+}
+
+void set_reverb(bool enabled) {
+    ENGINE_PARAMS *params = params_begin();
+    if (params->reverb == enabled) {
+        params_abort();
+        return;
+    }
+    params->reverb = enabled;
+    if (!route(params)) {
+        params_abort();
+        return;
+    }
+    params_commit();
 }
 
 void change_frequency(bool increase) {
-    float mod;
-
-    if (increase && (octave_increment < MAX_INC_OCTAVE)) {
-        mod = 2.0f;
-        octave_increment++;
-    } else if (!increase && (octave_increment > MAX_DEC_OCTAVE)) {
-        mod = 0.5f;
-        octave_increment--;
+    ENGINE_PARAMS *params = params_begin();
+
+    if (increase && (params->octave < MAX_INC_OCTAVE)) {
+        params->octave++;
+    } else if (!increase && (params->octave > MAX_DEC_OCTAVE)) {
+        params->octave--;
     } else {
+        params_abort();
         return;
     }
 
-    for (size_t i = 0; i < MAX_KEYS; i++) {
-        stream_data.signals[i].wave.frequency *= mod;
-        if (stream_data.signals[i].type == KS_e) {
-            initialize_ks(&stream_data.signals[i]);
-        }
+    params_commit();
+}
+
+void set_tuning(const TUNING_TABLE *table) {
+    if (!running) {
+        return;
+    }
+
+    ENGINE_PARAMS *params = params_begin();
+    params->tuning = table;
+    params_commit();
+}
+
+void set_pulse_width(float width) {
+    if (!running) {
+        return;
     }
+
+    width = std::clamp(width, OSC_MIN_WIDTH, OSC_MAX_WIDTH);
+    ENGINE_PARAMS *params = params_begin();
+    if (params->pulse_width == width) {
+        params_abort();
+        return;
+    }
+    params->pulse_width = width;
+    params_commit();
+}
+
+void set_filter(const FILTER_SETTINGS *settings) {
+    if (!running) {
+        return;
+    }
+
+    ENGINE_PARAMS *params = params_begin();
+    params->filter = *settings;
+    params_commit();
+}
+
+void set_modulation(const MOD_SETTINGS *settings) {
+    if (!running) {
+        return;
+    }
+
+    ENGINE_PARAMS *params = params_begin();
+    params->mod = *settings;
+    params_commit();
+}
+
+void set_mod_source(MOD_SOURCE source, float value) {
+    // The rest are worked out by the callback
+    if (source >= MOD_SRC_WHEEL && source < MOD_SRC_CNT) {
+        mod_sources[source].store(value, std::memory_order_relaxed);
+    }
+}
+
+void set_envelope(const ENVELOPE_SETTINGS *settings) {
+    if (!running) {
+        return;
+    }
+
+    ENGINE_PARAMS *params = params_begin();
+    params->envelope = *settings;
+    params_commit();
+}
+
+void set_expression(EXPRESSION expr, float value) {
+    switch (expr) {
+        case EXPR_PITCH_BEND:
+        case EXPR_HAND_BEND:
+            value = std::clamp(value, -MAX_PITCH_BEND, MAX_PITCH_BEND);
+            break;
+
+        case EXPR_LEVEL:
+        case EXPR_CUTOFF:
+            value = std::clamp(value, 0.0f, 1.0f);
+            break;
+
+        default:
+            return;
+    }
+    expression_targets[expr].store(value, std::memory_order_relaxed);
+}
+
+float sound_input_latency_ms() {
+    return running ? 1000.0f * input_latency.load(std::memory_order_relaxed)
+                     / stream_data.rate
+                   : 0.0f;
 }
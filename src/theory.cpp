@@ -109,7 +109,7 @@ static void update_suggestions(uint8_t idx_1, uint8_t idx_2) {
 
 static void determine_chord() {
     int interval;
-    std::string chord, composition;
+    std::string composition;
     std::string sug1_c, sug1_d;
     std::string sug2_c, sug2_d;
     uint8_t sug1_idx, sug2_idx;
@@ -117,48 +117,34 @@ static void determine_chord() {
     if (pressed_keys.size() == 0) {
         std::cout << "-" << std::endl;
 
-        set_chord("t0.txt=\"-\"", "t1.txt=\"-\"");
+        set_chord(NO_CHORD, NO_CHORD);
 
-        set_suggestions("t2.txt=\"-\"", "t3.txt=\"-\"");
-        set_suggestions("t4.txt=\"-\"", "t5.txt=\"-\"");
+        set_suggestion(0, NO_CHORD, NO_CHORD);
+        set_suggestion(1, NO_CHORD, NO_CHORD);
         turn_off_suggestions();
         return;
     } else if (pressed_keys.size() == 1) {
         std::cout << keys[pressed_keys[0]].name << std::endl;
 
-        chord = "t0.txt=\"";
-        chord += keys[pressed_keys[0]].name;
-        chord += "\"";
-        composition = "t1.txt=\"";
-        composition += keys[pressed_keys[0]].name;
-        composition += "\"";
-        set_chord(chord, composition);
+        set_chord(keys[pressed_keys[0]].name, keys[pressed_keys[0]].name);
 
         sug1_idx = get_key_suggestion_index(pressed_keys[0], 4);
         sug2_idx = get_key_suggestion_index(pressed_keys[0], 3);
 
-        sug1_c = "t2.txt=\"";
-        sug1_c += keys[pressed_keys[0]].name;
-        sug1_c += "\"";
+        sug1_c = keys[pressed_keys[0]].name;
 
-        sug1_d = "t3.txt=\"";
-        sug1_d += keys[pressed_keys[0]].name;
+        sug1_d = keys[pressed_keys[0]].name;
         sug1_d += "->";
         sug1_d += keys[sug1_idx].name;
-        sug1_d += "\"";
 
-        sug2_c = "t4.txt=\"";
-        sug2_c += keys[pressed_keys[0]].name;
-        sug2_c += "\"";
+        sug2_c = keys[pressed_keys[0]].name;
 
-        sug2_d = "t5.txt=\"";
-        sug2_d += keys[pressed_keys[0]].name;
+        sug2_d = keys[pressed_keys[0]].name;
         sug2_d += "->";
         sug2_d += keys[sug1_idx].name;
-        sug2_d += "\"";
 
-        set_suggestions(sug1_c, sug1_d);
-        set_suggestions(sug2_c, sug2_d);
+        set_suggestion(0, sug1_c, sug1_d);
+        set_suggestion(1, sug2_c, sug2_d);
 
         update_suggestions(sug1_idx, sug2_idx);
         return;
@@ -196,10 +182,6 @@ static void determine_chord() {
 
                 std::cout << chord_str << std::endl;
 
-                chord = "t0.txt=\"";
-                chord += chord_str;
-                chord += "\"";
-                composition = "t1.txt=\"";
                 std::string composition_str;
                 size_t i = 0;
                 while (i < pressed_keys.size() - 1) {
@@ -208,48 +190,38 @@ static void determine_chord() {
                     i++;
                 }
                 composition_str += keys[pressed_keys[i]].name;
-                composition += composition_str;
-                composition += "\"";
-                set_chord(chord, composition);
-
-                sug1_c = "t2.txt=\"";
-                sug1_d = "t3.txt=\"";
-                sug2_c = "t4.txt=\"";
-                sug2_d = "t5.txt=\"";
+                set_chord(chord_str, composition_str);
+
                 if (pattern.has_suggestions) {
                     sug1_idx = get_key_suggestion_index(rotated[0],
                                     pattern.suggestions[0].interval_from_root);
                     sug2_idx = get_key_suggestion_index(rotated[0],
                                     pattern.suggestions[1].interval_from_root);
 
-                    sug1_c += keys[pressed_keys[0]].name;
+                    sug1_c = keys[pressed_keys[0]].name;
                     sug1_c += pattern.suggestions[0].suffix;
-                    sug1_c += "\"";
 
-                    sug1_d += composition_str;
+                    sug1_d = composition_str;
                     sug1_d += "->";
                     sug1_d += keys[sug1_idx].name;
-                    sug1_d += "\"";
 
-                    sug2_c += keys[pressed_keys[0]].name;
+                    sug2_c = keys[pressed_keys[0]].name;
                     sug2_c += pattern.suggestions[0].suffix;
-                    sug2_c += "\"";
 
-                    sug2_d += composition_str;
+                    sug2_d = composition_str;
                     sug2_d += "->";
                     sug2_d += keys[sug1_idx].name;
-                    sug2_d += "\"";
 
                     update_suggestions(sug1_idx, sug2_idx);
                 } else {
-                    sug1_c += "-\"";
-                    sug1_d += "-\"";
-                    sug2_c += "-\"";
-                    sug2_d += "-\"";
+                    sug1_c = NO_CHORD;
+                    sug1_d = NO_CHORD;
+                    sug2_c = NO_CHORD;
+                    sug2_d = NO_CHORD;
                     turn_off_suggestions();
                 }
-                set_suggestions(sug1_c, sug1_d);
-                set_suggestions(sug2_c, sug2_d);
+                set_suggestion(0, sug1_c, sug1_d);
+                set_suggestion(1, sug2_c, sug2_d);
                 return;
             }
         }
@@ -257,7 +229,6 @@ static void determine_chord() {
 
     std::cout << "?" << std::endl;
 
-    composition = "t1.txt=\"";
     size_t i = 0;
     while (i < pressed_keys.size() - 1) {
         composition += keys[pressed_keys[i]].name;
@@ -265,11 +236,10 @@ static void determine_chord() {
         i++;
     }
     composition += keys[pressed_keys[i]].name;
-    composition += "\"";
-    set_chord("t0.txt=\"?\"", composition);
+    set_chord("?", composition);
 
-    set_suggestions("t2.txt=\"-\"", "t3.txt=\"-\"");
-    set_suggestions("t4.txt=\"-\"", "t5.txt=\"-\"");
+    set_suggestion(0, NO_CHORD, NO_CHORD);
+    set_suggestion(1, NO_CHORD, NO_CHORD);
     turn_off_suggestions();
 }
 
@@ -282,4 +252,20 @@ void update_music_state() {
 
     std::cout << " > Current chord (C key):" << std::endl;
     determine_chord();
+
+    // Only the fields that actually changed reach the display
+    disp_commit();
+}
+
+void update_detected_state(const uint8_t *notes, uint8_t count) {
+    std::cout << std::endl << " > Heard on the input:" << std::endl;
+    pressed_keys.assign(notes, notes + count);
+    for (size_t i = 0; i < pressed_keys.size(); i++) {
+        std::cout << (i ? " -> " : "") << keys[pressed_keys[i]].name;
+    }
+    std::cout << std::endl;
+
+    std::cout << " > Current chord (C key):" << std::endl;
+    determine_chord();
+    disp_commit();
 }
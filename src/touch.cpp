@@ -2,15 +2,16 @@
 #include <iostream>
 #include <wiringPi.h>
 
+#include "config.hpp"
+#include "midi.hpp"
+#include "sequencer.hpp"
 #include "sound.hpp"
 #include "touch.hpp"
 
 #define TOUCH_SUCCESS 0
 #define TOUCH_INITERR 1
 
-// Defines the max number of keys to load
-#define MAX_TOUCH 5
-    #define TOUCH_SAMPLES 3
+#define TOUCH_SAMPLES 3
 
 #define UP_OCTAVE   3
 #define DOWN_OCTAVE 4
@@ -21,13 +22,7 @@ typedef struct touch
     uint8_t state;
 } TOUCH;
 
-static touch touches[] = {
-    {7, false},
-    {0, false},
-    {2, false},
-    {3, false},
-    {4, false}
-};
+static touch touches[MAX_TOUCH];
 
 static uint8_t get_touch(TOUCH *touch) {
     return digitalRead(touch->pin);
@@ -41,6 +36,7 @@ uint8_t init_touch() {
     }
 
     for (size_t i = 0; i < MAX_TOUCH; i++) {
+        touches[i] = {config()->touch_pins[i], false};
         pinMode(touches[i].pin, INPUT);
     }
 
@@ -59,6 +55,8 @@ void loop_touch() {
 
             if (tmp_state && (i < TOUCH_SAMPLES)) {
                 trigger_sample(i);
+                midi_send_sample(i);
+                seq_record(SEQ_SAMPLE_TRACK(i), 1.0f);
             } else if (tmp_state && (i >= TOUCH_SAMPLES)) {
                 if (i == UP_OCTAVE) {
                     change_frequency(INC_OCTAVE);
@@ -0,0 +1,221 @@
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "audio.hpp"
+#include "config.hpp"
+#include "sound.hpp"
+#include "tuning.hpp"
+
+#define TUNING_SUCCESS 0
+#define TUNING_INITERR 1
+
+/*
+ * 2^(1/12) by Newton's method on x^12 = 2, run by the compiler. From a start
+ * this close it converges to the last bit of a double in a few rounds.
+ */
+static constexpr double semitone() {
+    double x = 1.06;
+    for (int round = 0; round < 8; round++) {
+        double p = 1.0;
+        for (int k = 0; k < 11; k++) {
+            p *= x;
+        }
+        x -= (p * x - 2.0) / (12.0 * p);
+    }
+    return x;
+}
+
+static constexpr SCALE equal_temperament() {
+    SCALE scale = {};
+    scale.degrees  = MAX_KEYS;
+    scale.ratio[0] = 1.0;
+    for (size_t k = 1; k < MAX_KEYS; k++) {
+        scale.ratio[k] = scale.ratio[k - 1] * semitone();
+    }
+    // Exact, so octaves never drift
+    scale.ratio[MAX_KEYS] = 2.0;
+    return scale;
+}
+
+static constexpr SCALE equal = equal_temperament();
+
+static_assert(equal.ratio[9] > 1.681792 && equal.ratio[9] < 1.681793,
+              "equal temperament major sixth is off");
+
+static std::atomic<const TUNING_TABLE *> current;
+
+// Tables may still be in an engine snapshot, they are freed on cleanup
+static std::vector<TUNING_TABLE *> retired;
+
+static bool initialized;
+
+// Ratio of note n (0 = key 0 in octave 0) to key 0, over as many periods
+// as it takes
+static double note_ratio(const SCALE *scale, int n) {
+    int periods = n >= 0 ? n / scale->degrees
+                         : -((scale->degrees - 1 - n) / scale->degrees);
+    int degree  = n - periods * scale->degrees;
+    return scale->ratio[degree] * pow(scale->ratio[scale->degrees], periods);
+}
+
+static TUNING_TABLE *build_table(const SCALE *scale, double reference_pitch,
+                                 uint8_t reference_key) {
+    TUNING_TABLE *table = new TUNING_TABLE;
+    double rate = audio_sample_rate();
+    double base = reference_pitch / note_ratio(scale, reference_key);
+
+    for (int t = 0; t < TUNING_NOTES; t++) {
+        double f = base * note_ratio(scale,
+                                     t + MAX_KEYS * TUNING_LOWEST_OCTAVE);
+        table->frequency[t] = static_cast<float>(f);
+        table->step[t]      = static_cast<float>(f / rate);
+        table->period[t]    = static_cast<float>(rate / f);
+    }
+    return table;
+}
+
+static double parse_pitch(const std::string& token) {
+    char *end;
+
+    // Scala: anything with a dot is in cents, the rest is a ratio
+    if (token.find('.') != std::string::npos) {
+        double cents = strtod(token.c_str(), &end);
+        return *end ? 0.0 : exp2(cents / 1200.0);
+    }
+
+    double numerator = strtod(token.c_str(), &end);
+    if (!*end) {
+        return numerator;
+    }
+    if (*end != '/') {
+        return 0.0;
+    }
+    double denominator = strtod(end + 1, &end);
+    return (*end || denominator <= 0.0) ? 0.0 : numerator / denominator;
+}
+
+bool tuning_load_scale(const char *name, SCALE *scale) {
+    if (!strcmp(name, TUNING_EQUAL)) {
+        *scale = equal;
+        return true;
+    }
+
+    std::ifstream file(name);
+    if (!file) {
+        std::cerr << "Failed to open scale " << name << std::endl;
+        return false;
+    }
+
+    // Lines after the comments: description, degree count, then one pitch
+    // per line with anything after the pitch ignored
+    std::string line;
+    bool described = false;
+    long expected  = 0;
+
+    scale->degrees  = 0;
+    scale->ratio[0] = 1.0;
+
+    while (std::getline(file, line)) {
+        if (!line.empty() && line[0] == '!') {
+            continue;
+        }
+        if (!described) {
+            described = true;
+            continue;
+        }
+
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos) {
+            continue;
+        }
+        std::string token = line.substr(first,
+                                        line.find_first_of(" \t\r", first)
+                                        - first);
+
+        if (!expected) {
+            expected = strtol(token.c_str(), nullptr, 10);
+            if (expected < 1 || expected > TUNING_MAX_DEGREES) {
+                std::cerr << name << ": bad degree count" << std::endl;
+                return false;
+            }
+            continue;
+        }
+
+        double ratio = parse_pitch(token);
+        if (ratio <= 0.0) {
+            std::cerr << name << ": bad pitch '" << token << "'" << std::endl;
+            return false;
+        }
+        scale->ratio[++scale->degrees] = ratio;
+        if (scale->degrees == expected) {
+            break;
+        }
+    }
+
+    if (!expected || scale->degrees != expected
+        || scale->ratio[scale->degrees] <= 1.0) {
+        std::cerr << name << ": incomplete scale" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static TUNING_TABLE *build_from_config() {
+    const DAW_CONFIG *cfg = config();
+    SCALE scale;
+
+    if (!tuning_load_scale(cfg->scale_name, &scale)) {
+        return nullptr;
+    }
+    return build_table(&scale, cfg->reference_pitch, cfg->reference_key);
+}
+
+uint8_t init_tuning() {
+    std::cout << "  * building tuning tables ...\n";
+
+    TUNING_TABLE *table = build_from_config();
+    if (!table) {
+        return TUNING_INITERR;
+    }
+    current.store(table);
+    retired.push_back(table);
+    initialized = true;
+
+    std::cout << " Tuning Success!\n";
+    return TUNING_SUCCESS;
+}
+
+void cleanup_tuning() {
+    initialized = false;
+    current.store(nullptr);
+    for (TUNING_TABLE *table : retired) {
+        delete table;
+    }
+    retired.clear();
+}
+
+const TUNING_TABLE *tuning_current() {
+    return current.load();
+}
+
+void tuning_reload() {
+    if (!initialized) {
+        return;
+    }
+
+    TUNING_TABLE *table = build_from_config();
+    if (!table) {
+        std::cerr << "Tuning not changed" << std::endl;
+        return;
+    }
+    current.store(table);
+    retired.push_back(table);
+    set_tuning(table);
+}
@@ -0,0 +1,594 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "gesture_ipc.hpp"
+
+#include "vision.hpp"
+
+#define VISION_SUCCESS 0
+#define VISION_OPENERR 1
+#define VISION_FMTERR  2
+#define VISION_MAPERR  3
+
+// Capture format requested from V4L2 devices
+#define VISION_WIDTH   320
+#define VISION_HEIGHT  240
+#define VISION_BUFFERS 4
+#define VISION_TIMEOUT 1000 // ms, also the wait between reopen attempts
+#define VISION_FILE_FPS 30  // Playback rate of recorded frames in the app
+
+// Region of interest, same as the Python detector
+#define ROI_X      60
+#define ROI_Y      60
+#define ROI_SIZE   180
+#define ROI_STRIDE 192 // Rows padded to a multiple of the vector width
+
+// Three box passes approximate the 35x35 Gaussian (sigma ~5.6) used before
+#define BLUR_RADIUS 5
+#define BLUR_RECIP  5958 // 65536 / (2 * BLUR_RADIUS + 1)
+
+// Frame difference gate, on a sparse grid of the raw ROI
+#define GATE_STEP      4
+    #define GATE_SIZE      (ROI_SIZE / GATE_STEP)
+#define GATE_THRESHOLD 6 // Mean absolute luma difference, above sensor noise
+
+#define HAND_MIN_AREA  2500
+#define FINGER_SAMPLES 128
+#define FINGER_RADIUS  0.75f // Of the distance to the farthest hand pixel
+#define FINGER_MIN_RUN 2     // Samples, filters single pixel noise
+
+typedef uint8_t v16u8 __attribute__((vector_size(16)));
+
+typedef enum source_type {
+    SOURCE_NONE = 0,
+    SOURCE_V4L2,
+    SOURCE_FILE,
+} SOURCE_TYPE;
+
+typedef struct capture_buffer {
+    void   *start;
+    size_t  length;
+} CAPTURE_BUFFER;
+
+static SOURCE_TYPE    source_type = SOURCE_NONE;
+static int            video_fd    = -1;
+static FILE          *frame_file  = nullptr;
+static CAPTURE_BUFFER buffers[VISION_BUFFERS];
+static uint32_t       buffer_cnt;
+
+// Geometry of the current frame; step is the distance between luma samples
+static uint32_t frame_width, frame_height, frame_stride, frame_step;
+static std::vector<uint8_t> file_frame;
+
+alignas(16) static uint8_t plane_a[ROI_SIZE * ROI_STRIDE];
+alignas(16) static uint8_t plane_b[ROI_SIZE * ROI_STRIDE];
+static uint8_t  gate_prev[GATE_SIZE * GATE_SIZE];
+static bool     gate_valid;
+
+static float circle_cos[FINGER_SAMPLES];
+static float circle_sin[FINGER_SAMPLES];
+
+static VISION_RESULT last_result;
+
+static std::atomic<bool> vision_running;
+static std::thread       vision_thread;
+static std::string       vision_source;
+static bool              device_lost;  // Unplugged or stopped, needs reopening
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+/*******************************************************************************
+ ********************************* Frame input *********************************
+ ******************************************************************************/
+
+static uint8_t open_v4l2(const char *device) {
+    video_fd = open(device, O_RDWR | O_NONBLOCK);
+    if (video_fd == -1) {
+        std::cerr << "Failed to open " << device << std::endl;
+        return VISION_OPENERR;
+    }
+
+    struct v4l2_format fmt = {};
+    fmt.type                = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width       = VISION_WIDTH;
+    fmt.fmt.pix.height      = VISION_HEIGHT;
+    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    fmt.fmt.pix.field       = V4L2_FIELD_NONE;
+    if (ioctl(video_fd, VIDIOC_S_FMT, &fmt) == -1) {
+        std::cerr << "Failed to set capture format" << std::endl;
+        return VISION_FMTERR;
+    }
+
+    // Luma is read straight out of the driver buffers, so only formats with
+    // an interleaved or planar Y channel first are usable
+    switch (fmt.fmt.pix.pixelformat) {
+        case V4L2_PIX_FMT_YUYV: frame_step = 2; break;
+        case V4L2_PIX_FMT_GREY: frame_step = 1; break;
+        default:
+            std::cerr << "Unsupported capture format" << std::endl;
+            return VISION_FMTERR;
+    }
+    frame_width  = fmt.fmt.pix.width;
+    frame_height = fmt.fmt.pix.height;
+    frame_stride = fmt.fmt.pix.bytesperline;
+
+    struct v4l2_requestbuffers req = {};
+    req.count  = VISION_BUFFERS;
+    req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (ioctl(video_fd, VIDIOC_REQBUFS, &req) == -1 || req.count == 0) {
+        std::cerr << "Failed to request capture buffers" << std::endl;
+        return VISION_MAPERR;
+    }
+    buffer_cnt = std::min<uint32_t>(req.count, VISION_BUFFERS);
+
+    for (uint32_t i = 0; i < buffer_cnt; i++) {
+        struct v4l2_buffer buf = {};
+        buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index  = i;
+        if (ioctl(video_fd, VIDIOC_QUERYBUF, &buf) == -1) {
+            return VISION_MAPERR;
+        }
+
+        buffers[i].length = buf.length;
+        buffers[i].start  = mmap(nullptr, buf.length, PROT_READ, MAP_SHARED,
+                                 video_fd, buf.m.offset);
+        if (buffers[i].start == MAP_FAILED) {
+            buffers[i].start = nullptr;
+            return VISION_MAPERR;
+        }
+
+        if (ioctl(video_fd, VIDIOC_QBUF, &buf) == -1) {
+            return VISION_MAPERR;
+        }
+    }
+
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (ioctl(video_fd, VIDIOC_STREAMON, &type) == -1) {
+        std::cerr << "Failed to start capture" << std::endl;
+        return VISION_OPENERR;
+    }
+
+    return VISION_SUCCESS;
+}
+
+// Reads the next binary PGM of the recording into file_frame
+static bool read_file_frame() {
+    unsigned int width, height, maxval;
+    if (fscanf(frame_file, " P5 %u %u %u", &width, &height, &maxval) != 3
+        || maxval > 255) {
+        return false;
+    }
+    fgetc(frame_file); // Single whitespace before the raster
+
+    file_frame.resize(static_cast<size_t>(width) * height);
+    if (fread(file_frame.data(), 1, file_frame.size(), frame_file)
+        != file_frame.size()) {
+        return false;
+    }
+
+    frame_width  = width;
+    frame_height = height;
+    frame_stride = width;
+    frame_step   = 1;
+    return true;
+}
+
+/*******************************************************************************
+ ******************************* Image processing ******************************
+ ******************************************************************************/
+
+// Sum of absolute differences against the last analysed frame
+static bool frame_changed(const uint8_t *roi) {
+    uint32_t diff = 0;
+    const uint8_t *prev = gate_prev;
+    for (int y = 0; y < ROI_SIZE; y += GATE_STEP) {
+        const uint8_t *row = roi + y * frame_stride;
+        for (int x = 0; x < ROI_SIZE; x += GATE_STEP) {
+            diff += std::abs(row[x * frame_step] - *prev++);
+        }
+    }
+
+    if (gate_valid && diff < GATE_THRESHOLD * GATE_SIZE * GATE_SIZE) {
+        return false;
+    }
+
+    // Only analysed frames become the reference, so slow drift still adds up
+    uint8_t *ref = gate_prev;
+    for (int y = 0; y < ROI_SIZE; y += GATE_STEP) {
+        const uint8_t *row = roi + y * frame_stride;
+        for (int x = 0; x < ROI_SIZE; x += GATE_STEP) {
+            *ref++ = row[x * frame_step];
+        }
+    }
+    gate_valid = true;
+    return true;
+}
+
+// Running-sum box filter along rows, edges clamped
+static void box_h(const uint8_t *src, uint32_t stride, uint32_t step,
+                  uint8_t *dst) {
+    for (int y = 0; y < ROI_SIZE; y++) {
+        const uint8_t *row = src + y * stride;
+        uint8_t       *out = dst + y * ROI_STRIDE;
+
+        uint32_t sum = row[0] * (BLUR_RADIUS + 1);
+        for (int k = 1; k <= BLUR_RADIUS; k++) {
+            sum += row[k * step];
+        }
+
+        for (int x = 0; x < ROI_SIZE; x++) {
+            out[x] = (sum * BLUR_RECIP) >> 16;
+            int add = std::min(x + BLUR_RADIUS + 1, ROI_SIZE - 1);
+            int sub = std::max(x - BLUR_RADIUS, 0);
+            sum += row[add * step] - row[sub * step];
+        }
+    }
+}
+
+/*
+ * Running-sum box filter along columns. Every column is independent, so the
+ * inner loops run across whole rows and vectorize (NEON on the Pi).
+ */
+static void box_v(const uint8_t *src, uint8_t *dst) {
+    alignas(16) uint16_t acc[ROI_STRIDE];
+
+    for (int x = 0; x < ROI_STRIDE; x++) {
+        acc[x] = src[x] * (BLUR_RADIUS + 1);
+    }
+    for (int k = 1; k <= BLUR_RADIUS; k++) {
+        const uint8_t *row = src + k * ROI_STRIDE;
+        for (int x = 0; x < ROI_STRIDE; x++) {
+            acc[x] += row[x];
+        }
+    }
+
+    for (int y = 0; y < ROI_SIZE; y++) {
+        const uint8_t *add = src + std::min(y + BLUR_RADIUS + 1, ROI_SIZE - 1)
+                                   * ROI_STRIDE;
+        const uint8_t *sub = src + std::max(y - BLUR_RADIUS, 0) * ROI_STRIDE;
+        uint8_t       *out = dst + y * ROI_STRIDE;
+
+        for (int x = 0; x < ROI_STRIDE; x++) {
+            out[x] = (static_cast<uint32_t>(acc[x]) * BLUR_RECIP) >> 16;
+            acc[x] += add[x] - sub[x];
+        }
+    }
+}
+
+static uint8_t otsu_threshold(const uint8_t *img) {
+    uint32_t hist[256] = {0};
+    for (int y = 0; y < ROI_SIZE; y++) {
+        const uint8_t *row = img + y * ROI_STRIDE;
+        for (int x = 0; x < ROI_SIZE; x++) {
+            hist[row[x]]++;
+        }
+    }
+
+    const float total = ROI_SIZE * ROI_SIZE;
+    float sum_all = 0.0f;
+    for (int i = 0; i < 256; i++) {
+        sum_all += i * static_cast<float>(hist[i]);
+    }
+
+    float   sum_bg = 0.0f, weight_bg = 0.0f, best = 0.0f;
+    uint8_t threshold = 0;
+    for (int t = 0; t < 256; t++) {
+        weight_bg += hist[t];
+        if (weight_bg == 0.0f) {
+            continue;
+        }
+        float weight_fg = total - weight_bg;
+        if (weight_fg == 0.0f) {
+            break;
+        }
+
+        sum_bg += t * static_cast<float>(hist[t]);
+        float mean_bg = sum_bg / weight_bg;
+        float mean_fg = (sum_all - sum_bg) / weight_fg;
+        float between = weight_bg * weight_fg
+                        * (mean_bg - mean_fg) * (mean_bg - mean_fg);
+        if (between > best) {
+            best      = between;
+            threshold = t;
+        }
+    }
+    return threshold;
+}
+
+// Inverted binary threshold (dark hand on light background -> 0xFF)
+static void apply_threshold(const uint8_t *src, uint8_t *dst, uint8_t t) {
+    v16u8 limit;
+    for (int i = 0; i < 16; i++) {
+        limit[i] = t;
+    }
+
+    for (int i = 0; i < ROI_SIZE * ROI_STRIDE; i += 16) {
+        v16u8 px;
+        memcpy(&px, src + i, sizeof(px));
+        v16u8 mask = (v16u8)(px <= limit);
+        memcpy(dst + i, &mask, sizeof(mask));
+    }
+}
+
+static uint8_t count_fingers(const uint8_t *mask, float cx, float cy,
+                             float radius) {
+    bool samples[FINGER_SAMPLES];
+    for (int i = 0; i < FINGER_SAMPLES; i++) {
+        int x = static_cast<int>(cx + radius * circle_cos[i]);
+        int y = static_cast<int>(cy + radius * circle_sin[i]);
+        samples[i] = x >= 0 && x < ROI_SIZE && y >= 0 && y < ROI_SIZE
+                     && mask[y * ROI_STRIDE + x];
+    }
+
+    // Start counting from a background sample so no run is split in two
+    int start = 0;
+    while (start < FINGER_SAMPLES && samples[start]) {
+        start++;
+    }
+    if (start == FINGER_SAMPLES) {
+        return 0;
+    }
+
+    // Every run of hand pixels crossing the circle is a finger, except the
+    // one that leads to the wrist
+    int runs = 0, run = 0;
+    for (int i = 1; i <= FINGER_SAMPLES; i++) {
+        if (samples[(start + i) % FINGER_SAMPLES]) {
+            run++;
+        } else {
+            if (run >= FINGER_MIN_RUN) {
+                runs++;
+            }
+            run = 0;
+        }
+    }
+    return runs > 0 ? runs - 1 : 0;
+}
+
+static void analyse(const uint8_t *roi, VISION_RESULT *result) {
+    box_h(roi, frame_stride, frame_step, plane_a);
+    box_h(plane_a, ROI_STRIDE, 1, plane_b);
+    box_h(plane_b, ROI_STRIDE, 1, plane_a);
+    box_v(plane_a, plane_b);
+    box_v(plane_b, plane_a);
+    box_v(plane_a, plane_b);
+
+    apply_threshold(plane_b, plane_a, otsu_threshold(plane_b));
+
+    uint32_t area = 0;
+    uint64_t sum_x = 0, sum_y = 0;
+    for (int y = 0; y < ROI_SIZE; y++) {
+        const uint8_t *row = plane_a + y * ROI_STRIDE;
+        for (int x = 0; x < ROI_SIZE; x++) {
+            if (row[x]) {
+                area++;
+                sum_x += x;
+                sum_y += y;
+            }
+        }
+    }
+
+    result->area    = area;
+    result->fingers = 0;
+    result->cx      = 0.5f;
+    result->cy      = 0.5f;
+    result->gesture = GESTURE_NOHAND;
+    if (area <= HAND_MIN_AREA) {
+        return;
+    }
+
+    float cx = static_cast<float>(sum_x) / area;
+    float cy = static_cast<float>(sum_y) / area;
+
+    float max_dist_sq = 0.0f;
+    for (int y = 0; y < ROI_SIZE; y++) {
+        const uint8_t *row = plane_a + y * ROI_STRIDE;
+        float dy_sq = (y - cy) * (y - cy);
+        for (int x = 0; x < ROI_SIZE; x++) {
+            if (row[x]) {
+                max_dist_sq = std::fmax(max_dist_sq,
+                                        (x - cx) * (x - cx) + dy_sq);
+            }
+        }
+    }
+
+    result->cx      = cx / ROI_SIZE;
+    result->cy      = cy / ROI_SIZE;
+    result->fingers = count_fingers(plane_a, cx, cy,
+                                    FINGER_RADIUS * std::sqrt(max_dist_sq));
+    result->gesture = result->fingers <= 1 ? GESTURE_CLOSED : GESTURE_OPENED;
+}
+
+/*******************************************************************************
+ ********************************** Public API *********************************
+ ******************************************************************************/
+
+uint8_t vision_open(const char *source) {
+    for (int i = 0; i < FINGER_SAMPLES; i++) {
+        circle_cos[i] = std::cos(2.0f * (float)M_PI * i / FINGER_SAMPLES);
+        circle_sin[i] = std::sin(2.0f * (float)M_PI * i / FINGER_SAMPLES);
+    }
+    gate_valid  = false;
+    device_lost = false;
+    last_result = {GESTURE_NOHAND, 0, 0, 0.5f, 0.5f, 0, false};
+
+    if (strncmp(source, "/dev/video", 10) == 0) {
+        source_type = SOURCE_V4L2;
+        uint8_t err = open_v4l2(source);
+        if (err) {
+            vision_close();
+        }
+        return err;
+    }
+
+    frame_file = fopen(source, "rb");
+    if (!frame_file) {
+        std::cerr << "Failed to open frame recording " << source << std::endl;
+        return VISION_OPENERR;
+    }
+    source_type = SOURCE_FILE;
+    return VISION_SUCCESS;
+}
+
+void vision_close() {
+    if (source_type == SOURCE_V4L2 && video_fd != -1) {
+        enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        ioctl(video_fd, VIDIOC_STREAMOFF, &type);
+        for (uint32_t i = 0; i < buffer_cnt; i++) {
+            if (buffers[i].start) {
+                munmap(buffers[i].start, buffers[i].length);
+                buffers[i].start = nullptr;
+            }
+        }
+        buffer_cnt = 0;
+        close(video_fd);
+        video_fd = -1;
+    }
+
+    if (frame_file) {
+        fclose(frame_file);
+        frame_file = nullptr;
+    }
+    source_type = SOURCE_NONE;
+}
+
+bool vision_step(VISION_RESULT *result) {
+    const uint8_t     *frame = nullptr;
+    struct v4l2_buffer buf   = {};
+
+    if (source_type == SOURCE_V4L2) {
+        struct pollfd pfd = {video_fd, POLLIN, 0};
+        if (poll(&pfd, 1, VISION_TIMEOUT) <= 0) {
+            return false;
+        }
+        // These come back at once every time, they don't go away by waiting
+        if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            device_lost = true;
+            return false;
+        }
+        buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (ioctl(video_fd, VIDIOC_DQBUF, &buf) == -1) {
+            device_lost = errno != EAGAIN && errno != EINTR;
+            return false;
+        }
+        frame = static_cast<const uint8_t *>(buffers[buf.index].start);
+    } else if (source_type == SOURCE_FILE) {
+        if (!read_file_frame()) {
+            return false;
+        }
+        frame = file_frame.data();
+    } else {
+        return false;
+    }
+
+    uint64_t stamp = now_ns();
+    if (frame_width >= ROI_X + ROI_SIZE && frame_height >= ROI_Y + ROI_SIZE) {
+        const uint8_t *roi = frame + ROI_Y * frame_stride + ROI_X * frame_step;
+        if (frame_changed(roi)) {
+            analyse(roi, &last_result);
+            last_result.skipped = false;
+        } else {
+            last_result.skipped = true;
+        }
+    } else {
+        last_result.gesture = GESTURE_NOHAND;
+        last_result.skipped = false;
+    }
+    last_result.stamp_ns = stamp;
+
+    // Analysis is done, the driver can refill the buffer
+    if (source_type == SOURCE_V4L2) {
+        ioctl(video_fd, VIDIOC_QBUF, &buf);
+    }
+
+    *result = last_result;
+    return true;
+}
+
+// Closes the camera and tries it again every VISION_TIMEOUT until it is back
+static void reopen_device() {
+    std::cerr << "Camera lost, reopening " << vision_source << std::endl;
+    vision_close();
+    while (vision_running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(VISION_TIMEOUT));
+        if (!vision_open(vision_source.c_str())) {
+            return;
+        }
+    }
+}
+
+static void vision_loop() {
+    auto period = std::chrono::microseconds(1000000 / VISION_FILE_FPS);
+    auto next   = std::chrono::steady_clock::now();
+    VISION_RESULT result;
+
+    while (vision_running) {
+        if (!vision_step(&result)) {
+            // A camera that times out may come back, a recording is over
+            if (device_lost) {
+                reopen_device();
+                continue;
+            }
+            if (source_type == SOURCE_V4L2) {
+                continue;
+            }
+            break;
+        }
+
+        // Every frame is published so the continuous features keep flowing
+        gesture_ipc_publish({result.gesture, result.fingers, result.stamp_ns,
+                             result.cx, result.cy,
+                             static_cast<float>(result.area)
+                             / (ROI_SIZE * ROI_SIZE)});
+
+        // Recordings are replayed at camera speed
+        if (source_type == SOURCE_FILE) {
+            next += period;
+            std::this_thread::sleep_until(next);
+        }
+    }
+}
+
+uint8_t init_vision(const char *source) {
+    uint8_t err = vision_open(source);
+    if (err) {
+        return err;
+    }
+
+    vision_source  = source;
+    vision_running = true;
+    vision_thread = std::thread(vision_loop);
+    return VISION_SUCCESS;
+}
+
+void cleanup_vision() {
+    if (!vision_running.exchange(false)) {
+        return;
+    }
+    vision_thread.join();
+    vision_close();
+}
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "voices.hpp"
+
+void voices_reset(VOICE_POOL *pool, uint8_t size, VOICE_STEAL steal) {
+    pool->size       = std::clamp<uint8_t>(size, 1, MAX_VOICES);
+    pool->steal      = steal;
+    pool->active_cnt = 0;
+
+    // Lowest voices come out first
+    pool->idle_cnt = pool->size;
+    for (uint8_t i = 0; i < pool->size; i++) {
+        pool->idle[i] = pool->size - 1 - i;
+    }
+
+    for (uint8_t v = 0; v < MAX_VOICES; v++) {
+        pool->note[v]  = 0;
+        pool->held[v]  = false;
+        pool->level[v] = 0.0f;
+        pool->peak[v]  = 0.0f;
+        pool->fresh[v] = false;
+    }
+    std::fill(pool->voice_of, pool->voice_of + TUNING_NOTES, VOICE_NONE);
+}
+
+static bool drop_active(VOICE_POOL *pool, uint8_t voice) {
+    uint8_t *end = pool->active + pool->active_cnt;
+    uint8_t *at  = std::find(pool->active, end, voice);
+    if (at == end) {
+        return false;
+    }
+
+    // Shifting keeps the list in start order
+    std::copy(at + 1, end, at);
+    pool->active_cnt--;
+
+    if (pool->voice_of[pool->note[voice]] == voice) {
+        pool->voice_of[pool->note[voice]] = VOICE_NONE;
+    }
+    return true;
+}
+
+// Released voices go first; within a group, the oldest or the quietest
+static uint8_t victim(const VOICE_POOL *pool) {
+    for (int held = 0; held <= 1; held++) {
+        uint8_t best = VOICE_NONE;
+        for (uint8_t a = 0; a < pool->active_cnt; a++) {
+            uint8_t v = pool->active[a];
+            if (pool->held[v] != static_cast<bool>(held)) {
+                continue;
+            }
+            if (best == VOICE_NONE) {
+                best = v;
+                if (pool->steal == STEAL_OLDEST) {
+                    break;
+                }
+            } else if (pool->level[v] < pool->level[best]) {
+                best = v;
+            }
+        }
+        if (best != VOICE_NONE) {
+            return best;
+        }
+    }
+    return pool->active[0];
+}
+
+uint8_t voices_start(VOICE_POOL *pool, uint8_t note) {
+    voices_release(pool, note);
+
+    uint8_t voice;
+    if (pool->idle_cnt) {
+        voice = pool->idle[--pool->idle_cnt];
+    } else {
+        voice = victim(pool);
+        drop_active(pool, voice);
+    }
+
+    pool->note[voice]  = note;
+    pool->held[voice]  = true;
+    pool->level[voice] = 1.0f;  // Not a stealing candidate before it's heard
+    pool->peak[voice]  = 0.0f;
+    pool->fresh[voice] = true;
+    pool->active[pool->active_cnt++] = voice;
+    pool->voice_of[note] = voice;
+    return voice;
+}
+
+uint8_t voices_release(VOICE_POOL *pool, uint8_t note) {
+    uint8_t voice = pool->voice_of[note];
+    if (voice != VOICE_NONE) {
+        pool->held[voice]    = false;
+        pool->voice_of[note] = VOICE_NONE;
+    }
+    return voice;
+}
+
+void voices_free(VOICE_POOL *pool, uint8_t voice) {
+    if (voice >= pool->size || !drop_active(pool, voice)) {
+        return;
+    }
+    pool->held[voice] = false;
+    pool->idle[pool->idle_cnt++] = voice;
+}
+
+void voices_block_done(VOICE_POOL *pool) {
+    for (uint8_t a = 0; a < pool->active_cnt; a++) {
+        uint8_t v = pool->active[a];
+        if (pool->fresh[v]) {
+            pool->fresh[v] = false;
+        } else {
+            pool->level[v] = pool->peak[v];
+        }
+        pool->peak[v] = 0.0f;
+    }
+}
@@ -0,0 +1,214 @@
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <iostream>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "workers.hpp"
+
+// Just under the audio thread, which never waits on anything but them
+#define WORKER_RT_PRIORITY 79
+
+// Polls before sleeping: a worker covers the gap between two stretches of a
+// block, the caller the tail of the last task
+#define WORKER_SPIN 4000
+#define CALLER_SPIN 20000
+
+/*
+ * A batch is published as one word: generation, task count and next task.
+ * A claim is a compare-and-swap on it, so a worker that wakes up late can
+ * only ever take a task of the batch it saw, and nothing of the next one.
+ */
+#define CURSOR(gen, tasks, next) ((static_cast<uint64_t>(gen) << 32) \
+                                  | (static_cast<uint64_t>(tasks) << 16) \
+                                  | (next))
+#define CURSOR_GEN(c)   static_cast<uint32_t>((c) >> 32)
+#define CURSOR_TASKS(c) static_cast<uint16_t>((c) >> 16)
+#define CURSOR_NEXT(c)  static_cast<uint16_t>(c)
+
+typedef struct batch {
+    WORKER_TASK task;
+    void       *ctx;
+} BATCH;
+
+static pthread_t workers[MAX_WORKERS];
+static uint8_t   worker_cnt;
+
+static BATCH                 batch;
+static std::atomic<uint64_t> cursor;
+static std::atomic<uint32_t> generation;  // Futex word the workers sleep on
+static std::atomic<uint32_t> sleeping;
+static std::atomic<uint32_t> pending;     // Futex word the caller sleeps on
+static std::atomic<bool>     caller_waiting;
+static std::atomic<bool>     stopping;
+static std::atomic<uint64_t> inline_tasks;
+
+static long futex(std::atomic<uint32_t> *word, int op, uint32_t value) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), op, value,
+                   nullptr, nullptr, 0);
+}
+
+static inline void cpu_relax() {
+#if defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#elif defined(__x86_64__) || defined(__i386__)
+    asm volatile("pause");
+#endif
+}
+
+// Takes tasks of batch gen until none are left, returns how many it ran
+static uint32_t claim(uint32_t gen, uint8_t thread) {
+    uint32_t ran = 0;
+    uint64_t c   = cursor.load(std::memory_order_acquire);
+    while (CURSOR_GEN(c) == gen && CURSOR_NEXT(c) < CURSOR_TASKS(c)) {
+        if (!cursor.compare_exchange_weak(c, c + 1,
+                                          std::memory_order_acquire)) {
+            continue;
+        }
+
+        batch.task(batch.ctx, CURSOR_NEXT(c), thread);
+        ran++;
+
+        // The last one out lets a sleeping caller go
+        if (pending.fetch_sub(1) == 1 && caller_waiting.load()) {
+            futex(&pending, FUTEX_WAKE_PRIVATE, 1);
+        }
+        c = cursor.load(std::memory_order_acquire);
+    }
+    return ran;
+}
+
+static void *worker_loop(void *arg) {
+    uint8_t  thread = static_cast<uint8_t>(reinterpret_cast<uintptr_t>(arg));
+    uint32_t seen   = generation.load();
+
+    while (true) {
+        uint32_t gen = generation.load(std::memory_order_acquire);
+        for (int spin = 0; gen == seen && spin < WORKER_SPIN; spin++) {
+            cpu_relax();
+            gen = generation.load(std::memory_order_acquire);
+        }
+
+        if (gen == seen) {
+            sleeping.fetch_add(1);
+            // Only sleeps if nothing was published since the last look
+            futex(&generation, FUTEX_WAIT_PRIVATE, seen);
+            sleeping.fetch_sub(1);
+            continue;
+        }
+
+        seen = gen;
+        if (stopping.load()) {
+            return nullptr;
+        }
+        claim(gen, thread);
+    }
+}
+
+static void pin(pthread_t thread, uint8_t index) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores > 1) {
+        // Core 0 is left to the system and the audio thread
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(1 + index % (cores - 1), &set);
+        pthread_setaffinity_np(thread, sizeof(set), &set);
+    }
+
+    struct sched_param param = {};
+    param.sched_priority = WORKER_RT_PRIORITY;
+    if (pthread_setschedparam(thread, SCHED_FIFO, &param)) {
+        std::cerr << "Warning: render worker " << int(index)
+                  << " is not real-time" << std::endl;
+    }
+}
+
+uint8_t init_workers(uint8_t count) {
+    worker_cnt     = 0;
+    generation     = 0;
+    cursor         = 0;
+    pending        = 0;
+    sleeping       = 0;
+    stopping       = false;
+    caller_waiting = false;
+    inline_tasks   = 0;
+    if (!count) {
+        return WORKERS_SUCCESS;
+    }
+
+    std::cout << "  * starting " << int(count) << " render workers ...\n";
+    for (uint8_t w = 0; w < count && w < MAX_WORKERS; w++) {
+        // Threads 1.., the audio thread is 0
+        void *arg = reinterpret_cast<void *>(static_cast<uintptr_t>(w + 1));
+        if (pthread_create(&workers[w], nullptr, worker_loop, arg)) {
+            std::cerr << "Failed to start render worker " << int(w)
+                      << std::endl;
+            cleanup_workers();
+            return WORKERS_INITERR;
+        }
+        worker_cnt++;
+        pin(workers[w], w);
+    }
+    return WORKERS_SUCCESS;
+}
+
+// Only once the audio stream is stopped
+void cleanup_workers() {
+    if (!worker_cnt) {
+        return;
+    }
+
+    stopping = true;
+    generation.fetch_add(1, std::memory_order_release);
+    futex(&generation, FUTEX_WAKE_PRIVATE, INT_MAX);
+    for (uint8_t w = 0; w < worker_cnt; w++) {
+        pthread_join(workers[w], nullptr);
+    }
+    worker_cnt = 0;
+}
+
+uint8_t workers_count() {
+    return worker_cnt;
+}
+
+void workers_run(WORKER_TASK task, void *ctx, uint8_t tasks) {
+    if (!worker_cnt || tasks < 2) {
+        for (uint8_t t = 0; t < tasks; t++) {
+            task(ctx, t, 0);
+        }
+        return;
+    }
+
+    // The previous batch is over, nobody reads these until the cursor moves
+    batch = {task, ctx};
+    pending.store(tasks, std::memory_order_relaxed);
+    uint32_t gen = generation.load(std::memory_order_relaxed) + 1;
+    cursor.store(CURSOR(gen, tasks, 0), std::memory_order_release);
+    generation.store(gen);
+    if (sleeping.load()) {
+        futex(&generation, FUTEX_WAKE_PRIVATE, worker_cnt);
+    }
+
+    inline_tasks.fetch_add(claim(gen, 0), std::memory_order_relaxed);
+
+    // Whatever is left was started by a worker and has to be finished by it
+    uint32_t left = pending.load(std::memory_order_acquire);
+    for (int spin = 0; left && spin < CALLER_SPIN; spin++) {
+        cpu_relax();
+        left = pending.load(std::memory_order_acquire);
+    }
+    while (left) {
+        caller_waiting.store(true);
+        futex(&pending, FUTEX_WAIT_PRIVATE, left);
+        left = pending.load(std::memory_order_acquire);
+    }
+    caller_waiting.store(false);
+}
+
+uint64_t workers_inline() {
+    return inline_tasks.load(std::memory_order_relaxed);
+}